@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "global.hpp"
+#include "Vector.hpp"
+
+// adaptive sampling, "adaptive <threshold> <maxspp>" in config:
+// every pixel takes SPP samples, then keeps going in batches of ADAPTIVE_BATCH until the standard error
+// of its mean, relative to the mean, drops under the threshold or it has taken maxspp samples.
+// converged pixels stop early, noisy ones (caustics, glossy highlights) get the samples
+#define ADAPTIVE_BATCH 8			// samples between two convergence checks of a pixel
+#define ADAPTIVE_MIN_MEAN 1e-3		// floor of the mean in the relative error, dark pixels don't sample forever
+
+float ADAPTIVE_THRESHOLD = 0;		// relative error a pixel stops at, 0: off
+int ADAPTIVE_MAX_SPP = 0;			// samples a pixel takes at most
+
+inline bool adaptiveSampling() {
+	return ADAPTIVE_THRESHOLD > 0 && ADAPTIVE_MAX_SPP > SPP;
+}
+
+// running estimate of one pixel: color sum, and mean and variance of the luminance (Welford)
+class PixelEstimator {
+public:
+	void add(const Vector3f& v) {
+		n++;
+		sum = sum + v;
+		double y = 0.2126 * v.x + 0.7152 * v.y + 0.0722 * v.z;
+		double d = y - mean;
+		mean += d / n;
+		m2 += d * (y - mean);
+	}
+
+	// SPP samples without adaptive sampling, with it until converged or ADAPTIVE_MAX_SPP
+	bool done() const {
+		if (!adaptiveSampling()) return n >= SPP;
+		if (n >= ADAPTIVE_MAX_SPP) return true;
+		if (n < SPP || (n - SPP) % ADAPTIVE_BATCH) return false;
+		return relativeError() < ADAPTIVE_THRESHOLD;
+	}
+
+	// samples to take before done() can change its mind, for integrators that queue samples ahead
+	int pending() const {
+		if (done()) return 0;
+		if (n < SPP) return SPP - n;
+		return std::min(ADAPTIVE_BATCH - (n - SPP) % ADAPTIVE_BATCH, ADAPTIVE_MAX_SPP - n);
+	}
+
+	// standard error of the mean luminance over the mean
+	double relativeError() const {
+		if (n < 2) return INFINITY;
+		return std::sqrt(m2 / ((n - 1) * (double)n)) / std::max(mean, ADAPTIVE_MIN_MEAN);
+	}
+
+	Vector3f estimate() const { return n ? sum / (float)n : Vector3f(0.f); }
+	int count() const { return n; }
+
+private:
+	Vector3f sum;
+	int n = 0;
+	double mean = 0, m2 = 0;
+};
+
+// samples per pixel as a heatmap: black (none) - blue - green - yellow - red (ADAPTIVE_MAX_SPP)
+void writeSampleHeatmap(const std::string& name, const std::vector<int>& counts, int width, int height) {
+	std::ofstream out(name);
+	out << "P3\n" << width << "\n" << height << "\n255\n";
+	long long total = 0;
+	int lo = INT32_MAX, hi = 0;
+	for (int c : counts) {
+		float t = std::min(1.f, c / (float)std::max(1, ADAPTIVE_MAX_SPP));
+		// 4 segments between the 5 colors
+		static const float ramp[5][3] = { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } };
+		int seg = std::min(3, (int)(t * 4));
+		float f = t * 4 - seg;
+		for (int ch = 0; ch < 3; ch++)
+			out << (int)(255 * (ramp[seg][ch] * (1 - f) + ramp[seg + 1][ch] * f)) << (ch < 2 ? " " : "\n");
+		total += c;
+		lo = std::min(lo, c);
+		hi = std::max(hi, c);
+	}
+	std::cout << "adaptive sampling: " << (double)total / counts.size() << " samples per pixel on average, min " << lo
+		<< ", max " << hi << ", heatmap " << name << "\n";
+}
@@ -0,0 +1,26 @@
+#pragma once
+// counts the heap allocations of every thread, so the render loops can show they don't allocate
+// global operator new is replaced, every binary includes this from exactly one translation unit
+
+#include <new>
+#include <cstdlib>
+
+#include "global.hpp"
+
+#if COUNT_ALLOCS
+thread_local long long threadAllocs = 0;	// operator new calls of this thread so far
+
+void* operator new(std::size_t size) {
+	threadAllocs++;
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+#endif
@@ -2,6 +2,7 @@
 // Integrator: bdpt
 // only consider t >= 1 case 
 #include "IIntegrator.hpp"
+#include "AllocCounter.hpp"
 #include <omp.h>
 #include <thread>;
 
@@ -11,9 +12,6 @@
 #define T_CHECK 1
 #define CHECK_MIS 1			// when checking, set it 1 if want MIS res
 
-std::mutex mutex_color;
-omp_lock_t omp_lock_color;
-
 class BDPT;
 
 struct Thread_arg_bdpt {
@@ -25,10 +23,11 @@ struct Thread_arg_bdpt {
 	const Vector3f* eyePos;
 
 	PPMGenerator* g;
-	const BDPT* bdpt;
+	BDPT* bdpt;
+	SplatFilm* film;
 };
 
-void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e);
+void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, const Tile& tile);
 
 namespace bdpt {
 	struct eyePathVert {
@@ -54,6 +53,23 @@ namespace bdpt {
 		float carry_towardEye;
 		bool isDelta;
 	};
+
+	// vertices of one path with a fixed capacity, so building paths never touches the heap
+	// every render thread keeps one eye path and one light path and reuses them for all its samples
+	template <typename Vert, int N>
+	struct PathBuffer {
+		Vert verts[N];
+		int n = 0;
+
+		int size() const { return n; }
+		void clear() { n = 0; }
+		// slot after the last vertex, fill it in place and push() to keep it
+		Vert& next() { return verts[n]; }
+		void push() { n++; }
+		Vert& operator[](int i) { return verts[i]; }
+	};
+	typedef PathBuffer<eyePathVert, MAX_PATHLENGTH + 1> EyePath;	// camera vertex + MAX_PATHLENGTH
+	typedef PathBuffer<lightPathVert, MAX_PATHLENGTH> LightPath;	// no t = 0 case
 }
 
 class BDPT : public IIntegrator{
@@ -62,17 +78,19 @@ public:
 	BDPT(PPMGenerator* g, IIntersectStrategy* inters) {
 		this->g = g;
 		this->interStrategy = inters;
-		omp_init_lock(&omp_lock_color);
 		omp_init_lock(&light_lock_omp);
 	}
 
+	std::atomic<long long> sampleAllocs{ 0 };	// heap allocations of the render threads, see COUNT_ALLOCS
+
 	// given the actual path strategy s = s, t = t, compute the mis weight of this strategy
-	float MISweight(std::vector<bdpt::eyePathVert>& epverts, std::vector<bdpt::lightPathVert>& lpverts,
-		int s, int t, Camera &cam) {
+	float MISweight(bdpt::EyePath& epverts, bdpt::LightPath& lpverts, int s, int t, Camera &cam) {
+		PROF_COUNT(PROF_MIS_WEIGHTS);
 		// refer to https://pbr-book.org/3ed-2018/Light_Transport_III_Bidirectional_Methods/Bidirectional_Path_Tracing 16.3.4
 		// refer "A LOT" to https://rendering-memo.blogspot.com/2016/03/bidirectional-path-tracing-8-combine.html
-		// direct visible light
-		if (s + t == 2) return 1;
+		// direct visible light. the callers have s + t >= 2, <= also tells the compiler that the s == 0 case
+		// below has t >= 3, so epverts[t - 2] is never epverts[-1]
+		if (s + t <= 2) return 1;
 		// protect epverts and lpverts
 		float pdf_tEndFwd, pdf_tEndRev, pdf_sEndFwd, pdf_sEndRev, G_connect;
 
@@ -81,8 +99,8 @@ public:
 		// assume epverts[t-1] is light: before calling this function, it is already checked
 		if (s == 0) {
 			// epverts[t-1] is on the light
-			bdpt::eyePathVert lightPrev = epverts[t - 2];
-			bdpt::eyePathVert lightvert = epverts[t - 1];
+			bdpt::eyePathVert& lightPrev = epverts[t - 2];
+			bdpt::eyePathVert& lightvert = epverts[t - 1];
 			Vector3f wo = normalized(lightPrev.inter.pos - lightvert.inter.pos);
 			float cos = abs(lightvert.inter.Ng.dot(wo));
 			float dirpdf = cos / M_PI;
@@ -93,8 +111,8 @@ public:
 			// No sEnd pdfs
 		}
 		else {
-			bdpt::lightPathVert sEndvert = lpverts[s - 1];
-			bdpt::eyePathVert tEndvert = epverts[t - 1];
+			bdpt::lightPathVert& sEndvert = lpverts[s - 1];
+			bdpt::eyePathVert& tEndvert = epverts[t - 1];
 			G_connect = Geo(sEndvert.inter.pos, sEndvert.inter.Ng, tEndvert.inter.pos, tEndvert.inter.Ng);
 			Vector3f tEnd2sEnd = normalized(sEndvert.inter.pos - tEndvert.inter.pos);
 			// reevaluate direction pdf
@@ -106,9 +124,9 @@ public:
 				pdf_tEndRev = cam.lensAreaInv;	// no actual reverse pdf
 
 				Vector3f s2prev = normalized(lpverts[s - 2].inter.pos - sEndvert.inter.pos);
-				pdf_sEndFwd = sEndvert.inter.mtlcolor.pdf(-cam2sEnd, s2prev, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtlcolor.eta)
+				pdf_sEndFwd = sEndvert.inter.mtl->pdf(sEndvert.inter.surface, -cam2sEnd, s2prev, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtl->eta)
 					/ abs((-cam2sEnd).dot(sEndvert.inter.Ng));
-				pdf_sEndRev = sEndvert.inter.mtlcolor.pdf(s2prev, -cam2sEnd, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtlcolor.eta)
+				pdf_sEndRev = sEndvert.inter.mtl->pdf(sEndvert.inter.surface, s2prev, -cam2sEnd, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtl->eta)
 					/ abs(s2prev.dot(sEndvert.inter.Ng));
 			}
 			else if (s == 1) {
@@ -118,9 +136,9 @@ public:
 				pdf_sEndRev = sEndvert.revPdf;	// no actual reverse pdf
 
 				Vector3f t2prev = normalized(epverts[t - 2].inter.pos - tEndvert.inter.pos);
-				pdf_tEndFwd = tEndvert.inter.mtlcolor.pdf(-light2tEnd, t2prev, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtlcolor.eta)
+				pdf_tEndFwd = tEndvert.inter.mtl->pdf(tEndvert.inter.surface, -light2tEnd, t2prev, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtl->eta)
 					/ abs((-light2tEnd).dot(tEndvert.inter.Ng));
-				pdf_tEndRev = tEndvert.inter.mtlcolor.pdf(t2prev, -light2tEnd, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtlcolor.eta)
+				pdf_tEndRev = tEndvert.inter.mtl->pdf(tEndvert.inter.surface, t2prev, -light2tEnd, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtl->eta)
 					/ abs(t2prev.dot(tEndvert.inter.Ng));
 			}
 			// most cases
@@ -129,14 +147,14 @@ public:
 				Vector3f s2prev = normalized(lpverts[s - 2].inter.pos - sEndvert.inter.pos);
 				Vector3f t2prev = normalized(epverts[t - 2].inter.pos - tEndvert.inter.pos);
 
-				pdf_sEndFwd = sEndvert.inter.mtlcolor.pdf(s2t, s2prev, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtlcolor.eta)
+				pdf_sEndFwd = sEndvert.inter.mtl->pdf(sEndvert.inter.surface, s2t, s2prev, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtl->eta)
 					/ abs(s2t.dot((sEndvert.inter.Ng)));
-				pdf_sEndRev = sEndvert.inter.mtlcolor.pdf(s2prev, s2t, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtlcolor.eta)
+				pdf_sEndRev = sEndvert.inter.mtl->pdf(sEndvert.inter.surface, s2prev, s2t, sEndvert.inter.Ns, g->eta, sEndvert.inter.mtl->eta)
 					/ abs(s2prev.dot((sEndvert.inter.Ng)));
 
-				pdf_tEndFwd = tEndvert.inter.mtlcolor.pdf(-s2t, t2prev, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtlcolor.eta)
+				pdf_tEndFwd = tEndvert.inter.mtl->pdf(tEndvert.inter.surface, -s2t, t2prev, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtl->eta)
 					/ abs((-s2t).dot(tEndvert.inter.Ng));
-				pdf_tEndRev = tEndvert.inter.mtlcolor.pdf(t2prev, -s2t, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtlcolor.eta)
+				pdf_tEndRev = tEndvert.inter.mtl->pdf(tEndvert.inter.surface, t2prev, -s2t, tEndvert.inter.Ns, g->eta, tEndvert.inter.mtl->eta)
 					/ abs(t2prev.dot(tEndvert.inter.Ng));
 			}
 		}
@@ -144,7 +162,7 @@ public:
 
 		// ************************* initializing mis nodes *******************************
 		// if s=2,t=2: x0 x1 x2 x3 x4,		x0 on the light, x4 on the eye
-		std::vector<bdpt::misNode> misnodes(s + t, bdpt::misNode());
+		bdpt::misNode misnodes[MAX_PATHLENGTH + 1] = {};	// s + t <= MAX_PATHLENGTH + 1
 		// initialize mis nodes k = s + t - 1
 		// light path part: i < s  <= k - 1 		k - 1 because I exclude the case t = 0
 		// p0 to p(k-1), 0 is toward the dir of light, k is toward the dir of camera
@@ -221,20 +239,18 @@ public:
 		return 1 / denominator;
 	}
 
-	// build eye path vertices
+	// build eye path vertices after the camera vertex epverts[0], starting at the first hit with throughput tp
 	// end if ( !intersected || intersect light ||  vertice number >= MAX_PATHLENGTH + 1)
-	void buildEyePath(std::vector<bdpt::eyePathVert>& epverts) {
-		Vector3f tp = epverts[1].throughput;
-		Intersection nxtInter = epverts[1].inter;
-		Vector3f wi = normalized(epverts[1].inter.pos - epverts[0].inter.pos);
+	void buildEyePath(bdpt::EyePath& epverts, const Intersection& firstHit, Vector3f tp) {
+		Intersection nxtInter = firstHit;
+		Vector3f wi = normalized(firstHit.pos - epverts[0].inter.pos);
 
-		epverts.pop_back();
 		float dirPdf = 0;	// pdf_w
 		Vector3f orig;
 		int size = epverts.size();
 
 		while (size < MAX_PATHLENGTH + 1) {
-			bdpt::eyePathVert ev;
+			bdpt::eyePathVert& ev = epverts.next();
 			ev.inter = nxtInter;
 			ev.throughput = tp;
 
@@ -243,11 +259,12 @@ public:
 
 			// sample next inter
 			Vector3f wo = -wi;
-			auto [success, TIR] = ev.inter.mtlcolor.sampleDirection(wo, ev.inter.Ns, wi, g->eta);
+			startBounce(size - 1, SLOT_BSDF);
+			auto [success, TIR] = ev.inter.mtl->sampleDirection(ev.inter.surface, wo, ev.inter.Ns, wi, g->eta);
 			if (!success) break;
 
 			wi = normalized(wi);
-			dirPdf = ev.inter.mtlcolor.pdf(wi, wo, ev.inter.Ns, g->eta, ev.inter.mtlcolor.eta);
+			dirPdf = ev.inter.mtl->pdf(ev.inter.surface, wi, wo, ev.inter.Ns, g->eta, ev.inter.mtl->eta);
 			if (TIR) {
 				wi = normalized(getReflectionDir(wo, ev.inter.Ns));
 				dirPdf = 1;
@@ -256,25 +273,25 @@ public:
 			float cos = abs(wi.dot(ev.inter.Ng));
 			ev.fwdPdf = dirPdf / cos;
 
-			if (ev.inter.mtlcolor.mType == PERFECT_REFLECTIVE || ev.inter.mtlcolor.mType == PERFECT_REFRACTIVE) {
+			if (ev.inter.mtl->mType == PERFECT_REFLECTIVE || ev.inter.mtl->mType == PERFECT_REFRACTIVE) {
 				ev.revPdf = ev.fwdPdf;
 				ev.isDelta = true;
 			}
 			else {
-				ev.revPdf = ev.inter.mtlcolor.pdf(wo, wi, ev.inter.Ns, g->eta, ev.inter.mtlcolor.eta);
+				ev.revPdf = ev.inter.mtl->pdf(ev.inter.surface, wo, wi, ev.inter.Ns, g->eta, ev.inter.mtl->eta);
 				ev.revPdf = ev.revPdf / abs(wo.dot(ev.inter.Ng));
 				ev.isDelta = false;
 			}
-			bdpt::eyePathVert pre = epverts[size - 1];
+			bdpt::eyePathVert& pre = epverts[size - 1];
 			ev.G = Geo(pre.inter.pos, pre.inter.Ng, ev.inter.pos, ev.inter.Ng);
-			epverts.emplace_back(ev);
+			epverts.push();
 
 			// if eye vertex == light, forming a C(t=n,s=0) case
-			if (ev.inter.mtlcolor.hasEmission())
+			if (ev.inter.mtl->hasEmission())
 				return;
 
 			// for next vertex
-			Vector3f bsdf = ev.inter.mtlcolor.BxDF(wi, wo, ev.inter.Ng, ev.inter.Ns, g->eta, false, TIR);
+			Vector3f bsdf = ev.inter.mtl->BxDF(ev.inter.surface, wi, wo, ev.inter.Ng, ev.inter.Ns, g->eta, false, TIR);
 			if (dirPdf < MIN_DIVISOR)
 				break;
 			tp = tp * bsdf * cos / dirPdf;
@@ -293,16 +310,17 @@ public:
 	}
 
 	// end if ( !intersected || intersect light ||  vertice number >= MAX_PATHLENGTH + 1)
-	void buildLightPath(std::vector<bdpt::lightPathVert>& lpverts) {
+	void buildLightPath(bdpt::LightPath& lpverts) {
 		// sample light position
 		Intersection lightInter;
 		float pickpdf;
+		startBounce(0, SLOT_LIGHT, STREAM_LIGHT);
 		sampleLight(lightInter, pickpdf, g);
 		float pdf;
 
 		// s = 1
 		Vector3f tp = 1 / pickpdf;
-		bdpt::lightPathVert lpv;
+		bdpt::lightPathVert& lpv = lpverts.next();
 		lpv.inter = lightInter;
 		lpv.throughput = tp;
 		pdf = pickpdf;
@@ -311,12 +329,13 @@ public:
 
 		float dirPdf;
 		Vector3f wi;
+		startBounce(0, SLOT_BSDF, STREAM_LIGHT);
 		if (!sampleLightDir(lightInter.Ng, dirPdf, wi))
 			return;
 		wi = normalized(wi);
 		float wi_n_cos = abs(wi.dot(lightInter.Ng));
 		lpv.fwdPdf = dirPdf / wi_n_cos;
-		lpverts.emplace_back(lpv);
+		lpverts.push();
 		// for s = 2
 		tp = lpverts[0].throughput * wi_n_cos / dirPdf;
 
@@ -326,13 +345,13 @@ public:
 		interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
 		if (!nxtInter.intersected)
 			return;
-		if (nxtInter.mtlcolor.hasEmission())
+		if (nxtInter.mtl->hasEmission())
 			return;
 
 		// random walk
 		int size = lpverts.size();
 		while (size < MAX_PATHLENGTH) {	// no t = 0 case
-			bdpt::lightPathVert lv;
+			bdpt::lightPathVert& lv = lpverts.next();
 			lv.inter = nxtInter;
 			lv.throughput = tp;
 
@@ -341,11 +360,12 @@ public:
 
 			// sample next inter
 			Vector3f wo = -wi;
-			auto [success, TIR] = lv.inter.mtlcolor.sampleDirection(wo, lv.inter.Ns, wi, g->eta);
+			startBounce(size, SLOT_BSDF, STREAM_LIGHT);
+			auto [success, TIR] = lv.inter.mtl->sampleDirection(lv.inter.surface, wo, lv.inter.Ns, wi, g->eta);
 			if (!success) break;
 
 			wi = normalized(wi);
-			dirPdf = lv.inter.mtlcolor.pdf(wi, wo, lv.inter.Ns, g->eta, lv.inter.mtlcolor.eta);
+			dirPdf = lv.inter.mtl->pdf(lv.inter.surface, wi, wo, lv.inter.Ns, g->eta, lv.inter.mtl->eta);
 
 			if (TIR) {
 				wi = normalized(getReflectionDir(wo, lv.inter.Ns));
@@ -355,24 +375,24 @@ public:
 			float cos = abs(wi.dot(lv.inter.Ng));
 			lv.fwdPdf = dirPdf / cos;
 
-			if (lv.inter.mtlcolor.mType == PERFECT_REFLECTIVE || lv.inter.mtlcolor.mType == PERFECT_REFRACTIVE) {
+			if (lv.inter.mtl->mType == PERFECT_REFLECTIVE || lv.inter.mtl->mType == PERFECT_REFRACTIVE) {
 				lv.revPdf = lv.fwdPdf;
 				lv.isDelta = true;
 			}
 			else {
-				lv.revPdf = lv.inter.mtlcolor.pdf(wo, wi, lv.inter.Ns, g->eta, lv.inter.mtlcolor.eta);
+				lv.revPdf = lv.inter.mtl->pdf(lv.inter.surface, wo, wi, lv.inter.Ns, g->eta, lv.inter.mtl->eta);
 				lv.revPdf = lv.revPdf / abs(wo.dot(lv.inter.Ng));
 				lv.isDelta = false;
 			}
-			bdpt::lightPathVert pre = lpverts[size - 1];
+			bdpt::lightPathVert& pre = lpverts[size - 1];
 			lv.G = Geo(pre.inter.pos, pre.inter.Ng, lv.inter.pos, lv.inter.Ng);
-			lpverts.emplace_back(lv);
+			lpverts.push();
 
-			if (lv.inter.mtlcolor.hasEmission())
+			if (lv.inter.mtl->hasEmission())
 				return;
 
 			// for next vertex
-			Vector3f bsdf = lv.inter.mtlcolor.BxDF(wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true, TIR);
+			Vector3f bsdf = lv.inter.mtl->BxDF(lv.inter.surface, wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true, TIR);
 			if (dirPdf < MIN_DIVISOR)
 				break;
 			tp = tp * bsdf * cos / dirPdf;
@@ -419,12 +439,29 @@ public:
 
 #if MULTITHREAD == 0
 		// through each pixel
+		Vector3f rayOrigs[RAY_PACKET_SIZE];
+		Vector3f rayDirs[RAY_PACKET_SIZE];
+		Intersection primaryInters[RAY_PACKET_SIZE];
+		bdpt::EyePath epverts;
+		bdpt::LightPath lpverts;
 		for (int y = 0; y < g->height; y++) {
 			Vector3f v_off = y * delta_v;
 			for (int x = 0; x < g->width; x++) {
 				//if (x == 623 && y == 745) {
 				//	PRINT = true;
 				//}
+
+				// camera rays of the next few pixels in the row go as one packet,
+				// every sample of a pixel shoots the same ray so the first hit is reused
+				if (x % RAY_PACKET_SIZE == 0) {
+					int nRays = std::min(RAY_PACKET_SIZE, g->width - x);
+					for (int k = 0; k < nRays; k++) {
+						rayOrigs[k] = eyePos;
+						rayDirs[k] = normalized(ul + (x + k) * delta_h + v_off + c_off_h + c_off_v - eyePos);
+					}
+					PROF_ADD(PROF_CAMERA_RAYS, nRays);
+					interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, nRays);
+				}
 				Vector3f& color = g->cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
 				Vector3f h_off = x * delta_h;
 				Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
@@ -432,15 +469,26 @@ public:
 
 				rayDir = normalized(pixelPos - eyePos);
 				Vector3f estimate;
+				Intersection jitteredHit;
 				for (int i = 0; i < SPP; i++) {
-					std::vector<bdpt::eyePathVert> epverts;
-					std::vector<bdpt::lightPathVert> lpverts;
-
+					startSample(g->getIndex(x, y), i);
+					epverts.clear();
+					lpverts.clear();
 
+					// every sample reuses the packet's first hit unless it shoots through its own spot of the pixel
+					Vector3f samplePos = pixelPos;
 					Vector3f wi = rayDir;
+					const Intersection* firstHit = &primaryInters[x % RAY_PACKET_SIZE];
+					if (PIXEL_JITTER) {
+						samplePos = jitterPixel(pixelPos, delta_h, delta_v);
+						wi = normalized(samplePos - eyePos);
+						PROF_COUNT(PROF_CAMERA_RAYS);
+						interStrategy->UpdateInter(jitteredHit, g->scene, eyePos, wi);
+						firstHit = &jitteredHit;
+					}
 					// build eye path vertices
 					// add camera point and first intersection vertex
-					bdpt::eyePathVert ev;
+					bdpt::eyePathVert& ev = epverts.next();
 					ev.inter.pos = eyePos;
 					ev.inter.intersected = true;
 					ev.inter.Ng = cam.fwdDir;
@@ -448,30 +496,23 @@ public:
 					ev.revPdf = cam.lensAreaInv;	// no reverse pdf for t = 1 case, here just to store the pdf of sampling camera point
 					
 					float wi_n_cos = abs(wi.dot(cam.fwdDir));
-					float d2 = (pixelPos - cam.position).norm2();
+					float d2 = (samplePos - cam.position).norm2();
 					ev.fwdPdf = d2 * cam.filmPlaneAreaInv / wi_n_cos;
 					ev.fwdPdf = ev.fwdPdf / wi_n_cos;	// projected solid angle pdf
 					ev.isDelta = false;
-
-					epverts.emplace_back(ev);
+					epverts.push();
 
 					float pdfCam_w = d2 * cam.lensAreaInv * cam.filmPlaneAreaInv / wi_n_cos;
 					Vector3f tp = epverts[0].throughput * wi_n_cos / pdfCam_w;
-					Intersection eVert2;
-					interStrategy->UpdateInter(eVert2, g->scene, eyePos, wi);
-					if (!eVert2.intersected)
-						break;
-
-					ev.inter = eVert2;
-					ev.throughput = tp;
-
-					epverts.emplace_back(ev);
-					buildEyePath(epverts);
+					const Intersection& eVert2 = *firstHit;
+					// the light path goes out even if the camera ray misses, its t = 1 splats still count
+					if (eVert2.intersected)
+						buildEyePath(epverts, eVert2, tp);
 					buildLightPath(lpverts);
 
 
 					Intersection pixelInter;
-					pixelInter.pos = pixelPos;
+					pixelInter.pos = samplePos;
 					Vector3f we = We(pixelInter, cam);
 					Vector3f contrib;
 
@@ -495,9 +536,9 @@ public:
 							// s == 0 case: naive path tracing
 							// no connection, so no G term
 							if (s == 0) {
-								bdpt::eyePathVert ev = epverts[t-1];
-								if (!ev.inter.mtlcolor.hasEmission()) continue;
-								Vector3f l = ev.inter.mtlcolor.emission;
+								bdpt::eyePathVert& ev = epverts[t - 1];
+								if (!ev.inter.mtl->hasEmission()) continue;
+								Vector3f l = ev.inter.mtl->emission;
 								contrib = we * ev.throughput * l * SPP_inv;
 								if (contrib.norm2() == 0) continue;
 								//if (isnan(contrib.x) || isinf(contrib.x)) continue;
@@ -511,9 +552,9 @@ public:
 							// light tracing and connect to camera case
 							// the pixel getting contribution need to be reevaluated
 							if (t == 1) {
-								bdpt::lightPathVert lv = lpverts[s - 1];
-								if (lv.inter.mtlcolor.hasEmission()) continue;
-								Vector3f l = lpverts[0].inter.mtlcolor.emission;
+								bdpt::lightPathVert& lv = lpverts[s - 1];
+								if (lv.inter.mtl->hasEmission()) continue;
+								Vector3f l = lpverts[0].inter.mtl->emission;
 								Vector3f orig = lv.inter.pos;
 								Vector3f wi = normalized(cam.position - orig);
 								Vector3f wo;
@@ -526,7 +567,7 @@ public:
 								else {
 									wo = normalized(lpverts[s - 2].inter.pos - lv.inter.pos);
 									rayInside =  wi.dot(lv.inter.Ns) < 0;
-									bsdf = lv.inter.mtlcolor.BxDF(wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
+									bsdf = lv.inter.mtl->BxDF(lv.inter.surface, wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
 								}
 								float G = Geo(cam.position, cam.fwdDir, lv.inter.pos, lv.inter.Ng);
 								Vector3f we = We(lv.inter, cam);
@@ -537,7 +578,7 @@ public:
 
 								// connect to camera
 								offsetRayOrig(orig, lv.inter.Ns, rayInside);
-								if (!isShadowRayBlocked(orig, cam.position, g) && wi.dot(cam.fwdDir) < 0) {
+								if (!isShadowRayBlocked(orig, cam.position, g, interStrategy) && wi.dot(cam.fwdDir) < 0) {
 									int index = cam.worldPos2PixelIndex(lv.inter.pos);
 
 #if CHECK
@@ -548,15 +589,15 @@ public:
 								continue;
 							}
 
-							bdpt::lightPathVert lv = lpverts[s - 1];
-							Vector3f l = lpverts[0].inter.mtlcolor.emission;
-							bdpt::eyePathVert ev = epverts[t - 1];
-							if (ev.inter.mtlcolor.hasEmission())
+							bdpt::lightPathVert& lv = lpverts[s - 1];
+							Vector3f l = lpverts[0].inter.mtl->emission;
+							bdpt::eyePathVert& ev = epverts[t - 1];
+							if (ev.inter.mtl->hasEmission())
 								continue;
 
 							Vector3f connectDir = normalized(ev.inter.pos - lv.inter.pos);
 							Vector3f e_wo = normalized(epverts[t - 2].inter.pos - ev.inter.pos);
-							Vector3f evBSDF = ev.inter.mtlcolor.BxDF(-connectDir, e_wo, ev.inter.Ng, ev.inter.Ns, g->eta);
+							Vector3f evBSDF = ev.inter.mtl->BxDF(ev.inter.surface, -connectDir, e_wo, ev.inter.Ng, ev.inter.Ns, g->eta);
 
 							Vector3f lvBSDF;
 							Vector3f l_wo;
@@ -567,7 +608,7 @@ public:
 							}
 							else {
 								l_wo = normalized(lpverts[s - 2].inter.pos - lv.inter.pos);
-								lvBSDF = lv.inter.mtlcolor.BxDF(connectDir, l_wo, lv.inter.Ng, lv.inter.Ns, g->eta);
+								lvBSDF = lv.inter.mtl->BxDF(lv.inter.surface, connectDir, l_wo, lv.inter.Ng, lv.inter.Ns, g->eta);
 							}
 							// connecting 
 							// check if two points are not blocked
@@ -585,7 +626,7 @@ public:
 								offsetRayOrig(lorig, lv.inter.Ns, rayInside);
 							}
 							
-							if (isShadowRayBlocked(eOrig, lorig, g))
+							if (isShadowRayBlocked(eOrig, lorig, g, interStrategy))
 								continue;
 
 							float G = Geo(ev.inter.pos, ev.inter.Ng, lv.inter.pos, lv.inter.Ng);
@@ -604,44 +645,9 @@ public:
 			}
 		}
 
-#elif MULTITHREAD == 1
-		int rowPerthd = g->height / N_THREAD;
-		std::thread thds[N_THREAD];
-
-		for (int i = 0; i < N_THREAD - 1; i++) {
-			Thread_arg_bdpt arg{
-				&ul,
-				&delta_v,
-				&delta_h,
-				&c_off_h,
-				&c_off_v,
-				&eyePos,
-				g,
-				this
-			};
-			// if((i * rowPerthd) <= 147 && 147 < ((i + 1) * rowPerthd))
-			thds[i] = std::thread(sub_render_bdpt, &arg, i, (i * rowPerthd), ((i + 1) * rowPerthd));
-		}
-
-		// last thread
-		Thread_arg_bdpt arg_end{
-				&ul,
-				&delta_v,
-				&delta_h,
-				&c_off_h,
-				&c_off_v,
-				&eyePos,
-				g,
-				this
-		};
-		thds[N_THREAD - 1] = std::thread(sub_render_bdpt, &arg_end, N_THREAD - 1, (N_THREAD - 1) * rowPerthd, g->height);
-
-		for (int i = 0; i < N_THREAD; i++) {
-			thds[i].join();
-		}
-
-#elif MULTITHREAD == 2
-		int rowPerthd = g->height / N_THREAD;
+#else
+		sampleAllocs = 0;
+		SplatFilm film(cam.FrameBuffer, N_THREAD);
 		Thread_arg_bdpt arg{
 				&ul,
 				&delta_v,
@@ -650,33 +656,38 @@ public:
 				&c_off_v,
 				&eyePos,
 				g,
-				this
+				this,
+				&film
 		};
-
-		#pragma omp parallel for
-		for (int i = 0; i < N_THREAD - 1; i++)
-			sub_render_bdpt(&arg, i, (i * rowPerthd), ((i + 1) * rowPerthd));
-
-		Thread_arg_bdpt arg_end{
-			&ul,
-			&delta_v,
-			&delta_h,
-			&c_off_h,
-			&c_off_v,
-			&eyePos,
-			g,
-			this
-		};
-		#pragma omp parallel for
-		for (int i = 0; i < 1; i++)
-			sub_render_bdpt(&arg_end, N_THREAD - 1, (N_THREAD - 1) * rowPerthd, g->height);
+		TileScheduler scheduler(g->width, g->height, N_THREAD);
+#if MULTITHREAD == 1
+		scheduler.run([&](const Tile& tile, int threadID) {
+			PROF_STAGE(STAGE_TILE);
+			sub_render_bdpt(&arg, threadID, tile);
+		});
+#elif MULTITHREAD == 2
+		// openmp hands out the tiles itself
+		std::vector<Tile> tiles = scheduler.getTiles();
+		#pragma omp parallel for schedule(dynamic) num_threads(N_THREAD)
+		for (int i = 0; i < tiles.size(); i++)
+			sub_render_bdpt(&arg, omp_get_thread_num(), tiles[i]);
+#endif
+		// the splats assume SPP light paths per pixel, with adaptive sampling there were
+		// total / (width * height) on average
+		long long totalSamples = 0;
+		for (int c : cam.sampleCount) totalSamples += c;
+		film.merge((double)SPP * cam.sampleCount.size() / std::max(1LL, totalSamples));
+#if COUNT_ALLOCS
+		std::cout << "heap allocations while rendering: " << sampleAllocs << ", per sample: "
+			<< sampleAllocs / ((double)g->width * g->height * SPP) << "\n";
+#endif
 #endif
 	}
 };
 
 
 
-void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
+void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, const Tile& tile) {
 	Thread_arg_bdpt arg = *a;
 
 	const Vector3f ul = *arg.ul;
@@ -687,31 +698,63 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 	PPMGenerator* g = arg.g;
 	std::vector<Vector3f>* rgb_array = &(g->cam.FrameBuffer.rgb);
 	const Vector3f eyePos = *arg.eyePos;
-	int Ncol = g->width;
 	Camera& cam = g->cam;
-	BDPT bdpt = *a->bdpt;
-
-	for (int y = s; y < e; y++) {
+	BDPT& bdpt = *a->bdpt;
+
+	Vector3f rayOrigs[RAY_PACKET_SIZE];
+	Vector3f rayDirs[RAY_PACKET_SIZE];
+	Intersection primaryInters[RAY_PACKET_SIZE];
+	bdpt::EyePath epverts;		// reused by every sample of the tile
+	bdpt::LightPath lpverts;
+#if COUNT_ALLOCS
+	long long allocs = threadAllocs;
+#endif
+	for (int y = tile.y0; y < tile.y1; y++) {
 		Vector3f v_off = y * delta_v;
-		for (int x = 0; x < Ncol; x++) {
+		for (int x = tile.x0; x < tile.x1; x++) {
+			// camera rays of the next few pixels in the row go as one packet,
+			// every sample of a pixel shoots the same ray so the first hit is reused
+			if ((x - tile.x0) % RAY_PACKET_SIZE == 0) {
+				int nRays = std::min(RAY_PACKET_SIZE, tile.x1 - x);
+				for (int k = 0; k < nRays; k++) {
+					rayOrigs[k] = eyePos;
+					rayDirs[k] = normalized(ul + (x + k) * delta_h + v_off + c_off_h + c_off_v - eyePos);
+				}
+				PROF_ADD(PROF_CAMERA_RAYS, nRays);
+				bdpt.interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, nRays);
+			}
 
 			Vector3f& color = cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
 			Vector3f h_off = x * delta_h;
 			Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
 			Vector3f rayDir;
 			rayDir = normalized(pixelPos - eyePos);
-			Vector3f estimate;
+			PixelEstimator est;
+			Vector3f estimate;		// contribution of the current sample
 			//if (x == 725 && y == 709)
 			//	int a = 0;
 
-			for (int i = 0; i < SPP; i++) {
-				std::vector<bdpt::eyePathVert> epverts;
-				std::vector<bdpt::lightPathVert> lpverts;
+			Intersection jitteredHit;
+			for (int i = 0; !est.done(); est.add(estimate), i++) {
+				startSample(g->getIndex(x, y), i);
+				estimate = 0;
+				epverts.clear();
+				lpverts.clear();
 
+				// every sample reuses the packet's first hit unless it shoots through its own spot of the pixel
+				Vector3f samplePos = pixelPos;
 				Vector3f wi = rayDir;
+				const Intersection* firstHit = &primaryInters[(x - tile.x0) % RAY_PACKET_SIZE];
+				if (PIXEL_JITTER) {
+					samplePos = jitterPixel(pixelPos, delta_h, delta_v);
+					wi = normalized(samplePos - eyePos);
+					PROF_COUNT(PROF_CAMERA_RAYS);
+					bdpt.interStrategy->UpdateInter(jitteredHit, g->scene, eyePos, wi);
+					firstHit = &jitteredHit;
+				}
 				// build eye path vertices
 				// add camera point and first intersection vertex
-				bdpt::eyePathVert ev;
+				bdpt::eyePathVert& ev = epverts.next();
 				ev.inter.pos = eyePos;
 				ev.inter.intersected = true;
 				ev.inter.Ng = cam.fwdDir;
@@ -719,35 +762,28 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 				ev.revPdf = cam.lensAreaInv;	// no reverse pdf for t = 1 case, here just to store the pdf of sampling camera point
 
 				float wi_n_cos = abs(wi.dot(cam.fwdDir));
-				float d2 = (pixelPos - cam.position).norm2();
+				float d2 = (samplePos - cam.position).norm2();
 				ev.fwdPdf = d2 * cam.filmPlaneAreaInv / wi_n_cos;
 				ev.fwdPdf = ev.fwdPdf / wi_n_cos;	// projected solid angle pdf
 				ev.isDelta = false;
+				epverts.push();
 
-				epverts.emplace_back(ev);
-				
 				float pdfCam_w = d2 * cam.lensAreaInv * cam.filmPlaneAreaInv / wi_n_cos;
 				Vector3f tp = epverts[0].throughput * wi_n_cos / pdfCam_w;
-				Intersection eVert2;
-				bdpt.interStrategy->UpdateInter(eVert2, g->scene, eyePos, wi);
-				if (!eVert2.intersected)
-					break;
-
-				ev.inter = eVert2;
-				ev.throughput = tp;
-
-				epverts.emplace_back(ev);
-				bdpt.buildEyePath(epverts);
+				const Intersection& eVert2 = *firstHit;
+				// the light path goes out even if the camera ray misses, its t = 1 splats still count
+				if (eVert2.intersected)
+					bdpt.buildEyePath(epverts, eVert2, tp);
 				bdpt.buildLightPath(lpverts);
 
 				Intersection pixelInter;
-				pixelInter.pos = pixelPos;
+				pixelInter.pos = samplePos;
 				Vector3f we = We(pixelInter, cam);
 				Vector3f contrib;
 
 				// compute contribution
 				// only t >= 1 case contribute
-				if (epverts.size() < 2)
+				if (epverts.size() < 1)
 					continue;
 				for (int pathLength = 1; pathLength <= MAX_PATHLENGTH; pathLength++) {
 					// for path with pathLength, list all possible strategies 
@@ -764,13 +800,13 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 						// s == 0 case: naive path tracing
 						// no connection, so no G term
 						if (s == 0) {
-							if (ev.inter.mtlcolor.mType == UNLIT) {
-								estimate += ev.inter.mtlcolor.diffuse;
+							if (eVert2.mtl->mType == UNLIT) {
+								estimate += eVert2.surface.diffuse;
 								continue;
 							}
-							bdpt::eyePathVert ev = epverts[t - 1];
-							if (!ev.inter.mtlcolor.hasEmission()) continue;
-							Vector3f l = ev.inter.mtlcolor.emission;
+							bdpt::eyePathVert& ev = epverts[t - 1];
+							if (!ev.inter.mtl->hasEmission()) continue;
+							Vector3f l = ev.inter.mtl->emission;
 							contrib = we * ev.throughput * l;
 							if (contrib.norm2() == 0) continue;
 							if (isnan(contrib.x)) continue;
@@ -786,9 +822,9 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 						// light tracing and connect to camera case
 						// the pixel getting contribution need to be reevaluated
 						if (t == 1) {
-							bdpt::lightPathVert lv = lpverts[s - 1];
-							if (lv.inter.mtlcolor.hasEmission()) continue;
-							Vector3f l = lpverts[0].inter.mtlcolor.emission;
+							bdpt::lightPathVert& lv = lpverts[s - 1];
+							if (lv.inter.mtl->hasEmission()) continue;
+							Vector3f l = lpverts[0].inter.mtl->emission;
 							Vector3f orig = lv.inter.pos;
 							Vector3f wi = normalized(cam.position - orig);
 							Vector3f wo;
@@ -801,7 +837,7 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 							else {
 								wo = normalized(lpverts[s - 2].inter.pos - lv.inter.pos);
 								rayInside = wi.dot(lv.inter.Ng) < 0;
-								bsdf = lv.inter.mtlcolor.BxDF(wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
+								bsdf = lv.inter.mtl->BxDF(lv.inter.surface, wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
 							}
 							float G = Geo(cam.position, cam.fwdDir, lv.inter.pos, lv.inter.Ng);
 							Vector3f we = We(lv.inter, cam);
@@ -816,32 +852,22 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 
 							// connect to camera
 							offsetRayOrig(orig, lv.inter.Ns, rayInside);
-							if (!isShadowRayBlocked(orig, cam.position, g) && wi.dot(cam.fwdDir) < 0) {
+							if (!isShadowRayBlocked(orig, cam.position, g, bdpt.interStrategy) && wi.dot(cam.fwdDir) < 0) {
 								int index = cam.worldPos2PixelIndex(lv.inter.pos);
-#if MULTITHREAD==1
-								mutex_color.lock();
-								cam.FrameBuffer.addRGB(index, misw * contrib);
-								mutex_color.unlock();
-#elif MULTITHREAD == 2
-								omp_set_lock(&omp_lock_color);
-								cam.FrameBuffer.addRGB(index, misw * contrib);
-								omp_unset_lock(&omp_lock_color);
-#else
-								cam.FrameBuffer.addRGB(index, misw * contrib);
-#endif
+								arg.film->splat(threadID, index, misw * contrib);
 							}
 							continue;
 						}
 
-						bdpt::lightPathVert lv = lpverts[s - 1];
-						Vector3f l = lpverts[0].inter.mtlcolor.emission;
-						bdpt::eyePathVert ev = epverts[t - 1];
-						if (ev.inter.mtlcolor.hasEmission())
+						bdpt::lightPathVert& lv = lpverts[s - 1];
+						Vector3f l = lpverts[0].inter.mtl->emission;
+						bdpt::eyePathVert& ev = epverts[t - 1];
+						if (ev.inter.mtl->hasEmission())
 							continue;
 
 						Vector3f connectDir = normalized(ev.inter.pos - lv.inter.pos);
 						Vector3f e_wo = normalized(epverts[t - 2].inter.pos - ev.inter.pos);
-						Vector3f evBSDF = ev.inter.mtlcolor.BxDF(-connectDir, e_wo, ev.inter.Ng, ev.inter.Ns, g->eta, false);
+						Vector3f evBSDF = ev.inter.mtl->BxDF(ev.inter.surface, -connectDir, e_wo, ev.inter.Ng, ev.inter.Ns, g->eta, false);
 
 						Vector3f lvBSDF;
 						Vector3f l_wo;
@@ -852,7 +878,7 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 						}
 						else {
 							l_wo = normalized(lpverts[s - 2].inter.pos - lv.inter.pos);
-							lvBSDF = lv.inter.mtlcolor.BxDF(connectDir, l_wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
+							lvBSDF = lv.inter.mtl->BxDF(lv.inter.surface, connectDir, l_wo, lv.inter.Ng, lv.inter.Ns, g->eta, true);
 						}
 						// connecting 
 						// check if two points are not blocked
@@ -869,7 +895,7 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 							rayInside = l_wo.dot(lv.inter.Ns) < 0;
 							offsetRayOrig(lorig, lv.inter.Ns, rayInside);
 						}
-						if (isShadowRayBlocked(eOrig, lorig, g))
+						if (isShadowRayBlocked(eOrig, lorig, g, bdpt.interStrategy))
 							continue;
 
 						float G = Geo(ev.inter.pos, ev.inter.Ng, lv.inter.pos, lv.inter.Ng);
@@ -886,15 +912,11 @@ void sub_render_bdpt(Thread_arg_bdpt* a, int threadID, int s, int e) {
 					}
 				}
 			}
-#if MULTITHREAD == 1
-			mutex_color.lock();
-			cam.FrameBuffer.addRGB(x + y * cam.width, estimate * SPP_inv);
-			mutex_color.unlock();
-#elif MULTITHREAD == 2
-			omp_set_lock(&omp_lock_color);
-			cam.FrameBuffer.addRGB(x + y * cam.width, estimate* SPP_inv);
-			omp_unset_lock(&omp_lock_color);
-#endif
+			arg.film->addPixel(x + y * cam.width, est.estimate());
+			g->cam.sampleCount[g->getIndex(x, y)] = est.count();
 		}
 	}
+#if COUNT_ALLOCS
+	bdpt.sampleAllocs += threadAllocs - allocs;
+#endif
 }
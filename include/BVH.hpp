@@ -4,192 +4,644 @@
 #include <chrono>
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
 
 #include "BoundBox.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
 #include "Object.hpp"
+#include "Triangle.hpp"
+#include "MemoryArena.hpp"
+
+
+#define SAH_BUCKETS 12				// number of bins when evaluating the SAH
+#define SAH_TRAVERSAL_COST 0.125f	// cost of one box test relative to one primitive test
+#define SAH_INTERSECT_COST 1.f
+#define BVH_STACK_SIZE 64			// traversal stack, the builder keeps the tree shallower than this
+#define RAY_PACKET_SIZE 8			// max rays traced together by IntersectPacket
+#define BVH_MAX_SAH_DEPTH 32		// below this depth the builder falls back to median split
+#define BVH_MAX_LEAF_SIZE 255		// upper limit of the configurable objects per leaf
+#define BVH_PARALLEL_MIN_PRIMS 8192	// ranges smaller than this are built and binned on one thread
+
+// how a BVH node divides its objects into two children
+enum BVHSplitMethod {
+	BVH_MEDIAN,		// sort by centroid along the longest dimension, split at the middle object
+	BVH_SAH			// binned Surface Area Heuristic
+};
 
-
-// tree node, contains only ONE object
+// tree node used while building, a leaf covers a small range of objects
+// flattened into LinearBVHNode once the build is done
+// all of them live in one array of the build arena, dropped in one go after flattening
 struct BVHNode {
-	Object* obj;
 	BoundBox bound;
 	BVHNode* left = nullptr;
 	BVHNode* right = nullptr;
+	int splitAxis = 0;
+	int firstPrim = 0;		// leaf: range [firstPrim, firstPrim + nPrims) of BVHAccel::primInfo
+	int nPrims = 0;
+};
 
-	~BVHNode() {
-	}
+// compact node used for traversal, stored in depth first order in one array:
+// the first child of an interior node is always the next node in the array
+struct alignas(32) LinearBVHNode {
+	BoundBox bound;					// 24 bytes
+	union {
+		int primitivesOffset;		// leaf: first primitive in BVHAccel::orderedPrims
+		int secondChildOffset;		// interior: index of the second child
+	};
+	uint16_t nPrimitives;			// 0 means interior node
+	uint8_t axis;					// interior: split axis, decides which child is nearer
+	uint8_t pad[1];
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+// pushed node of the nearest hit traversal
+struct BVHStackEntry {
+	int node;
+	float tEnter;		// distance the ray enters the node's bound
+};
+
+// a primitive of the BVH: primitive prim of objects[obj], prim is 0 unless the object is a TriangleMesh
+struct BVHPrimRef {
+	int32_t obj;
+	int32_t prim;
+};
+
+// build time data of one primitive, the builder reorders an array of it in place
+struct BVHPrimitiveInfo {
+	BVHPrimRef ref;
+	BoundBox bound;
+	Vector3f centroid;
 };
 
 
 // BVH acceleration class
-// contains a root BVHNode and algorithms to getIntersection with bounds
+// builds a BVHNode tree, flattens it into a LinearBVHNode array and traverses it with a stack
+// the flattened nodes, the leaf order and the precomputed triangles are allocated in the scene's arena
 class BVHAccel {
 public:
-	// the scene passes in the objList
-	BVHAccel(std::vector<Object*> objList): objects(objList) {
-		auto start = std::chrono::system_clock::now();
-		root = recursiveBuild(objects);
-		auto end = std::chrono::system_clock::now();
+	// the scene passes in the objList and its arena
+	// maxLeafSize: max number of objects in one leaf
+	BVHAccel(std::vector<Object*> objList, MemoryArena& arena, BVHSplitMethod method = BVH_SAH, int maxLeafSize = 4)
+		: objects(objList), splitMethod(method), maxPrimsInNode(std::min(std::max(maxLeafSize, 1), BVH_MAX_LEAF_SIZE)) {
+		auto start = std::chrono::steady_clock::now();
+		buildThreads = MULTITHREAD ? N_THREAD : 1;
+		size_t nPrims = 0;
+		for (Object* obj : objects) nPrims += obj->primitiveCount();
+		primInfo.reserve(nPrims);
+		for (int i = 0; i < objects.size(); i++) {
+			for (int p = 0; p < objects[i]->primitiveCount(); p++) {
+				BoundBox b = objects[i]->primitiveBound(p);
+				primInfo.push_back({ { i, p }, b, b.Centroid() });
+			}
+		}
+		if (!primInfo.empty()) {
+			// a binary tree over n primitives has at most 2n - 1 nodes
+			MemoryArena buildArena;
+			buildNodes = static_cast<BVHNode*>(buildArena.alloc((2 * primInfo.size() - 1) * sizeof(BVHNode), alignof(BVHNode)));
+			BVHNode* root = recursiveBuild(0, primInfo.size(), 0, buildThreads);
+
+			nodes = arena.createArray<LinearBVHNode>(nodeCount);
+			orderedPrims = arena.createArray<BVHPrimRef>(primInfo.size());
+			int offset = 0, primOffset = 0;
+			flattenBVHTree(root, offset, primOffset);
+			buildNodes = nullptr;
+			buildTriAccels(arena);
+		}
+		// only needed while building
+		primInfo.clear();
+		primInfo.shrink_to_fit();
+		auto end = std::chrono::steady_clock::now();
 
 		std::cout << "\nBVH Building Time consumed: \n";
-		std::cout << std::chrono::duration_cast<std::chrono::seconds>(end - start).count() << " seconds\n";
+		std::cout << std::chrono::duration<double, std::milli>(end - start).count() << " ms (" << buildThreads << " threads)\n";
+		std::cout << "BVH split method: " << (splitMethod == BVH_SAH ? "SAH" : "median")
+			<< ", max leaf size: " << maxPrimsInNode
+			<< ", nodes: " << nodeCount << ", expected traversal cost: " << SAHCost() << "\n";
 	}
 	
-	~BVHAccel() {	
-		deleteBVHtree(root);
+	// rebuild a BVH from a flattened tree stored in the scene cache, no partitioning at all
+	// order[i]: the i-th primitive in leaf order
+	BVHAccel(std::vector<Object*> objList, MemoryArena& arena, const LinearBVHNode* cachedNodes, int nNodes,
+		const BVHPrimRef* order, int nPrims, BVHSplitMethod method, int maxLeafSize)
+		: objects(objList), splitMethod(method), maxPrimsInNode(std::min(std::max(maxLeafSize, 1), BVH_MAX_LEAF_SIZE)) {
+		buildThreads = 1;
+		nodeCount = nNodes;
+		nodes = arena.copyArray(cachedNodes, nNodes);
+		orderedPrims = arena.copyArray(order, nPrims);
+		for (const BVHPrimRef& ref : orderedPrims) {
+			if (ref.obj < 0 || ref.obj >= objects.size() || ref.prim < 0 || ref.prim >= objects[ref.obj]->primitiveCount())
+				throw std::runtime_error("scene cache: primitive out of range\n");
+		}
+		buildTriAccels(arena);
 	}
 
-	// build the BVH tree based on the objList
-	// the Obj in the list has its own BoundBox
-	// we use them to initialize the tree
-	BVHNode* recursiveBuild(std::vector<Object*> objList) {
-		BVHNode* res = new BVHNode();
-
-		// build BVH depending on the size of objList
-		if (objList.size() == 0) return res;
-
-		else if (objList.size() == 1) {
-			res->bound = objList.at(0)->bound;
-			res->left = nullptr;
-			res->right = nullptr;
-			res->obj = objList[0];
-			return res;
+	// build the BVH tree over primInfo[start, end)
+	// objects are partitioned in place, no sub lists are copied
+	// nThreads: threads this subtree may use, big ranges build their two halves concurrently.
+	// the ranges are disjoint and the tree is flattened afterwards in DFS order, so the result
+	// doesn't depend on thread timing
+	BVHNode* recursiveBuild(int start, int end, int depth, int nThreads) {
+		BVHNode* res = new (&buildNodes[nodeCount++]) BVHNode();
+		int nPrims = end - start;
+		int nChunks = std::max(1, std::min(nThreads, nPrims / BVH_PARALLEL_MIN_PRIMS));
+
+		BoundBox unionBound, centroidBound;
+		if (nChunks == 1) computeBounds(start, end, unionBound, centroidBound);
+		else {
+			// bounds of every chunk, then union them in order
+			std::vector<BoundBox> chunkBound(nChunks), chunkCentroid(nChunks);
+			parallelChunks(start, end, nChunks, [&](int s, int e, int c) {
+				computeBounds(s, e, chunkBound[c], chunkCentroid[c]);
+			});
+			unionBound = chunkBound[0];
+			centroidBound = chunkCentroid[0];
+			for (int c = 1; c < nChunks; c++) {
+				unionBound = Union(unionBound, chunkBound[c]);
+				centroidBound = Union(centroidBound, chunkCentroid[c]);
+			}
 		}
+		res->bound = unionBound;
 
-		else if (objList.size() == 2) {		// weird here
-			res->left = recursiveBuild({ objList[0] });
-			res->right = recursiveBuild({ objList[1] });
-
-			res->bound = Union(res->left->bound, res->right->bound);
+		// build BVH depending on the number of objects
+		bool useSAH = splitMethod == BVH_SAH && depth < BVH_MAX_SAH_DEPTH;
+		if (nPrims == 1 || (nPrims <= maxPrimsInNode && !useSAH)) {
+			res->firstPrim = start;
+			res->nPrims = nPrims;
 			return res;
 		}
 
-		else {	// multiple objects, then divide the box along the longest dimension
-			// first union all the object
-			// 5/6/2023: I loop and union objects here, which is very slow but the result 
-			// seems to be correct.
-			BoundBox unionBound = Union(objList[0]->bound, objList[1]->bound);
-			for (int i = 2; i < objList.size(); i++) {
-				unionBound = Union(unionBound, objList[i]->bound);
+		// multiple objects, then divide the box into two
+		int mid = -1;
+		// SAH may peel off a few objects at a time, stop it from making the tree
+		// deeper than the traversal stack
+		if (useSAH) {
+			res->splitAxis = centroidBound.maxExtent();
+			mid = partitionSAH(start, end, unionBound, centroidBound, nPrims <= maxPrimsInNode, nChunks);
+			// SAH says testing all of them is cheaper than splitting,
+			// or they can't be separated but are few enough for a leaf
+			if (mid == start || (mid == -1 && nPrims <= maxPrimsInNode)) {
+				res->firstPrim = start;
+				res->nPrims = nPrims;
+				return res;
 			}
-			
-			// first find the longest dimension
-			// then sort objects by this dimension
-			// find the middle object and divide the bound into two
+		}
+
+		if (mid == -1) {
+			// median split: find the middle object along the longest dimension
+			// nth_element only places the middle one, no need to sort the whole range
 			int longest = unionBound.maxExtent();
-			switch (longest) 
-			{
-			case 0: {	// x dimension is the longest
-				std::sort(objList.begin(), objList.end(),
-					[](Object* o1, Object* o2) -> bool {
-						return o1->bound.Centroid().x < o2->bound.Centroid().x;
-					});
-				break;
+			res->splitAxis = longest;
+			mid = start + nPrims / 2;
+			std::nth_element(primInfo.begin() + start, primInfo.begin() + mid, primInfo.begin() + end,
+				[longest](const BVHPrimitiveInfo& p1, const BVHPrimitiveInfo& p2) -> bool {
+					return p1.centroid.get(longest) < p2.centroid.get(longest);
+				});
+		}
+
+		if (nThreads > 1 && nPrims >= BVH_PARALLEL_MIN_PRIMS) {
+			int leftThreads = nThreads / 2;
+			std::thread leftBuild([&]() { res->left = recursiveBuild(start, mid, depth + 1, leftThreads); });
+			res->right = recursiveBuild(mid, end, depth + 1, nThreads - leftThreads);
+			leftBuild.join();
+		}
+		else {
+			res->left = recursiveBuild(start, mid, depth + 1, 1);
+			res->right = recursiveBuild(mid, end, depth + 1, 1);
+		}
+		return res;
+	}
+
+	// bin the centroids along the longest centroid dimension and pick the bin boundary
+	// with the lowest SAH cost, then partition primInfo[start, end) by it
+	// allowLeaf: the range is small enough to be a leaf, compare the split with that
+	// nChunks: bin that many pieces of the range on their own threads
+	// return the partition point, start if a leaf is cheaper, -1 if centroids can't be separated
+	int partitionSAH(int start, int end, const BoundBox& unionBound, const BoundBox& centroidBound, bool allowLeaf, int nChunks) {
+		int axis = centroidBound.maxExtent();
+		float cmin = centroidBound.pMin.get(axis);
+		float cmax = centroidBound.pMax.get(axis);
+		if (cmax <= cmin) return -1;	// all centroids at the same spot
+
+		auto bucketOf = [&](const BVHPrimitiveInfo& p) -> int {
+			int b = (int)(SAH_BUCKETS * (p.centroid.get(axis) - cmin) / (cmax - cmin));
+			return b >= SAH_BUCKETS ? SAH_BUCKETS - 1 : b;
+		};
+		auto fillBuckets = [&](int s, int e, SAHBucket* buckets) {
+			for (int i = s; i < e; i++) {
+				SAHBucket& b = buckets[bucketOf(primInfo[i])];
+				b.bound = b.count == 0 ? primInfo[i].bound : Union(b.bound, primInfo[i].bound);
+				b.count++;
 			}
-			case 1: {  // y dimension is the longest
-				std::sort(objList.begin(), objList.end(),
-					[](Object* o1, Object* o2) -> bool {
-						return o1->bound.Centroid().y < o2->bound.Centroid().y;
-					});
-				break;
+		};
+
+		SAHBucket buckets[SAH_BUCKETS];
+		if (nChunks == 1) fillBuckets(start, end, buckets);
+		else {
+			// every chunk fills its own buckets, merged in chunk order
+			std::vector<SAHBucket> chunkBuckets(nChunks * SAH_BUCKETS);
+			parallelChunks(start, end, nChunks, [&](int s, int e, int c) {
+				fillBuckets(s, e, &chunkBuckets[c * SAH_BUCKETS]);
+			});
+			for (int c = 0; c < nChunks; c++) {
+				for (int i = 0; i < SAH_BUCKETS; i++) {
+					const SAHBucket& b = chunkBuckets[c * SAH_BUCKETS + i];
+					if (b.count == 0) continue;
+					buckets[i].bound = buckets[i].count == 0 ? b.bound : Union(buckets[i].bound, b.bound);
+					buckets[i].count += b.count;
+				}
 			}
-			case 2: {  // z dimension is the longest
-				std::sort(objList.begin(), objList.end(),
-					[](Object* o1, Object* o2) -> bool {
-						return o1->bound.Centroid().z < o2->bound.Centroid().z;
-					});
-				break;
+		}
+
+		// sweep from right to left, rightCount[i] and rightBound[i] cover bucket i+1 ... SAH_BUCKETS-1
+		BoundBox rightBound[SAH_BUCKETS - 1];
+		int rightCount[SAH_BUCKETS - 1] = { 0 };
+		int count = 0;
+		BoundBox bound;
+		for (int i = SAH_BUCKETS - 1; i > 0; i--) {
+			if (buckets[i].count > 0) {
+				bound = count == 0 ? buckets[i].bound : Union(bound, buckets[i].bound);
+				count += buckets[i].count;
 			}
+			rightCount[i - 1] = count;
+			rightBound[i - 1] = bound;
+		}
+
+		// sweep from left to right and evaluate the cost of splitting after bucket i
+		float invArea = 1.f / std::max(unionBound.SurfaceArea(), FLT_MIN);
+		float minCost = FLT_MAX;
+		int minBucket = -1;
+		int leftCount = 0;
+		BoundBox leftBound;
+		for (int i = 0; i < SAH_BUCKETS - 1; i++) {
+			if (buckets[i].count > 0) {
+				leftBound = leftCount == 0 ? buckets[i].bound : Union(leftBound, buckets[i].bound);
+				leftCount += buckets[i].count;
 			}
-			/********* switch ends ***********/
-			std::vector<Object*>::iterator begin = objList.begin();
-			auto middle = begin + (objList.size() / 2);
-			auto end = objList.end();
+			if (leftCount == 0 || rightCount[i] == 0) continue;
 
-			std::vector<Object*> leftObjects(begin, middle);
-			std::vector<Object*> rightObjects(middle, end);
+			float cost = SAH_TRAVERSAL_COST + SAH_INTERSECT_COST * invArea *
+				(leftCount * leftBound.SurfaceArea() + rightCount[i] * rightBound[i].SurfaceArea());
+			if (cost < minCost) {
+				minCost = cost;
+				minBucket = i;
+			}
+		}
+		if (minBucket == -1) return -1;
+		if (allowLeaf && minCost >= SAH_INTERSECT_COST * (end - start)) return start;
+
+		auto midIter = std::partition(primInfo.begin() + start, primInfo.begin() + end,
+			[&](const BVHPrimitiveInfo& p) -> bool {
+				return bucketOf(p) <= minBucket;
+			});
+		return midIter - primInfo.begin();
+	}
 
-			assert(objList.size() == rightObjects.size() + leftObjects.size());
+	// expected cost of tracing a random ray through the tree, relative to one primitive test
+	float SAHCost() const {
+		if (nodes.empty()) return 0;
+		float rootArea = nodes[0].bound.SurfaceArea();
+		if (rootArea <= 0) return 0;
+
+		float cost = 0;
+		for (const LinearBVHNode& node : nodes) {
+			if (node.nPrimitives > 0)
+				cost += SAH_INTERSECT_COST * node.nPrimitives * node.bound.SurfaceArea();
+			else
+				cost += SAH_TRAVERSAL_COST * node.bound.SurfaceArea();
+		}
+		return cost / rootArea;
+	}
 
-			res->left = recursiveBuild(leftObjects);
-			res->right = recursiveBuild(rightObjects);
+	// find the nearest intersection along the ray, update inter if there's any
+	// boxes entered beyond the closest hit so far are skipped, and the whole
+	// Intersection is only filled once for the final closest object
+	bool Intersect(const Vector3f& rayOrig, const Vector3f& rayDir, Intersection& inter) const {
+		if (nodes.empty()) return false;
+
+		Vector3f invDir = { 1 / rayDir.x, 1 / rayDir.y, 1 / rayDir.z };
+		int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+		float tMax = inter.t;		// closest hit so far
+		int hitIdx = -1;
+		float hitB1 = 0, hitB2 = 0;
+
+		float tEnter;
+		if (!nodes[0].bound.IntersectRay(rayOrig, invDir, dirIsNeg, tMax, tEnter))
+			return false;
+
+		BVHStackEntry toVisit[BVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		int current = 0;
+		while (true) {
+			const LinearBVHNode& node = nodes[current];
+			PROF_COUNT(PROF_BVH_NODES);
+			if (node.nPrimitives > 0) {
+				for (int i = 0; i < node.nPrimitives; i++) {
+					int idx = node.primitivesOffset + i;
+					float t, b1, b2;
+					if (intersectPrim(idx, rayOrig, rayDir, tMax, t, b1, b2)) {
+						tMax = t;
+						hitIdx = idx;
+						hitB1 = b1;
+						hitB2 = b2;
+					}
+				}
+			}
+			else {
+				// test both children, go down the nearer one and push the other
+				int first = current + 1;
+				int second = node.secondChildOffset;
+				float tFirst, tSecond;
+				bool hitFirst = nodes[first].bound.IntersectRay(rayOrig, invDir, dirIsNeg, tMax, tFirst);
+				bool hitSecond = nodes[second].bound.IntersectRay(rayOrig, invDir, dirIsNeg, tMax, tSecond);
+				if (hitFirst && hitSecond) {
+					if (tSecond < tFirst) {
+						std::swap(first, second);
+						std::swap(tFirst, tSecond);
+					}
+					toVisit[toVisitOffset++] = { second, tSecond };
+					current = first;
+					continue;
+				}
+				else if (hitFirst) {
+					current = first;
+					continue;
+				}
+				else if (hitSecond) {
+					current = second;
+					continue;
+				}
+			}
 
-			res->bound = Union(res->left->bound, res->right->bound);
+			// pop the next node, skip those the ray enters behind the closest hit
+			while (toVisitOffset > 0 && toVisit[toVisitOffset - 1].tEnter > tMax)
+				toVisitOffset--;
+			if (toVisitOffset == 0) break;
+			current = toVisit[--toVisitOffset].node;
 		}
 
-		return res;
+		if (hitIdx == -1) return false;
+		fillPrim(hitIdx, rayOrig, rayDir, tMax, hitB1, hitB2, inter);
+		return true;
 	}
 
-	BVHNode* getNode() { return root; }
-
-private:
-	std::vector<Object*> objects;	
-	BVHNode* root;					// root of the tree
+	// trace n coherent rays (n <= RAY_PACKET_SIZE) together, e.g. camera rays of neighbouring pixels
+	// a node is fetched once for the whole packet while any ray still hits it,
+	// children are ordered by the direction of the first active ray
+	// inters[i]: closest hit of ray i closer than inters[i].t
+	void IntersectPacket(const Vector3f* rayOrig, const Vector3f* rayDir, int n, Intersection* inters) const {
+		assert(n <= RAY_PACKET_SIZE);
+		if (nodes.empty() || n <= 0) return;
+
+		Vector3f invDir[RAY_PACKET_SIZE];
+		int dirIsNeg[RAY_PACKET_SIZE][3];
+		float tMax[RAY_PACKET_SIZE];
+		int hitIdx[RAY_PACKET_SIZE];
+		float hitB1[RAY_PACKET_SIZE], hitB2[RAY_PACKET_SIZE];
+		for (int r = 0; r < n; r++) {
+			invDir[r] = { 1 / rayDir[r].x, 1 / rayDir[r].y, 1 / rayDir[r].z };
+			dirIsNeg[r][0] = invDir[r].x < 0;
+			dirIsNeg[r][1] = invDir[r].y < 0;
+			dirIsNeg[r][2] = invDir[r].z < 0;
+			tMax[r] = inters[r].t;
+			hitIdx[r] = -1;
+		}
 
+		// rays before firstActive missed an ancestor box, they are out of this subtree
+		struct PacketStackEntry { int node; int firstActive; };
+		PacketStackEntry toVisit[BVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		int current = 0;
+		int first = 0;
+		float tEnter;
+		while (true) {
+			const LinearBVHNode& node = nodes[current];
+			PROF_COUNT(PROF_BVH_NODES);
+			while (first < n && !node.bound.IntersectRay(rayOrig[first], invDir[first], dirIsNeg[first], tMax[first], tEnter))
+				first++;
+
+			if (first < n) {
+				if (node.nPrimitives > 0) {
+					for (int r = first; r < n; r++) {
+						if (r > first && !node.bound.IntersectRay(rayOrig[r], invDir[r], dirIsNeg[r], tMax[r], tEnter))
+							continue;
+						for (int i = node.primitivesOffset; i < node.primitivesOffset + node.nPrimitives; i++) {
+							float t, b1, b2;
+							if (intersectPrim(i, rayOrig[r], rayDir[r], tMax[r], t, b1, b2)) {
+								tMax[r] = t;
+								hitIdx[r] = i;
+								hitB1[r] = b1;
+								hitB2[r] = b2;
+							}
+						}
+					}
+				}
+				else {
+					int nearChild = current + 1;
+					int farChild = node.secondChildOffset;
+					if (dirIsNeg[first][node.axis]) std::swap(nearChild, farChild);
+					toVisit[toVisitOffset++] = { farChild, first };
+					current = nearChild;
+					continue;
+				}
+			}
 
-	void deleteBVHtree(BVHNode* node) {
-		if (!node) return;
+			if (toVisitOffset == 0) break;
+			toVisitOffset--;
+			current = toVisit[toVisitOffset].node;
+			first = toVisit[toVisitOffset].firstActive;
+		}
 
-		if (node->left) deleteBVHtree(node->left);
-		if (node->right) deleteBVHtree(node->right);
+		for (int r = 0; r < n; r++) {
+			if (hitIdx[r] != -1)
+				fillPrim(hitIdx[r], rayOrig[r], rayDir[r], tMax[r], hitB1[r], hitB2[r], inters[r]);
+		}
+	}
 
-		delete node;
+	// hit test of the idx-th primitive in leaf order, on the precomputed copy if it's a triangle
+	bool intersectPrim(int idx, const Vector3f& rayOrig, const Vector3f& rayDir, float tMax, float& t, float& b1, float& b2) const {
+		PROF_COUNT(PROF_PRIM_TESTS);
+#if PRECOMPUTE_TRI
+		if (triAccels[idx].isTriangle) return triAccels[idx].intersectT(rayOrig, rayDir, tMax, t, b1, b2);
+#endif
+		const BVHPrimRef& ref = orderedPrims[idx];
+		return objects[ref.obj]->intersectT(ref.prim, rayOrig, rayDir, tMax, t, b1, b2);
 	}
-};
 
+	bool occludedPrim(int idx, const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) const {
+		PROF_COUNT(PROF_PRIM_TESTS);
+#if PRECOMPUTE_TRI
+		if (triAccels[idx].isTriangle) return triAccels[idx].occluded(rayOrig, rayDir, tMin, tMax);
+#endif
+		const BVHPrimRef& ref = orderedPrims[idx];
+		return objects[ref.obj]->occluded(ref.prim, rayOrig, rayDir, tMin, tMax);
+	}
 
+	// fill inter for the hit on the idx-th primitive in leaf order found by intersectPrim
+	void fillPrim(int idx, const Vector3f& rayOrig, const Vector3f& rayDir, float t, float b1, float b2, Intersection& inter) const {
+		const BVHPrimRef& ref = orderedPrims[idx];
+		objects[ref.obj]->fillIntersection(ref.prim, rayOrig, rayDir, t, b1, b2, inter);
+	}
 
-// get the Intersection with ginven BVHnode, and ray info
-Intersection getIntersection(BVHNode* node, const Vector3f& rayOrig, const Vector3f& rayDir) {
-	Intersection inter;
-	if (!node) return inter;
-	// if ray miss this bound
-	if (!node->bound.IntersectRay(rayOrig, rayDir))  
-		return inter;
+	// the flattened tree and the leaf order primitives, the wide BVH is collapsed from them
+	const ArenaArray<LinearBVHNode>& getNodes() const { return nodes; }
+	const ArenaArray<BVHPrimRef>& getOrderedPrims() const { return orderedPrims; }
+	int primitiveCount() const { return orderedPrims.size(); }
 
-	// if the node is a leaf node
-	// then test the intersection of ray and objects
-	// in this project, leaf box always contain only 1 object
-	if (!node->left && !node->right) {
-		node->obj->intersect(rayOrig, rayDir, inter);
-		return inter;
+	// bytes of the traversal data: nodes, leaf order and precomputed triangles
+	size_t memoryUsage() const {
+		return nodes.size() * sizeof(LinearBVHNode) + orderedPrims.size() * sizeof(BVHPrimRef)
+			+ triAccels.size() * sizeof(TriAccel);
 	}
 
-	// if node is a internal node
-	// then return the nearest intersection 
-	Intersection linter = getIntersection(node->left, rayOrig, rayDir);
-	Intersection rinter = getIntersection(node->right, rayOrig, rayDir);
-
-	if (linter.t <= rinter.t) return linter;
-	return rinter;
-}
+	// any-hit query: is there an object hit in (tMin, tMax), used for shadow and connection rays
+	// returns at the first blocker, never fills an Intersection
+	bool Occluded(const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) const {
+		if (nodes.empty()) return false;
+
+		Vector3f invDir = { 1 / rayDir.x, 1 / rayDir.y, 1 / rayDir.z };
+		int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+		int toVisit[BVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		int current = 0;
+		float tEnter;
+		while (true) {
+			const LinearBVHNode& node = nodes[current];
+			PROF_COUNT(PROF_BVH_NODES);
+			if (node.bound.IntersectRay(rayOrig, invDir, dirIsNeg, tMax, tEnter)) {
+				if (node.nPrimitives > 0) {
+					for (int i = 0; i < node.nPrimitives; i++) {
+						if (occludedPrim(node.primitivesOffset + i, rayOrig, rayDir, tMin, tMax))
+							return true;
+					}
+					if (toVisitOffset == 0) break;
+					current = toVisit[--toVisitOffset];
+				}
+				else {
+					// order doesn't matter for correctness, near child first still finds a blocker sooner
+					if (dirIsNeg[node.axis]) {
+						toVisit[toVisitOffset++] = current + 1;
+						current = node.secondChildOffset;
+					}
+					else {
+						toVisit[toVisitOffset++] = node.secondChildOffset;
+						current = current + 1;
+					}
+				}
+			}
+			else {
+				if (toVisitOffset == 0) break;
+				current = toVisit[--toVisitOffset];
+			}
+		}
+		return false;
+	}
 
-// test if there's a intesection with non-emissive obj, used for shadow ray
-bool hasIntersection(BVHNode* node, const Vector3f& rayOrig, const Vector3f& rayDir, float dis) {
-	if (!node) return false;
+	// product of (1 - alpha) of every object closer than dis, for hard shadow
+	float ShadowCoeffi(const Vector3f& rayOrig, const Vector3f& rayDir, float dis) const {
+		if (nodes.empty()) return 1;
+
+		Vector3f invDir = { 1 / rayDir.x, 1 / rayDir.y, 1 / rayDir.z };
+		int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+		float res = 1;
+		int toVisit[BVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		int current = 0;
+		while (true) {
+			const LinearBVHNode& node = nodes[current];
+			PROF_COUNT(PROF_BVH_NODES);
+			if (node.bound.IntersectRay(rayOrig, invDir, dirIsNeg)) {
+				if (node.nPrimitives > 0) {
+					for (int i = 0; i < node.nPrimitives; i++) {
+						float t, b1, b2;
+						if (intersectPrim(node.primitivesOffset + i, rayOrig, rayDir, FLT_MAX, t, b1, b2) && t < dis)
+							res *= (1 - objects[orderedPrims[node.primitivesOffset + i].obj]->mtlcolor.alpha);
+					}
+					if (toVisitOffset == 0) break;
+					current = toVisit[--toVisitOffset];
+				}
+				else {
+					toVisit[toVisitOffset++] = node.secondChildOffset;
+					current = current + 1;
+				}
+			}
+			else {
+				if (toVisitOffset == 0) break;
+				current = toVisit[--toVisitOffset];
+			}
+		}
+		return res;
+	}
 
-	if (!node->bound.IntersectRay(rayOrig, rayDir))
-		return false;
-	
-	// if the node is a leaf node
-	// then test the intersection of ray and objects
-	// in this project, leaf box always contain only 1 object
-	if (!node->left && !node->right) {
-		Intersection inter;
-		node->obj->intersect(rayOrig, rayDir, inter);
-		//if (inter.mtlcolor.hasEmission()) return false;	// do not test with light, 3/3/2024: not good but a hack
-
-		if (inter.intersected && inter.t < dis && !FLOAT_EQUAL(inter.t, dis))
-			return true;
-		return false;
+private:
+	std::vector<Object*> objects;	
+	ArenaArray<BVHPrimRef> orderedPrims;	// primitives in leaf order, leaves index into it
+	ArenaArray<TriAccel> triAccels;			// parallel to orderedPrims, only the hit test data
+	ArenaArray<LinearBVHNode> nodes;		// depth first order, nodes[0] is the root
+	std::vector<BVHPrimitiveInfo> primInfo;	// build time only
+	BVHNode* buildNodes = nullptr;			// build time only, nodeCount of them are in use
+	BVHSplitMethod splitMethod;
+	int maxPrimsInNode;
+	int buildThreads = 1;
+	std::atomic<int> nodeCount{ 0 };
+
+	struct SAHBucket {
+		int count = 0;
+		BoundBox bound;
+	};
+
+	// union of the object bounds and of the centroids in primInfo[start, end)
+	void computeBounds(int start, int end, BoundBox& bound, BoundBox& centroidBound) const {
+		bound = primInfo[start].bound;
+		centroidBound = BoundBox(primInfo[start].centroid, primInfo[start].centroid);
+		for (int i = start + 1; i < end; i++) {
+			bound = Union(bound, primInfo[i].bound);
+			centroidBound = Union(centroidBound, primInfo[i].centroid);
+		}
 	}
 
-	// if node is a internal node
-	if (hasIntersection(node->left, rayOrig, rayDir, dis))
-		return true;
+	// run f(chunkStart, chunkEnd, chunkIndex) on nChunks contiguous pieces of [start, end),
+	// chunk 0 on the calling thread
+	template <typename F>
+	static void parallelChunks(int start, int end, int nChunks, F f) {
+		int chunkSize = (end - start + nChunks - 1) / nChunks;
+		std::vector<std::thread> thds;
+		for (int c = 1; c < nChunks; c++)
+			thds.emplace_back(f, start + c * chunkSize, std::min(start + (c + 1) * chunkSize, end), c);
+		f(start, std::min(start + chunkSize, end), 0);
+		for (auto& t : thds) t.join();
+	}
 
-	return hasIntersection(node->right, rayOrig, rayDir, dis);
-}
+	// write the subtree into nodes[offset...] in depth first order, its leaves' primitives into orderedPrims[primOffset...]
+	// return the index of this node
+	int flattenBVHTree(BVHNode* node, int& offset, int& primOffset) {
+		int myOffset = offset++;
+		nodes[myOffset].bound = node->bound;
+		if (!node->left && !node->right) {
+			nodes[myOffset].primitivesOffset = primOffset;
+			nodes[myOffset].nPrimitives = node->nPrims;
+			for (int i = node->firstPrim; i < node->firstPrim + node->nPrims; i++)
+				orderedPrims[primOffset++] = primInfo[i].ref;
+		}
+		else {
+			nodes[myOffset].axis = node->splitAxis;
+			nodes[myOffset].nPrimitives = 0;
+			flattenBVHTree(node->left, offset, primOffset);
+			nodes[myOffset].secondChildOffset = flattenBVHTree(node->right, offset, primOffset);
+		}
+		return myOffset;
+	}
 
+	void buildTriAccels(MemoryArena& arena) {
+#if PRECOMPUTE_TRI
+		triAccels = arena.createArray<TriAccel>(orderedPrims.size());
+		for (int i = 0; i < orderedPrims.size(); i++) triAccels[i] = TriAccel(objects[orderedPrims[i].obj], orderedPrims[i].prim);
+#endif
+	}
+};
@@ -7,41 +7,40 @@
 class BVHStrategy : public IIntersectStrategy {
 	virtual void UpdateInter(Intersection& inter, Scene& sce, 
 		const Vector3f & rayOrig, const Vector3f& rayDir)override {
-		inter = getIntersection(sce.BVHaccelerator->getNode(), rayOrig, rayDir);
+		PROF_RAY_STAGE(STAGE_INTERSECT);
+		PROF_COUNT(PROF_RAYS);
+		inter = Intersection();
+		if (sce.QBVHaccelerator) sce.QBVHaccelerator->Intersect(rayOrig, rayDir, inter);
+		else sce.BVHaccelerator->Intersect(rayOrig, rayDir, inter);
+	}
+
+	// packets always go down the binary tree, it's built for every accelerator
+	// the integrators only send camera rays as packets
+	virtual void UpdateInterPacket(Intersection* inters, Scene& sce,
+		const Vector3f* rayOrigs, const Vector3f* rayDirs, int n) override {
+		PROF_STAGE(STAGE_CAMERA);
+		PROF_ADD(PROF_RAYS, n);
+		for (int i = 0; i < n; i++) inters[i] = Intersection();
+		sce.BVHaccelerator->IntersectPacket(rayOrigs, rayDirs, n, inters);
 	}
 
 	virtual float getShadowCoeffi(Scene& sce, Intersection& p, Vector3f& lightPos) override{
+		PROF_RAY_STAGE(STAGE_SHADOW);
+		PROF_COUNT(PROF_SHADOW_RAYS);
 		Vector3f orig = p.pos;
 		orig = orig + 0.0005f * p.Ng;
 		Vector3f raydir = normalized(lightPos - orig);
 
 		float distance = (lightPos - orig).norm();
 		
-		return ShadowHelper(sce.BVHaccelerator->getNode(), orig, raydir, distance);
+		return sce.BVHaccelerator->ShadowCoeffi(orig, raydir, distance);
 	}
 
-	float ShadowHelper(BVHNode* node, const Vector3f& rayOrig, const Vector3f& rayDir, float dis) {
-		if (!node) return 1;
-		// if ray miss this bound
-		if (!node->bound.IntersectRay(rayOrig, rayDir))
-			return 1;
-
-		Intersection inter;
-		// if the node is a leaf node
-		// then test the intersection of ray and objects
-		// in this project, leaf box always contain only 1 object
-		if (!node->left && !node->right) {
-			node->obj->intersect(rayOrig, rayDir, inter);
-			if (inter.intersected && inter.t < dis)
-				return (1-inter.mtlcolor.alpha);
-			return 1;
-		}
-
-		// if node is a internal node
-		float l = ShadowHelper(node->left, rayOrig, rayDir, dis);
-		float r = ShadowHelper(node->right, rayOrig, rayDir, dis);
-
-		return l * r;
+	virtual bool isOccluded(Scene& sce, const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) override {
+		PROF_RAY_STAGE(STAGE_SHADOW);
+		PROF_COUNT(PROF_SHADOW_RAYS);
+		if (sce.QBVHaccelerator) return sce.QBVHaccelerator->Occluded(rayOrig, rayDir, tMin, tMax);
+		return sce.BVHaccelerator->Occluded(rayOrig, rayDir, tMin, tMax);
 	}
 
 
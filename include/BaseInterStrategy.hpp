@@ -9,6 +9,9 @@
 class BaseInterStrategy : public IIntersectStrategy {
 	virtual void UpdateInter(Intersection& inter, Scene& sce,
 		const Vector3f& rayOrig, const Vector3f& rayDir) override {
+		PROF_RAY_STAGE(STAGE_INTERSECT);
+		PROF_COUNT(PROF_RAYS);
+		PROF_ADD(PROF_PRIM_TESTS, sce.objList.size());
 
 		for (const auto& obj : sce.objList) {
 			Intersection interTemp;
@@ -23,6 +26,8 @@ class BaseInterStrategy : public IIntersectStrategy {
 	}
 
 	virtual float getShadowCoeffi(Scene& sce, Intersection& p, Vector3f& lightPos) override{
+		PROF_RAY_STAGE(STAGE_SHADOW);
+		PROF_COUNT(PROF_SHADOW_RAYS);
 		Vector3f orig = p.pos;
 		orig = orig + 0.0005f * p.Ng;
 		Vector3f raydir = normalized(lightPos - orig);
@@ -36,11 +41,23 @@ class BaseInterStrategy : public IIntersectStrategy {
 
 			Intersection p_light_inter;
 			if (i->intersect(orig, raydir, p_light_inter) && p_light_inter.t < distance) {
-				res = res * (1 - p_light_inter.mtlcolor.alpha);
+				res = res * (1 - p_light_inter.mtl->alpha);
 			}
 		}
 		return res;
 	}
 
+	virtual bool isOccluded(Scene& sce, const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) override {
+		PROF_RAY_STAGE(STAGE_SHADOW);
+		PROF_COUNT(PROF_SHADOW_RAYS);
+		for (const auto& obj : sce.objList) {
+			for (int p = 0; p < obj->primitiveCount(); p++) {
+				PROF_COUNT(PROF_PRIM_TESTS);
+				if (obj->occluded(p, rayOrig, rayDir, tMin, tMax)) return true;
+			}
+		}
+		return false;
+	}
+
 
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <float.h>
 
 #include "Vector.hpp"
 
@@ -10,7 +11,7 @@ public:
 	Vector3f pMin, pMax;		// two points specifiy the bound
 
 	// construction, takes two point and specify the pmin pmax
-	BoundBox(Vector3f& p1, Vector3f& p2) {
+	BoundBox(const Vector3f& p1, const Vector3f& p2) {
 
 
 		pMin = Vector3f(
@@ -32,11 +33,17 @@ public:
 	}
 
 	// return the centroid of this bounding box
-	Vector3f Centroid() { return 0.5 * pMin + 0.5 * pMax; }
+	Vector3f Centroid() const { return 0.5 * pMin + 0.5 * pMax; }
 
 	// return the diagonal of this bounding box
 	Vector3f Diagonal() const { return pMax - pMin; }
 
+	// return the surface area of this bounding box, used by SAH
+	float SurfaceArea() const {
+		Vector3f d = Diagonal();
+		return 2.f * (d.x * d.y + d.x * d.z + d.y * d.z);
+	}
+
 	// return the index of max elment in diagonal
 	// which dimension is the longest one? x y z
 	// helper function for dividing the bounding box
@@ -90,11 +97,41 @@ public:
 
 		return false;
 	}
+
+	// same test for traversal, invDir and dirIsNeg are computed once per ray
+	// dirIsNeg picks the entering slab plane so no swap is needed
+	bool IntersectRay(const Vector3f& rayOrig, const Vector3f& invDir, const int dirIsNeg[3]) const {
+		float tEnter;
+		return IntersectRay(rayOrig, invDir, dirIsNeg, FLT_MAX, tEnter);
+	}
+
+	// tMax: distance of the closest hit found so far, a box entered beyond it is a miss
+	// tEnter: updated to the distance the ray enters the box
+	bool IntersectRay(const Vector3f& rayOrig, const Vector3f& invDir, const int dirIsNeg[3],
+		float tMax, float& tEnter) const {
+		float tmin_x = ((dirIsNeg[0] ? pMax.x : pMin.x) - rayOrig.x) * invDir.x;
+		float tmax_x = ((dirIsNeg[0] ? pMin.x : pMax.x) - rayOrig.x) * invDir.x;
+
+		float tmin_y = ((dirIsNeg[1] ? pMax.y : pMin.y) - rayOrig.y) * invDir.y;
+		float tmax_y = ((dirIsNeg[1] ? pMin.y : pMax.y) - rayOrig.y) * invDir.y;
+
+		float tmin_z = ((dirIsNeg[2] ? pMax.z : pMin.z) - rayOrig.z) * invDir.z;
+		float tmax_z = ((dirIsNeg[2] ? pMin.z : pMax.z) - rayOrig.z) * invDir.z;
+
+		float buffer = tmin_y > tmin_z ? tmin_y : tmin_z;
+		float t_enter = tmin_x > buffer ? tmin_x : buffer;
+
+		buffer = tmax_y < tmax_z ? tmax_y : tmax_z;
+		float t_exit = tmax_x < buffer ? tmax_x : buffer;
+
+		tEnter = t_enter;
+		return t_enter <= t_exit && t_exit >= 0.f && t_enter <= tMax;
+	}
 };
 
 
 // union two bounds
-BoundBox Union(BoundBox& b1, BoundBox& b2) {
+BoundBox Union(const BoundBox& b1, const BoundBox& b2) {
 	Vector3f min(fmin(b1.pMin.x, b2.pMin.x),
 		fmin(b1.pMin.y, b2.pMin.y),
 		fmin(b1.pMin.z, b2.pMin.z)
@@ -109,7 +146,7 @@ BoundBox Union(BoundBox& b1, BoundBox& b2) {
 }
 
 // union a bounding box and a point
-inline BoundBox Union(BoundBox& b, Vector3f& v) {
+inline BoundBox Union(const BoundBox& b, const Vector3f& v) {
 	Vector3f min(fmin(b.pMin.x, v.x),
 		fmin(b.pMin.y, v.y),
 		fmin(b.pMin.z, v.z)
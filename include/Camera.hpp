@@ -83,6 +83,7 @@ public:
 	Vector3f rightDir;
 	Vector3f position;
 	Texture FrameBuffer;
+	std::vector<int> sampleCount;	// samples taken per pixel
 
 	int width;
 	int height;
@@ -6,7 +6,10 @@
 #include "Vector.hpp"
 #include "global.hpp"
 #include "PPMGenerator.hpp"
+#include "TriangleMesh.hpp"
 #include "IIntersectStrategy.h"
+#include "TileScheduler.hpp"
+#include "SplatFilm.hpp"
 
 
 
@@ -30,23 +33,36 @@ void changeNormalDir(Intersection& inter, PPMGenerator* g) {
 
 	switch (inter.obj->objectType)
 	{
-	case TRIANGLE: {
-		Triangle* t = static_cast<Triangle*>(inter.obj);
+	case TRIANGLE:
+	case MESH: {
+		// corners of the hit triangle, a mesh keeps them in its shared arrays
+		Vector3f v0, v1, v2;
+		Vector2f uv0, uv1, uv2;
+		if (inter.obj->objectType == TRIANGLE) {
+			Triangle* t = static_cast<Triangle*>(inter.obj);
+			v0 = t->v0; v1 = t->v1; v2 = t->v2;
+			uv0 = t->uv0; uv1 = t->uv1; uv2 = t->uv2;
+		}
+		else {
+			TriangleMesh* m = static_cast<TriangleMesh*>(inter.obj);
+			m->getTriangle(inter.prim, v0, v1, v2);
+			m->getTriangleUV(inter.prim, uv0, uv1, uv2);
+		}
 		// our triangle start from lower left corner and go counterclockwise
 
 		// 2025/6/5   seems to be wrong for e1  and e2 according to 
 		// https://learnopengl.com/Advanced-Lighting/Normal-Mapping
-		Vector3f e1 = t->v1 - t->v0;
-		Vector3f e2 = t->v2 - t->v0;	// v2-v1?
+		Vector3f e1 = v1 - v0;
+		Vector3f e2 = v2 - v0;	// v2-v1?
 		// Vector3f nDir = crossProduct(e1, e2); // flat shading
 		Vector3f nDir = inter.Ns;	// smooth shading
 		nDir = normalized(nDir);
 
-		float deltaU1 = t->uv1.x - t->uv0.x;
-		float deltaV1 = t->uv1.y - t->uv0.y;
+		float deltaU1 = uv1.x - uv0.x;
+		float deltaV1 = uv1.y - uv0.y;
 
-		float deltaU2 = t->uv2.x - t->uv0.x;
-		float deltaV2 = t->uv2.y - t->uv0.y;
+		float deltaU2 = uv2.x - uv0.x;
+		float deltaV2 = uv2.y - uv0.y;
 
 		float coef = 1 / (-deltaU1 * deltaV2 + deltaV1 * deltaU2);
 
@@ -94,7 +110,7 @@ void textureModify(Intersection& inter, PPMGenerator* g) {
 				"\ninter.diffuseIndex is greater than diffuseTexuture.size()\nImport texture files in config.txt \n";
 			exit(1);
 		}
-		inter.mtlcolor.diffuse = g->diffuseMaps.at(inter.diffuseIndex)
+		inter.surface.diffuse = g->diffuseMaps.at(inter.diffuseIndex)
 			->getRGBat(inter.textPos.x, inter.textPos.y);
 	}
 	// NORMAL
@@ -109,7 +125,7 @@ void textureModify(Intersection& inter, PPMGenerator* g) {
 				"\ninter.roughnessIndex is greater than roughness_texture.size()\nImport texture files in config.txt \n";
 			exit(1);
 		}
-		inter.mtlcolor.roughness = g->roughnessMaps.at(inter.roughnessMapIndex)
+		inter.surface.roughness = g->roughnessMaps.at(inter.roughnessMapIndex)
 			->getRGBat(inter.textPos.x, inter.textPos.y).x;
 
 	}
@@ -121,7 +137,7 @@ void textureModify(Intersection& inter, PPMGenerator* g) {
 				"\ninter.metallicIndex is greater than metallic_texture.size()\nImport texture files in config.txt \n";
 			exit(1);
 		}
-		inter.mtlcolor.metallic = g->metallicMaps.at(inter.metallicMapIndex)
+		inter.surface.metallic = g->metallicMaps.at(inter.metallicMapIndex)
 			->getRGBat(inter.textPos.x, inter.textPos.y).x;
 	}
 }
@@ -132,24 +148,12 @@ void textureModify(Intersection& inter, PPMGenerator* g) {
 /// <param name="p">inter information</param>
 /// <param name="lightPos">light position</param>
 /// <returns>if the ray is blocked obj, return true</returns>
-bool isShadowRayBlocked(Vector3f orig, Vector3f& lightPos, PPMGenerator* g) {
+bool isShadowRayBlocked(Vector3f orig, Vector3f& lightPos, PPMGenerator* g, IIntersectStrategy* interStrategy) {
 	Vector3f raydir = normalized(lightPos - orig);
 	float distance = (lightPos - orig).norm();
 
-	if (!EXPEDITE) {
-		Intersection p_light_inter;
-		for (auto& i : g->scene.objList) {
-			//if (i->mtlcolor.hasEmission()) continue; // do not test with light avatar
-
-			if (i->intersect(orig, raydir, p_light_inter) && p_light_inter.t < distance) {
-				return true;
-			}
-		}
-		return false;
-	}
-	else { // BVH intersection test
-		return hasIntersection(g->scene.BVHaccelerator->getNode(), orig, raydir, distance);
-	}
+	// a hit within SHADOW_EPSILON of the target is the target itself (e.g. the light avatar)
+	return interStrategy->isOccluded(g->scene, orig, raydir, 0.f, distance - SHADOW_EPSILON);
 }
 
 float getLightPdf(Intersection& inter, PPMGenerator* g) {
@@ -192,6 +196,21 @@ void sampleLight(Intersection& inter, float& pdf, PPMGenerator* g) {
 }
 
 
+// spot of the current sample inside the pixel centered at pixelPos, the pixel spans delta_h x delta_v
+// world space center of pixel (x, y) on the image plane: ul the upper left pixel, delta_h / delta_v one pixel
+// right / down, c_off_h / c_off_v the half pixel offsets to the center
+inline Vector3f pixelCenter(const Vector3f& ul, const Vector3f& delta_h, const Vector3f& delta_v,
+	const Vector3f& c_off_h, const Vector3f& c_off_v, int x, int y) {
+	return ul + x * delta_h + y * delta_v + c_off_h + c_off_v;
+}
+
+Vector3f jitterPixel(const Vector3f& pixelPos, const Vector3f& delta_h, const Vector3f& delta_v) {
+	float dx, dy;
+	getPixelSample(dx, dy);
+	return pixelPos + (dx - 0.5f) * delta_h + (dy - 0.5f) * delta_v;
+}
+
+
 bool sampleLightDir(Vector3f& N, float& dirPdf, Vector3f& sampledRes) {
 	// cos-weighted
 	float r1 = getRandomFloat();
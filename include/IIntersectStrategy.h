@@ -10,8 +10,22 @@ public:
 	virtual void UpdateInter(Intersection& inter, Scene& sce,
 		const Vector3f& rayOrig, const Vector3f& rayDir) = 0;
 
+	// intersection of n coherent rays (n <= RAY_PACKET_SIZE), e.g. the camera rays of neighbouring pixels
+	// inters[i] is reset and updated like UpdateInter does for ray i
+	virtual void UpdateInterPacket(Intersection* inters, Scene& sce,
+		const Vector3f* rayOrigs, const Vector3f* rayDirs, int n) {
+		for (int i = 0; i < n; i++) {
+			inters[i] = Intersection();
+			UpdateInter(inters[i], sce, rayOrigs[i], rayDirs[i]);
+		}
+	}
+
 	// calculate shadow coefficient, for hard shadow
 	virtual float getShadowCoeffi(Scene& sce, Intersection& p, Vector3f& lightpos) = 0;
 
+	// any-hit query for shadow and connection rays: is there anything in (tMin, tMax) along the ray
+	// no Intersection is filled, stops at the first blocker
+	virtual bool isOccluded(Scene& sce, const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) = 0;
+
 
 };
\ No newline at end of file
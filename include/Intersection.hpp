@@ -26,7 +26,14 @@ public:
 	int metallicMapIndex = -1;
 
 
-	Material mtlcolor;
+	const Material* mtl = &defaultMaterial;	// material of the hit object, shared by all hits on it
+	SurfaceValues surface;		// diffuse / roughness / metallic at this hit, textures change these instead of the material
 	Object *obj = nullptr;		// this intersection is on which object	
+	int prim = 0;				// which primitive of obj, the triangle of a TriangleMesh
+
+	void setMaterial(const Material& m) {
+		mtl = &m;
+		surface = m.surfaceValues();
+	}
 
 };
\ No newline at end of file
@@ -78,10 +78,11 @@ public:
 					eyeLocation = eyePos;
 				}
 
-				Intersection inter = getIntersection(g->scene.BVHaccelerator->getNode(), eyePos, rayDir);
+				Intersection inter;
+				interStrategy->UpdateInter(inter, g->scene, eyePos, rayDir);
 				if (!inter.intersected)
 					continue;
-				Vector3f ret = inter.mtlcolor.diffuse;
+				Vector3f ret = inter.surface.diffuse;
 				Vector3f interPos = inter.pos;
 				int i = cam.worldPos2PixelIndex(interPos);
 				if (!cam.FrameBuffer.setRGB(i, ret)) {
@@ -92,116 +93,123 @@ public:
 			showProgress((float)y / g->height);
 		}
 #else
-		int PathCnt = cam.width * cam.height;
-		for (int y = 0; y < cam.height; y++) {
-			for (int x = 0; x < cam.width; x++) {
-				for (int i = 0; i < SPP; i++) {
-
-					// all light path vertices
-					std::vector<lightPathVert> lpverts;
-					float pdfCam = 1.f;
-
-					// sample light position
-					Intersection lightInter;
-					float pickpdf;
-					sampleLight(lightInter, pickpdf, g);
-					// sample direction
-					float dirPdf;
-					Vector3f wi;	// ray direciton
-					if (!sampleLightDir(lightInter.Ng, dirPdf, wi))
-						continue;
-					wi = normalized(wi);
-
-					// visible light connect eye
-					Vector3f orig = lightInter.pos;
-					offsetRayOrig(orig, lightInter.Ns, false);
-					if (!isShadowRayBlocked(orig, cam.position, g)) {
-						int index = cam.worldPos2PixelIndex(lightInter.pos);
-
-						cam.FrameBuffer.setRGB(index, lightInter.mtlcolor.emission * We(lightInter, cam) * SPP_inv);
-					}
+		// every pixel of a tile stands for SPP light paths, the splats can land anywhere in the film
+		TileScheduler scheduler(g->width, g->height, MULTITHREAD ? N_THREAD : 1);
+		SplatFilm film(cam.FrameBuffer, MULTITHREAD ? N_THREAD : 1);
+		scheduler.run([&](const Tile& tile, int threadID) {
+			PROF_STAGE(STAGE_TILE);
+			for (int y = tile.y0; y < tile.y1; y++) {
+				for (int x = tile.x0; x < tile.x1; x++) {
+					for (int i = 0; i < SPP; i++) {
+						startSample(g->getIndex(x, y), i);
+
+						// all light path vertices
+						std::vector<lightPathVert> lpverts;
+						float pdfCam = 1.f;
+
+						// sample light position
+						Intersection lightInter;
+						float pickpdf;
+						sampleLight(lightInter, pickpdf, g);
+						// sample direction
+						float dirPdf;
+						Vector3f wi;	// ray direciton
+						if (!sampleLightDir(lightInter.Ng, dirPdf, wi))
+							continue;
+						wi = normalized(wi);
 
-					// 1 / light pdf
-					// tp at s = 1;
-					Vector3f tp = 1 / pickpdf;
-					lightPathVert lpv;
-					lpv.inter = lightInter;
-					lpv.throughput = tp;
-					lpverts.emplace_back(lpv);
-
-					// for next vertex
-					float wi_n_cos = abs(wi.dot(lpverts[0].inter.Ng));
-					tp = lpverts[0].throughput * wi_n_cos / dirPdf;
-
-					Intersection nxtInter;
-					interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
-					if (!nxtInter.intersected)
-						continue;
-
-
-					// random walk to build light path
-					for (int s = 1; s < MAXDEPTH; ++s) {
-						lightPathVert lv;
-						lv.throughput = tp;
-						lv.inter = nxtInter;
-						// TEXTURE
-						if (lv.inter.obj->isTextureActivated)
-							textureModify(lv.inter, g);
-
-						lpverts.emplace_back(lv);
-						// sample next inter
-						Vector3f wo = -wi;
-						auto [success, TIR] = lv.inter.mtlcolor.sampleDirection(wo, lv.inter.Ns, wi, g->eta);
-						if (!success) break;
+						// visible light connect eye
+						Vector3f orig = lightInter.pos;
+						offsetRayOrig(orig, lightInter.Ns, false);
+						if (!isShadowRayBlocked(orig, cam.position, g, interStrategy)) {
+							int index = cam.worldPos2PixelIndex(lightInter.pos);
 
-						wi = normalized(wi);
-						dirPdf = lv.inter.mtlcolor.pdf(wi, wo, lv.inter.Ns, g->eta, lv.inter.mtlcolor.eta);
-						if (dirPdf == 0) break;;
-						if (TIR) {
-							wi = normalized(getReflectionDir(wo, lv.inter.Ns));
-							dirPdf = 1;
+							film.splat(threadID, index, lightInter.mtl->emission * We(lightInter, cam) * SPP_inv);
 						}
-						float cos = abs(wi.dot(lv.inter.Ng));
+
+						// 1 / light pdf
+						// tp at s = 1;
+						Vector3f tp = 1 / pickpdf;
+						lightPathVert lpv;
+						lpv.inter = lightInter;
+						lpv.throughput = tp;
+						lpverts.emplace_back(lpv);
+
 						// for next vertex
-						Vector3f bsdf = lv.inter.mtlcolor.BxDF(wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true, TIR);
-						if (dirPdf < MIN_DIVISOR)
-							break;
-						tp = tp * bsdf * cos / dirPdf;
-
-						// find next inter
-						orig = lv.inter.pos;
-						bool rayInside = lv.inter.Ns.dot(wi) < 0;
-						offsetRayOrig(orig, lv.inter.Ns, rayInside);
+						float wi_n_cos = abs(wi.dot(lpverts[0].inter.Ng));
+						tp = lpverts[0].throughput * wi_n_cos / dirPdf;
+
+						Intersection nxtInter;
 						interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
 						if (!nxtInter.intersected)
-							break;
-					}
+							continue;
+
+
+						// random walk to build light path
+						for (int s = 1; s < MAXDEPTH; ++s) {
+							lightPathVert lv;
+							lv.throughput = tp;
+							lv.inter = nxtInter;
+							// TEXTURE
+							if (lv.inter.obj->isTextureActivated)
+								textureModify(lv.inter, g);
+
+							lpverts.emplace_back(lv);
+							// sample next inter
+							Vector3f wo = -wi;
+							auto [success, TIR] = lv.inter.mtl->sampleDirection(lv.inter.surface, wo, lv.inter.Ns, wi, g->eta);
+							if (!success) break;
+
+							wi = normalized(wi);
+							dirPdf = lv.inter.mtl->pdf(lv.inter.surface, wi, wo, lv.inter.Ns, g->eta, lv.inter.mtl->eta);
+							if (dirPdf == 0) break;;
+							if (TIR) {
+								wi = normalized(getReflectionDir(wo, lv.inter.Ns));
+								dirPdf = 1;
+							}
+							float cos = abs(wi.dot(lv.inter.Ng));
+							// for next vertex
+							Vector3f bsdf = lv.inter.mtl->BxDF(lv.inter.surface, wi, wo, lv.inter.Ng, lv.inter.Ns, g->eta, true, TIR);
+							if (dirPdf < MIN_DIVISOR)
+								break;
+							tp = tp * bsdf * cos / dirPdf;
+
+							// find next inter
+							orig = lv.inter.pos;
+							bool rayInside = lv.inter.Ns.dot(wi) < 0;
+							offsetRayOrig(orig, lv.inter.Ns, rayInside);
+							interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
+							if (!nxtInter.intersected)
+								break;
+						}
 
-					// evaluate path contribution Contribution(s, t = 1)
-					int size = lpverts.size();
-					for (int s = 1; s < size; ++s) {
-						lightPathVert lv = lpverts[s];
-						float G = Geo(cam.position, cam.fwdDir, lv.inter.pos, lv.inter.Ng);
-						Vector3f l = lightInter.mtlcolor.emission;
-						Vector3f wo = normalized(lpverts[s - 1].inter.pos - lpverts[s].inter.pos);
-						Vector3f wi = normalized(cam.position - lpverts[s].inter.pos);
-						Vector3f bsdf = lv.inter.mtlcolor.BxDF(wi, wo, lv.inter.Ng, lv.inter.Ns, 1.f, true);
-						Vector3f we = We(lv.inter, cam);
-						Vector3f res = pdfCam * l * bsdf * lv.throughput * G * we;
-
-						// connect to camera
-						Vector3f orig = lv.inter.pos;
-						bool rayInside = lv.inter.Ns.dot(wo) < 0;
-						offsetRayOrig(orig, lv.inter.Ns, rayInside);
-						if (!isShadowRayBlocked(orig, cam.position, g)) {
-							int index = cam.worldPos2PixelIndex(lv.inter.pos);
-							Vector3f col = cam.FrameBuffer.addRGB(index, res * SPP_inv);
+						// evaluate path contribution Contribution(s, t = 1)
+						int size = lpverts.size();
+						for (int s = 1; s < size; ++s) {
+							lightPathVert lv = lpverts[s];
+							float G = Geo(cam.position, cam.fwdDir, lv.inter.pos, lv.inter.Ng);
+							Vector3f l = lightInter.mtl->emission;
+							Vector3f wo = normalized(lpverts[s - 1].inter.pos - lpverts[s].inter.pos);
+							Vector3f wi = normalized(cam.position - lpverts[s].inter.pos);
+							Vector3f bsdf = lv.inter.mtl->BxDF(lv.inter.surface, wi, wo, lv.inter.Ng, lv.inter.Ns, 1.f, true);
+							Vector3f we = We(lv.inter, cam);
+							Vector3f res = pdfCam * l * bsdf * lv.throughput * G * we;
+
+							// connect to camera
+							Vector3f orig = lv.inter.pos;
+							bool rayInside = lv.inter.Ns.dot(wo) < 0;
+							offsetRayOrig(orig, lv.inter.Ns, rayInside);
+							if (!isShadowRayBlocked(orig, cam.position, g, interStrategy)) {
+								int index = cam.worldPos2PixelIndex(lv.inter.pos);
+								film.splat(threadID, index, res * SPP_inv);
+							}
 						}
 					}
 				}
-			}
 			
-		}
+			}
+		});
+		film.merge();
 #endif
 	}
 
@@ -16,6 +16,14 @@ enum MaterialType {
 };
 
 
+// the material values of one hit that texture maps can change (see textureModify),
+// everything else is read from the shared Material of the object
+struct SurfaceValues {
+	Vector3f diffuse = Vector3f(0.9f, 0.9f, 0.9f);
+	float roughness = 1;
+	float metallic = 0;
+};
+
 class Material {
 public:
 	Vector3f diffuse = Vector3f(0.9f, 0.9f, 0.9f);
@@ -51,18 +59,41 @@ public:
 		return *this;
 	}
 
-	bool hasEmission() {
+	bool hasEmission() const {
 		return emission.x || emission.y || emission.z;
 	}
 
+	// values of a hit before any texture is applied
+	SurfaceValues surfaceValues() const {
+		return { diffuse, roughness, metallic };
+	}
+
 	// BxDF, return vec3f of elements within [0,1] 
 	// wi, wo: origin at inter.pos center, pointing outward
 	// wi: incident ray
 	// wo: view dir
-	Vector3f BxDF(const Vector3f& wi_, const Vector3f& wo_, const Vector3f& Ng, const Vector3f& Ns, float eta_scene, bool adjoint = false, bool TIR = false) {
+	// sv: values of the hit, they shadow the members of the same name
+	Vector3f BxDF(const SurfaceValues& sv, const Vector3f& wi_, const Vector3f& wo_, const Vector3f& Ng, const Vector3f& Ns, float eta_scene, bool adjoint = false, bool TIR = false) const {
+		switch (mType) {
+		case LAMBERTIAN: return BxDFOf<LAMBERTIAN>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		case MICROFACET_R: return BxDFOf<MICROFACET_R>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		case MICROFACET_T: return BxDFOf<MICROFACET_T>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		case PERFECT_REFLECTIVE: return BxDFOf<PERFECT_REFLECTIVE>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		case PERFECT_REFRACTIVE: return BxDFOf<PERFECT_REFRACTIVE>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		default: return BxDFOf<UNLIT>(sv, wi_, wo_, Ng, Ns, eta_scene, adjoint, TIR);
+		}
+	}
+
+	// BxDF of a material of type T, mType == T. shading batches of one type call it without the switch
+	template <MaterialType T>
+	Vector3f BxDFOf(const SurfaceValues& sv, const Vector3f& wi_, const Vector3f& wo_, const Vector3f& Ng, const Vector3f& Ns, float eta_scene, bool adjoint = false, bool TIR = false) const {
+		PROF_COUNT(PROF_BSDF_EVALS);
+		Vector3f diffuse = sv.diffuse;
+		float roughness = sv.roughness;
+		float metallic = sv.metallic;
 		Vector3f wi = wi_;
 		Vector3f wo = wo_;
-		if (mType != MICROFACET_T && mType != PERFECT_REFRACTIVE) {
+		if constexpr (T != MICROFACET_T && T != PERFECT_REFRACTIVE) {
 			if (wi.dot(Ng) * wi.dot(Ns) <= 0 || wo.dot(Ng) * wo.dot(Ns) <= 0)
 				return 0;
 		}
@@ -73,24 +104,21 @@ public:
 		}
 		float correctNormal = abs(wi.dot(Ns)) / abs(wi.dot(Ng));
 
-		switch (mType) {
-		case LAMBERTIAN: {
+		if constexpr (T == LAMBERTIAN) {
 			float cos_theta = wi.dot(Ns);
 			// account for reflection contribution only
 			if (cos_theta >= 0.f) {
 				return diffuse / M_PI * correctNormal;
 			}
 			else return Vector3f(0.f);
-			break;
 		}
-
-		case MICROFACET_R: {
+		else if constexpr (T == MICROFACET_R) {
 			// Cook-Torrance Model
 			Vector3f h = normalized(wi + wo);
 			float costheta = h.dot(wi);
 
 			Vector3f F0(0.04f);	// should be 0.04			
-			F0 = lerp(F0, this->diffuse, this->metallic);
+			F0 = lerp(F0, diffuse, metallic);
 			Vector3f F = fresnelSchlick(costheta, F0);	// learnopgl https://learnopengl.com/PBR/Theory
 			// float F = fresnel(wo, h, eta_scene, this->eta);
 			float D = D_ndf(h, Ns, roughness);
@@ -106,8 +134,7 @@ public:
 			// return ref_term;	// used for MIS testing
 			return (diffuse_term + ref_term) * correctNormal;
 		}
-
-		case MICROFACET_T: {
+		else if constexpr (T == MICROFACET_T) {
 			float eta_i = eta_scene;
 			float eta_t = eta;
 			Vector3f interN = Ns;
@@ -142,21 +169,18 @@ public:
 				float D = D_ndf(h, interN, roughness);
 				float G = G_smf(wi, wo, interN, roughness, h);
 				float numerator = abs(cos_ih) * abs(cos_oh) * eta_t * eta_t * (1 - F) * G * D;
-				float denominator = abs(cos_in) * abs(cos_on) * std::powf(eta_i * cos_ih + eta_t * cos_oh, 2);
+				float denominator = abs(cos_in) * abs(cos_on) * powf(eta_i * cos_ih + eta_t * cos_oh, 2);
 				if (denominator == 0) return 0;
 				return numerator / denominator * correctNormal;
 			}
 		}
-
-		case PERFECT_REFLECTIVE:{
+		else if constexpr (T == PERFECT_REFLECTIVE) {
 			if (FLOAT_EQUAL(normalized(wi + wo).dot(Ns), 1.f))
 				// https://www.youtube.com/watch?v=sg2xdcB8M3c
 				return 1 /abs(Ns.dot(wi)) * correctNormal;
 			return 0;
-			break;
 		}
-
-		case PERFECT_REFRACTIVE: {
+		else if constexpr (T == PERFECT_REFRACTIVE) {
 			// https://www.youtube.com/watch?v=sg2xdcB8M3c
 			// https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#fragment-BxDFDeclarations-7
 			Vector3f refDir = normalized(getReflectionDir(wo, Ns));
@@ -182,10 +206,8 @@ public:
 				return /*(eta_t * eta_t) / (eta_i * eta_i) * */(1 - F) * 1 / interN.dot(wi) * correctNormal;
 			
 			return Vector3f(0.f);
-			break;			
 		}
-
-		default:
+		else {
 			return Vector3f(0.f);
 		}
 	}
@@ -197,10 +219,23 @@ public:
 	// when passed in, eta_i is always eta_world
 	// returns: first bool for sample success, true for succeed
 	//			second bool for special event happening, 1 for happened
-	std::tuple<bool, bool> sampleDirection(const Vector3f& wo, const Vector3f& N, Vector3f& sampledRes, float eta_i = 1.f) {
-		switch (mType)
-		{
-		case MICROFACET_R: {
+	std::tuple<bool, bool> sampleDirection(const SurfaceValues& sv, const Vector3f& wo, const Vector3f& N, Vector3f& sampledRes, float eta_i = 1.f) const {
+		switch (mType) {
+		case MICROFACET_R: return sampleDirectionOf<MICROFACET_R>(sv, wo, N, sampledRes, eta_i);
+		case MICROFACET_T: return sampleDirectionOf<MICROFACET_T>(sv, wo, N, sampledRes, eta_i);
+		case LAMBERTIAN: return sampleDirectionOf<LAMBERTIAN>(sv, wo, N, sampledRes, eta_i);
+		case PERFECT_REFLECTIVE: return sampleDirectionOf<PERFECT_REFLECTIVE>(sv, wo, N, sampledRes, eta_i);
+		case PERFECT_REFRACTIVE: return sampleDirectionOf<PERFECT_REFRACTIVE>(sv, wo, N, sampledRes, eta_i);
+		default: return sampleDirectionOf<UNLIT>(sv, wo, N, sampledRes, eta_i);
+		}
+	}
+
+	// sampleDirection of a material of type T, mType == T
+	template <MaterialType T>
+	std::tuple<bool, bool> sampleDirectionOf(const SurfaceValues& sv, const Vector3f& wo, const Vector3f& N, Vector3f& sampledRes, float eta_i = 1.f) const {
+		PROF_COUNT(PROF_BSDF_SAMPLES);
+		float roughness = sv.roughness;
+		if constexpr (T == MICROFACET_R) {
 			if (wo.dot(N) <= 0.0f)
 				return { false, false };		// crucial
 			
@@ -210,7 +245,7 @@ public:
 			float r0 = getRandomFloat();
 			float r1 = getRandomFloat();
 			float alhpa = roughness * roughness;
-			alpha = std::max(alpha, 1e-3f);
+			float alpha = std::max(this->alpha, 1e-3f);
 			float a2 = alhpa * alpha;
 			
 			float phi = 2 * M_PI * r1;
@@ -226,9 +261,8 @@ public:
 
 			sampledRes = res;
 			return { true, false };
-			break;
 		}
-		case MICROFACET_T: {
+		else if constexpr (T == MICROFACET_T) {
 			float r0 = getRandomFloat();
 			float r1 = getRandomFloat();
 			float a = roughness * roughness;
@@ -264,10 +298,8 @@ public:
 				sampledRes = res;
 
 			return { true, false };
-			break;
 		}
-
-		case LAMBERTIAN: {
+		else if constexpr (T == LAMBERTIAN) {
 			if (wo.dot(N) <= 0.0f)
 				return {false, false};
 			// cosine weighted
@@ -303,15 +335,12 @@ public:
 
 			sampledRes = res;
 			return { true,false };
-			break;
 		}
-
-		case PERFECT_REFLECTIVE: {
+		else if constexpr (T == PERFECT_REFLECTIVE) {
 			sampledRes = getReflectionDir(wo, N);
 			return { true,false };
-			break;
 		}
-		case PERFECT_REFRACTIVE: {
+		else if constexpr (T == PERFECT_REFRACTIVE) {
 			float eta_t = eta;
 			Vector3f interN = N;
 			if (wo.dot(N) < 0) {
@@ -332,14 +361,10 @@ public:
 			else sampledRes = res;
 
 			return { true,false };
-			break;
 		}
-		default: {
+		else {
 			return { false,false };
-			break;
 		}
-		}
-
 	}
 
 
@@ -347,19 +372,29 @@ public:
 
 	// wo: -camera dir   wi: sampled dir
 	// when passed in, eta_i is always eta_world, eta_t is always ior of inter.material
-	float pdf(const Vector3f& wi, const Vector3f& wo, const Vector3f& N, float eta_i = 1.f, float eta_t = 1.f) const {
-		switch (mType)
-		{
-		case LAMBERTIAN: {
+	float pdf(const SurfaceValues& sv, const Vector3f& wi, const Vector3f& wo, const Vector3f& N, float eta_i = 1.f, float eta_t = 1.f) const {
+		switch (mType) {
+		case LAMBERTIAN: return pdfOf<LAMBERTIAN>(sv, wi, wo, N, eta_i, eta_t);
+		case MICROFACET_R: return pdfOf<MICROFACET_R>(sv, wi, wo, N, eta_i, eta_t);
+		case MICROFACET_T: return pdfOf<MICROFACET_T>(sv, wi, wo, N, eta_i, eta_t);
+		case PERFECT_REFLECTIVE: return pdfOf<PERFECT_REFLECTIVE>(sv, wi, wo, N, eta_i, eta_t);
+		case PERFECT_REFRACTIVE: return pdfOf<PERFECT_REFRACTIVE>(sv, wi, wo, N, eta_i, eta_t);
+		default: return pdfOf<UNLIT>(sv, wi, wo, N, eta_i, eta_t);
+		}
+	}
+
+	// pdf of a material of type T, mType == T
+	template <MaterialType T>
+	float pdfOf(const SurfaceValues& sv, const Vector3f& wi, const Vector3f& wo, const Vector3f& N, float eta_i = 1.f, float eta_t = 1.f) const {
+		float roughness = sv.roughness;
+		if constexpr (T == LAMBERTIAN) {
 			// uniform sample probability 1 / (2 * PI)
 			if (wi.dot(N) > 0.0f)
 				return wi.dot(N) / M_PI;  // cosine weighted pdf https://ameye.dev/notes/sampling-the-hemisphere/
 			else
 				return 0.0f;
-
-			break;
 		}
-		case MICROFACET_R: {
+		else if constexpr (T == MICROFACET_R) {
 			// corresponds to normal distribution function D
 			// https://www.tobias-franke.eu/log/2014/03/30/notes_on_importance_sampling.html
 			Vector3f h = normalized(wo + wi);
@@ -369,9 +404,8 @@ public:
 			// 4.f * wo.dot(h) is the jacobian of the transformation from wh to wi
 			// proof: https://www.youtube.com/watch?v=Xi1FZZJ235I
 			return D_ndf(h, N, roughness) * cosTheta / (4.f * wo.dot(h));
-			break;
 		}
-		case MICROFACET_T: {
+		else if constexpr (T == MICROFACET_T) {
 			Vector3f interN = N;
 			if (wo.dot(N) < 0) {
 				interN = -N;
@@ -401,17 +435,13 @@ public:
 				if (denominatorSqrt == 0) return 0;
 				return (1 - F) *  D_ndf(h, interN, roughness) * cosTheta * jacobian;
 			}
-			break;
 		}
-
-		case PERFECT_REFLECTIVE: {
+		else if constexpr (T == PERFECT_REFLECTIVE) {
 			if(FLOAT_EQUAL(normalized(wi+wo).dot(N), 1.f))
 				return 1;
 			 return 0;
-			break;
 		}
-
-		case PERFECT_REFRACTIVE: {
+		else if constexpr (T == PERFECT_REFRACTIVE) {
 			Vector3f refDir = normalized(getReflectionDir(wo, N));
 			Vector3f nDir = N;
 			if (wo.dot(nDir) < 0) {
@@ -429,12 +459,11 @@ public:
 				return 1 - F;
 
 			return 0;
-			break;
 		}
-
-		default:
+		else {
 			return 1;
-			break;
 		}
 	}
-};
\ No newline at end of file
+};
+
+const Material defaultMaterial;	// what intersections report before they hit anything
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <memory>
+
+#define ARENA_BLOCK_SIZE (256 * 1024)	// bytes of a regular block, bigger requests get a block of their own
+
+// fixed size view of an array in a MemoryArena, the arena owns the memory
+template <typename T>
+class ArenaArray {
+public:
+	ArenaArray() {}
+	ArenaArray(T* ptr, size_t n) : ptr(ptr), n(n) {}
+
+	T& operator[](size_t i) { return ptr[i]; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	T* data() { return ptr; }
+	const T* data() const { return ptr; }
+	T* begin() { return ptr; }
+	T* end() { return ptr + n; }
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + n; }
+
+private:
+	T* ptr = nullptr;
+	size_t n = 0;
+};
+
+// bump allocator that owns everything of a scene: objects, BVH arrays, the accelerators themselves.
+// objects created one after the other sit next to each other in memory, and nothing is freed
+// one by one: reset() (or the destructor) runs the destructors that matter and drops whole blocks.
+// not thread safe, the scene is put together on one thread
+class MemoryArena {
+public:
+	MemoryArena(size_t blockSize = ARENA_BLOCK_SIZE) : blockSize(blockSize) {}
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+	~MemoryArena() { reset(); }
+
+	// raw, uninitialized memory
+	void* alloc(size_t bytes, size_t align = alignof(std::max_align_t)) {
+		uintptr_t p = (cur + align - 1) & ~(uintptr_t)(align - 1);
+		if (blocks.empty() || p + bytes > end) {
+			// start a new block, the rest of the current one is wasted
+			size_t size = std::max(blockSize, bytes + align);
+			char* block = static_cast<char*>(::operator new(size));
+			blocks.push_back({ block, size });
+			reserved += size;
+			cur = (uintptr_t)block;
+			end = cur + size;
+			p = (cur + align - 1) & ~(uintptr_t)(align - 1);
+		}
+		used += p + bytes - cur;
+		cur = p + bytes;
+		return (void*)p;
+	}
+
+	// construct a T in the arena, its destructor runs on reset() unless it is trivial
+	template <typename T, typename... Args>
+	T* create(Args&&... args) {
+		T* obj = new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+			dtors.push_back({ obj, [](void* p) { static_cast<T*>(p)->~T(); } });
+		return obj;
+	}
+
+	// n default constructed Ts in one piece
+	template <typename T>
+	ArenaArray<T> createArray(size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena arrays don't run destructors");
+		if (n == 0) return ArenaArray<T>();
+		T* arr = static_cast<T*>(alloc(n * sizeof(T), alignof(T)));
+		for (size_t i = 0; i < n; i++) new (&arr[i]) T();
+		return ArenaArray<T>(arr, n);
+	}
+
+	// copy of src[0, n)
+	template <typename T>
+	ArenaArray<T> copyArray(const T* src, size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena arrays don't run destructors");
+		if (n == 0) return ArenaArray<T>();
+		T* arr = static_cast<T*>(alloc(n * sizeof(T), alignof(T)));
+		std::uninitialized_copy(src, src + n, arr);
+		return ArenaArray<T>(arr, n);
+	}
+
+	// destroy everything created in the arena (latest first) and give the blocks back
+	void reset() {
+		for (auto it = dtors.rbegin(); it != dtors.rend(); ++it) it->destroy(it->obj);
+		dtors.clear();
+		for (const Block& b : blocks) ::operator delete(b.ptr);
+		blocks.clear();
+		cur = end = 0;
+		used = reserved = 0;
+	}
+
+	size_t bytesUsed() const { return used; }			// handed out, alignment padding included
+	size_t bytesReserved() const { return reserved; }	// taken from the heap
+	int blockCount() const { return blocks.size(); }
+
+private:
+	struct Block {
+		char* ptr;
+		size_t size;
+	};
+	struct Dtor {
+		void* obj;
+		void (*destroy)(void*);
+	};
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	std::vector<Dtor> dtors;
+	uintptr_t cur = 0, end = 0;		// free part of the newest block
+	size_t used = 0, reserved = 0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "global.hpp"
+
+// AVX2 microfacet evaluation when the compiler targets it (-mavx2, /arch:AVX2), the wavefront
+// shade stage falls back to Material::BxDFOf / pdfOf one hit at a time otherwise
+#if SHADE_SIMD && SIMD_AVX && defined(__AVX2__)
+#define SHADE_AVX2 1
+#else
+#define SHADE_AVX2 0
+#endif
+
+#define SHADE_LANES 8	// evaluations per microfacet kernel call
+
+// SHADE_LANES evaluations of a MICROFACET_R material, structure of arrays: one field of all lanes is one Float8 / Vec3x8
+struct alignas(32) MicrofacetLanes {
+	float wi[3][SHADE_LANES];		// [x/y/z][lane]
+	float wo[3][SHADE_LANES];
+	float Ng[3][SHADE_LANES];
+	float Ns[3][SHADE_LANES];
+	float diffuse[3][SHADE_LANES];
+	float roughness[SHADE_LANES];
+	float metallic[SHADE_LANES];
+	// results
+	float f[3][SHADE_LANES];		// Material::BxDF
+	float pdf[SHADE_LANES];			// Material::pdf
+};
+
+#if SHADE_AVX2
+namespace simd8 {
+	// Smith G1 of GGX, tan^2 of the angle to the normal from its cosine instead of acos + tan
+	inline Float8 G1(Float8 wn, Float8 wh, Float8 a2) {
+		Float8 one(1.f);
+		Float8 wn2 = wn * wn;
+		Float8 tan2 = (one - wn2) / wn2;
+		Float8 g = Float8(2.f) / (one + sqrt(fmadd(a2, tan2, one)));
+		// the microfacet has to face w from the same side as the normal
+		return andnot(wh / wn < Float8(0.f), g);
+	}
+}
+
+// Cook-Torrance with GGX of MICROFACET_R for all lanes, what Material::BxDFOf<MICROFACET_R> and
+// pdfOf<MICROFACET_R> compute for one
+inline void evalMicrofacetR8(MicrofacetLanes& l) {
+	using namespace simd8;
+	Float8 zero(0.f), one(1.f);
+	Vec3x8 wi = Vec3x8::load(l.wi), wo = Vec3x8::load(l.wo);
+	Vec3x8 Ng = Vec3x8::load(l.Ng), Ns = Vec3x8::load(l.Ns);
+	Float8 wiNg = dot(wi, Ng), wiNs = dot(wi, Ns), woNg = dot(wo, Ng), woNs = dot(wo, Ns);
+	// light leaking through the shading normal
+	Float8 valid = (wiNg * wiNs > zero) & (woNg * woNs > zero);
+	Float8 correctNormal = abs(wiNs) / abs(wiNg);
+
+	Vec3x8 h = wi + wo;
+	Float8 hLen = sqrt(dot(h, h));
+	h = h * ((hLen > zero) & (one / hLen));
+
+	// D
+	Float8 roughness = Float8::load(l.roughness);
+	Float8 alpha = max(roughness * roughness, Float8(1e-3f));
+	Float8 a2 = alpha * alpha;
+	Float8 nh = dot(Ns, h);
+	Float8 c2 = nh * nh;
+	Float8 sum = a2 * c2 + (one - c2);
+	Float8 D = a2 / (Float8(M_PI) * (sum * sum));
+	D = select(sum == zero, one, D);
+	D = andnot(nh < zero, D);
+
+	// G, NaN lanes (grazing or degenerate directions) shadow everything
+	Float8 G = G1(wiNs, dot(wi, h), a2) * G1(woNs, dot(wo, h), a2);
+	G = isOrdered(G) & G;
+
+	// F, Schlick
+	Float8 x = one - dot(h, wi);
+	Float8 x2 = x * x;
+	Float8 x5 = (x2 * x2) * x;
+
+	Float8 denom = Float8(4.f) * (wiNs * woNs);
+	Float8 specScale = (G * D) / denom;
+	valid = valid & (denom != zero);
+	Float8 metallic = Float8::load(l.metallic);
+	Float8 f0base(0.04f);
+	for (int c = 0; c < 3; c++) {
+		Float8 diffuse = Float8::load(l.diffuse[c]);
+		Float8 F0 = fmadd(metallic, diffuse - f0base, f0base);
+		Float8 F = fmadd(one - F0, x5, F0);
+		Float8 diffuseTerm = (one - F) * (diffuse / Float8(M_PI));
+		Float8 f = fmadd(F, specScale, diffuseTerm) * correctNormal;
+		(valid & f).store(l.f[c]);
+	}
+
+	// pdf of the sampled half vector, over the jacobian to wi
+	Float8 pdf = (D * max(nh, zero)) / (Float8(4.f) * dot(wo, h));
+	pdf.store(l.pdf);
+}
+#endif
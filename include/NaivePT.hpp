@@ -49,123 +49,145 @@ public:
 		Vector3f c_off_h = (ur - ul) / (float)(g->width * 2);	// center horizontal offset
 		Vector3f c_off_v = (ll - ul) / (float)(g->height * 2); // vertical
 
-		for (int y = 0; y < g->height; y++) {
-			Vector3f v_off = y * delta_v;
-			//PRINT = false;
-			for (int x = 0; x < g->width; x++) {
-				if (x == 1345 && y == 60) {
-					PRINT = true;
-				}
+		// tiles go to the threads with work stealing
+		TileScheduler scheduler(g->width, g->height, MULTITHREAD ? N_THREAD : 1);
+		scheduler.run([&](const Tile& tile, int threadID) {
+			PROF_STAGE(STAGE_TILE);
+			Vector3f rayOrigs[RAY_PACKET_SIZE];
+			Vector3f rayDirs[RAY_PACKET_SIZE];
+			Intersection primaryInters[RAY_PACKET_SIZE];
+			for (int y = tile.y0; y < tile.y1; y++) {
+				Vector3f v_off = y * delta_v;
+				//PRINT = false;
+				for (int x = tile.x0; x < tile.x1; x++) {
+					if (x == 1345 && y == 60) {
+						PRINT = true;
+					}
 
-				Vector3f& color = g->cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
-				Vector3f h_off = x * delta_h;
-				Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
-				Vector3f rayDir;
-				Vector3f eyeLocation;
-
-				rayDir = normalized(pixelPos - eyePos);
-				eyeLocation = eyePos;
-
-				Vector3f estimate;
-				for (int i = 0; i < SPP; i++) {
-					std::vector<eyePathVert> epverts;
-					float pdfCam = 1.f;
-					Vector3f wi = rayDir;
-
-					// camera vertex, t = 0 
-					Vector3f tp = 1;
-					eyePathVert epv;
-					epv.inter = Intersection();
-					epv.inter.pos = eyePos;
-					epv.inter.intersected = true;
-					epv.inter.Ng = cam.fwdDir;
-					epv.throughput = tp;
-					epverts.emplace_back(epv);
-					float dirPdf = 0;
-					Vector3f orig = eyePos;
-
-					// for next vertex
-					// way 1: stick to original mesurement function
-					// tp = 1;	
-
-					// ***** way 2: 
-					// 6/22/2024:
-					// the pdf of first point w.r.t area == choose the pixel, the pdf_A = 1/FilmArea,
-					// pdf_w = 1/FilmArea/lensArea * d^2/ camCos
-					// == d^2 / (FilmArea * lensArea* camCos)
-					float wi_n_cos = abs(wi.dot(epverts[0].inter.Ng)); // camCos
-					float d2 = (pixelPos - cam.position).norm2();
-					float pdfCam_w = d2 * cam.lensAreaInv * cam.filmPlaneAreaInv / wi_n_cos;
-					// projected solid angle pdf
-					tp = epverts[0].throughput * wi_n_cos / pdfCam_w;
-					// ***** way 2 ends
-
-					Intersection nxtInter;
-					interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
-					if (!nxtInter.intersected)
-						continue;
-
-					// random walk to build light path
-					for (int t = 1; t < MAXDEPTH; ++t) {
-						eyePathVert ev;
-						ev.throughput = tp;
-						ev.inter = nxtInter;
-						// TEXTURE
-						if (ev.inter.obj->isTextureActivated) textureModify(ev.inter, g);
-
-						//  t = 1
-						epverts.emplace_back(ev);
-						if (ev.inter.mtlcolor.hasEmission())
-							break;
-						// sample next inter
-						Vector3f wo = -wi;
-						auto [success, TIR] = ev.inter.mtlcolor.sampleDirection(wo, ev.inter.Ng, wi, g->eta);
-						if (!success) break;
-
-						wi = normalized(wi);
-						dirPdf = ev.inter.mtlcolor.pdf(wi, wo, ev.inter.Ng, g->eta, ev.inter.mtlcolor.eta);
-						if (dirPdf == 0) break;;
-						if (TIR) {
-							wi = normalized(getReflectionDir(wo, ev.inter.Ng));
-							dirPdf = 1;
+					// camera rays of the next few pixels in the row go as one packet,
+					// every sample of a pixel shoots the same ray so the first hit is reused
+					if ((x - tile.x0) % RAY_PACKET_SIZE == 0) {
+						int nRays = std::min(RAY_PACKET_SIZE, tile.x1 - x);
+						for (int k = 0; k < nRays; k++) {
+							rayOrigs[k] = eyePos;
+							rayDirs[k] = normalized(ul + (x + k) * delta_h + v_off + c_off_h + c_off_v - eyePos);
 						}
-						float cos = abs(wi.dot(ev.inter.Ng));
+						PROF_ADD(PROF_CAMERA_RAYS, nRays);
+						interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, nRays);
+					}
+
+					Vector3f& color = g->cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
+					Vector3f h_off = x * delta_h;
+					Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
+					Vector3f rayDir;
+					Vector3f eyeLocation;
+
+					rayDir = normalized(pixelPos - eyePos);
+					eyeLocation = eyePos;
+
+					PixelEstimator est;
+					Vector3f estimate;		// contribution of the current sample
+					for (int i = 0; !est.done(); est.add(estimate), i++) {
+						startSample(g->getIndex(x, y), i);
+						estimate = 0;
+						std::vector<eyePathVert> epverts;
+						float pdfCam = 1.f;
+						Vector3f wi = rayDir;
+
+						// camera vertex, t = 0 
+						Vector3f tp = 1;
+						eyePathVert epv;
+						epv.inter = Intersection();
+						epv.inter.pos = eyePos;
+						epv.inter.intersected = true;
+						epv.inter.Ng = cam.fwdDir;
+						epv.throughput = tp;
+						epverts.emplace_back(epv);
+						float dirPdf = 0;
+						Vector3f orig = eyePos;
+
 						// for next vertex
-						Vector3f bsdf = ev.inter.mtlcolor.BxDF(wi, wo, ev.inter.Ng, g->eta, TIR);
-						if (dirPdf < MIN_DIVISOR)
-							break;
-						tp = tp * bsdf * cos / dirPdf;
-
-						// find next inter
-						orig = ev.inter.pos;
-						bool rayInside = ev.inter.Ng.dot(wi) < 0;
-						offsetRayOrig(orig, ev.inter.Ng, rayInside);
-						interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
+						// way 1: stick to original mesurement function
+						// tp = 1;	
+
+						// ***** way 2: 
+						// 6/22/2024:
+						// the pdf of first point w.r.t area == choose the pixel, the pdf_A = 1/FilmArea,
+						// pdf_w = 1/FilmArea/lensArea * d^2/ camCos
+						// == d^2 / (FilmArea * lensArea* camCos)
+						float wi_n_cos = abs(wi.dot(epverts[0].inter.Ng)); // camCos
+						float d2 = (pixelPos - cam.position).norm2();
+						float pdfCam_w = d2 * cam.lensAreaInv * cam.filmPlaneAreaInv / wi_n_cos;
+						// projected solid angle pdf
+						tp = epverts[0].throughput * wi_n_cos / pdfCam_w;
+						// ***** way 2 ends
+
+						Intersection nxtInter = primaryInters[(x - tile.x0) % RAY_PACKET_SIZE];
 						if (!nxtInter.intersected)
-							break;
+							continue;
+
+						// random walk to build light path
+						for (int t = 1; t < MAXDEPTH; ++t) {
+							eyePathVert ev;
+							ev.throughput = tp;
+							ev.inter = nxtInter;
+							// TEXTURE
+							if (ev.inter.obj->isTextureActivated) textureModify(ev.inter, g);
+
+							//  t = 1
+							epverts.emplace_back(ev);
+							if (ev.inter.mtl->hasEmission())
+								break;
+							// sample next inter
+							Vector3f wo = -wi;
+							auto [success, TIR] = ev.inter.mtl->sampleDirection(ev.inter.surface, wo, ev.inter.Ng, wi, g->eta);
+							if (!success) break;
+
+							wi = normalized(wi);
+							dirPdf = ev.inter.mtl->pdf(ev.inter.surface, wi, wo, ev.inter.Ng, g->eta, ev.inter.mtl->eta);
+							if (dirPdf == 0) break;;
+							if (TIR) {
+								wi = normalized(getReflectionDir(wo, ev.inter.Ng));
+								dirPdf = 1;
+							}
+							float cos = abs(wi.dot(ev.inter.Ng));
+							// for next vertex
+							Vector3f bsdf = ev.inter.mtl->BxDF(ev.inter.surface, wi, wo, ev.inter.Ng, g->eta, TIR);
+							if (dirPdf < MIN_DIVISOR)
+								break;
+							tp = tp * bsdf * cos / dirPdf;
+
+							// find next inter
+							orig = ev.inter.pos;
+							bool rayInside = ev.inter.Ng.dot(wi) < 0;
+							offsetRayOrig(orig, ev.inter.Ng, rayInside);
+							interStrategy->UpdateInter(nxtInter, g->scene, orig, wi);
+							if (!nxtInter.intersected)
+								break;
+						}
+						// evaluate path contribution Contribution(s, t = 1)
+						int size = epverts.size();
+
+						eyePathVert ev = epverts[size - 1];
+
+						// evaluate pixel contribution
+						// https://agraphicsguynotes.com/posts/the_missing_primary_ray_pdf_in_path_tracing/
+						float G = Geo(cam.position, cam.fwdDir, pixelPos, -cam.fwdDir);
+						Vector3f l = ev.inter.mtl->emission;
+						Intersection pixelInter;
+						pixelInter.pos = pixelPos;
+						Vector3f we = We(pixelInter, cam);
+						// pixel area == 1, pdf point = 1/1
+						float p = cam.lensAreaInv  * cam.filmPlaneAreaInv * 1;
+						// can just let res = l * tp: G, We, 1/p cancel each others.
+						// Vector3f res = (1/p) * l * ev.throughput * G * we;	// way 1, original mesureament function
+						Vector3f res = l * ev.throughput * we; // way 2, no connection vertices, no G term
+						estimate += res;
 					}
-					// evaluate path contribution Contribution(s, t = 1)
-					int size = epverts.size();
-
-					eyePathVert ev = epverts[size - 1];
-
-					// evaluate pixel contribution
-					// https://agraphicsguynotes.com/posts/the_missing_primary_ray_pdf_in_path_tracing/
-					float G = Geo(cam.position, cam.fwdDir, pixelPos, -cam.fwdDir);
-					Vector3f l = ev.inter.mtlcolor.emission;
-					Intersection pixelInter;
-					pixelInter.pos = pixelPos;
-					Vector3f we = We(pixelInter, cam);
-					// pixel area == 1, pdf point = 1/1
-					float p = cam.lensAreaInv  * cam.filmPlaneAreaInv * 1;
-					// can just let res = l * tp: G, We, 1/p cancel each others.
-					// Vector3f res = (1/p) * l * ev.throughput * G * we;	// way 1, original mesureament function
-					Vector3f res = l * ev.throughput * we; // way 2, no connection vertices, no G term
-					estimate += res;
+					color = est.estimate();
+					g->cam.sampleCount[g->getIndex(x, y)] = est.count();
 				}
-				estimate = estimate * SPP_inv;
-				color = estimate;
 			}
-		}
+		});
 	}
 };
\ No newline at end of file
@@ -9,17 +9,55 @@
 enum OBJTYPE
 {
 	TRIANGLE,
-	SPEHRE
+	SPEHRE,
+	MESH
 };
 
 class Object {
 public:
 	virtual ~Object() {};
 	// check if ray intersect with this object
-	// if intersect then update inter data
+	// if intersect then update inter data with the nearest of its primitives
 	// orig: ray origin
 	// dir: ray direction
-	virtual bool intersect(const Vector3f& orig, const Vector3f& dir, Intersection& inter) = 0;
+	virtual bool intersect(const Vector3f& orig, const Vector3f& dir, Intersection& inter) {
+		float tMax = FLT_MAX, hitB1 = 0, hitB2 = 0;
+		int hitPrim = -1;
+		for (int prim = 0; prim < primitiveCount(); prim++) {
+			float t, b1, b2;
+			if (intersectT(prim, orig, dir, tMax, t, b1, b2)) {
+				tMax = t;
+				hitPrim = prim;
+				hitB1 = b1;
+				hitB2 = b2;
+			}
+		}
+		if (hitPrim == -1)
+			return false;
+		fillIntersection(hitPrim, orig, dir, tMax, hitB1, hitB2, inter);
+		return true;
+	}
+
+	// the BVH sees an object as primitiveCount() primitives: one per triangle of a TriangleMesh,
+	// just primitive 0 for everything else. the queries below take the primitive index
+	virtual int primitiveCount() const { return 1; }
+	virtual BoundBox primitiveBound(int prim) const { return bound; }
+	// corners of primitive prim if it is a triangle, for the BVH's precomputed copy (TriAccel)
+	virtual bool getTriangle(int prim, Vector3f& v0, Vector3f& v1, Vector3f& v2) const { return false; }
+
+	// cheap ray test used by BVH traversal: only find the hit distance t in (0, tMax)
+	// b1 b2: barycentric coordinates of the hit (triangle only), passed back to fillIntersection
+	virtual bool intersectT(int prim, const Vector3f& orig, const Vector3f& dir, float tMax, float& t, float& b1, float& b2) = 0;
+
+	// occlusion test for shadow rays: true if the ray hits primitive prim anywhere in (tMin, tMax)
+	// the default only looks at the nearest hit, objects with several hits along a ray override it
+	virtual bool occluded(int prim, const Vector3f& orig, const Vector3f& dir, float tMin, float tMax) {
+		float t, b1, b2;
+		return intersectT(prim, orig, dir, tMax, t, b1, b2) && t > tMin;
+	}
+
+	// fill the whole inter (material, normals, uv...) for a hit on primitive prim found by intersectT
+	virtual void fillIntersection(int prim, const Vector3f& orig, const Vector3f& dir, float t, float b1, float b2, Intersection& inter) = 0;
 
 	Object() {
 
@@ -41,5 +79,7 @@ public:
 	virtual float getArea() = 0;
 	// randomly sample a point on the surface of this object
 	virtual void samplePoint(Intersection& inter, float& pdf) = 0;
+	// heap bytes the object holds besides itself (vertex arrays of a mesh)
+	virtual size_t memoryUsage() const { return 0; }
 	
 };
\ No newline at end of file
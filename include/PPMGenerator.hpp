@@ -7,16 +7,21 @@
 #include<vector>
 #include<cmath>
 #include <regex>
+#include <unordered_map>
 
 #include "Vector.hpp"
 #include "global.hpp"
 #include "Scene.hpp"
 #include "Sphere.hpp"
 #include "Triangle.hpp"
+#include "TriangleMesh.hpp"
+#include "AdaptiveSampling.hpp"
 #include "Material.hpp"
 #include "Texture.hpp"
 #include "OBJ_Loader.h"
 #include "Camera.hpp"
+#include "SceneCache.hpp"
+#include "ThreadAffinity.hpp"
 
 
 
@@ -63,6 +68,9 @@ public:
 	int roughnessIndex = -1;
 	int metallicIndex = -1;
 
+	std::vector<ObjFileEntry> objFiles;	// OBJ files queued by addObjFile, loaded by loadScene
+	std::string sceneCacheDir;			// set by the "scenecache" keyword in config, empty: no cache
+
 	int parallel_projection = 0;  // 0 for perspective, 1 for orthographic
 	Material mtlcolor;			  // temp buffer for material color	default 0 0 0
 	// ******* depthcueing *******
@@ -135,21 +143,19 @@ public:
 		}
 	}
 
+	// name of an output file: the config name without .txt, then suffix
+	// if not find .txt or merely .txt    then generate xxx.ppm or .ppm
+	std::string outputName(const std::string& suffix) const {
+		std::string input(inputName);
+		std::size_t pos = input.find(".txt");
+		if (pos == std::string::npos) return input + suffix;
+		return input.substr(0, pos) + suffix;
+	}
+
 	// generate the ppm file. 
 	// write the rgb data into a file
 	void generate() {
-
-		std::string input(inputName);
-		std::string outName;
-		std::size_t pos = input.find(".txt");
-		// if not find .txt or merely .txt    then generate xxx.ppm or .ppm
-		if (pos == std::string::npos || pos == 0) {
-			outName = std::string(inputName).append(".ppm");
-			if (pos == 0) outName = std::string(".ppm");
-		}
-		else {
-			outName = input.substr(0, pos).append(".ppm");
-		}
+		std::string outName = outputName(".ppm");
 		fout.open(outName);
 		writeHeader();
 		writePixel();
@@ -157,54 +163,99 @@ public:
 		std::cout << "Generating image successfully.\n";
 		fout.clear();
 		fout.close();
+
+		// samples spent per pixel next to the image, xxx_spp.ppm
+		if (adaptiveSampling())
+			writeSampleHeatmap(outputName("_spp.ppm"), cam.sampleCount, width, height);
 	}
 
-	// load triangles from OBJ_Loader
+	// load all triangles of an OBJ file into one TriangleMesh
+	// OBJ_Loader repeats a vertex for every face using it, the mesh keeps every distinct
+	// position/normal/uv once and the triangles index into them
 	// 4/24/2023  22:43    try edit texture on   mtlcolor
 	void loadObj(objl::Loader& loader, Material& mtlcolor, int textureIndex = -1, 
 		int bumpMapIndex= -1, int roughnessIndex = -1, int metallicIndex = -1) {
 
-		for (auto m : loader.LoadedMeshes) {
-			for (int i = 0; i < m.Vertices.size(); i += 3) {
-				// each triangle
-				std::unique_ptr<Triangle> t = std::make_unique<Triangle>();
+		size_t nIndices = 0;
+		for (auto& m : loader.LoadedMeshes) nIndices += m.Indices.size();
+		if (nIndices < 3) return;
 
-				for (int j = 0; j < 3; j++) {
-					t->objectType = OBJTYPE::TRIANGLE;
-					objl::Vertex v = m.Vertices[i+j];
+		TriangleMesh* mesh = scene.arena.create<TriangleMesh>();
+		mesh->indices.reserve(nIndices);
+		std::unordered_map<MeshVertexKey, uint32_t, MeshVertexKeyHash> vertexIndex;
 
-					if (j == 0) {
-						t->v0 = Vector3f(v.Position.X, v.Position.Y, v.Position.Z);
-						t->n0 = Vector3f(v.Normal.X, v.Normal.Y, v.Normal.Z);
-						t->uv0 = Vector2f(v.TextureCoordinate.X, v.TextureCoordinate.Y);
-					}
+		for (auto& m : loader.LoadedMeshes) {
+			for (unsigned int i : m.Indices) {
+				const objl::Vertex& v = m.Vertices[i];
+				MeshVertexKey key = { v.Position.X, v.Position.Y, v.Position.Z, v.Normal.X, v.Normal.Y, v.Normal.Z,
+					v.TextureCoordinate.X, v.TextureCoordinate.Y };
+				auto it = vertexIndex.find(key);
+				if (it == vertexIndex.end()) {
+					it = vertexIndex.emplace(key, (uint32_t)mesh->positions.size()).first;
+					mesh->positions.push_back(Vector3f(v.Position.X, v.Position.Y, v.Position.Z));
+					mesh->normals.push_back(Vector3f(v.Normal.X, v.Normal.Y, v.Normal.Z));
+					mesh->uvs.push_back(Vector2f(v.TextureCoordinate.X, v.TextureCoordinate.Y));
+				}
+				mesh->indices.push_back(it->second);
+			}
+		}
+		mesh->mtlcolor = mtlcolor;
+		mesh->textureIndex = textureIndex;
+		mesh->normalMapIndex = bumpMapIndex;
+		mesh->roughnessMapIndex = roughnessIndex;
+		mesh->metallicMapIndex = metallicIndex;
+		if (mesh->textureIndex != -1 || mesh->normalMapIndex != -1 || mesh->metallicMapIndex != -1
+			|| mesh->roughnessMapIndex != -1)
+			mesh->isTextureActivated = true;
+		mesh->shrink_to_fit();
+		mesh->initializeBound();
+		std::cout << "object loaded sucessfully: " << mesh->triangleCount() << " triangles, "
+			<< mesh->positions.size() << " vertices, " << (mesh->memoryUsage() >> 10) << " KB\n";
+		scene.add(mesh);
+	}
 
-					else if (j == 1) {
-						t->v1 = Vector3f(v.Position.X, v.Position.Y, v.Position.Z);
-						t->n1 = Vector3f(v.Normal.X, v.Normal.Y, v.Normal.Z);
-						t->uv1 = Vector2f(v.TextureCoordinate.X, v.TextureCoordinate.Y);
-					}
+	// queue an OBJ file, all its triangles get mtlcolor and the textures
+	// the files are read by loadScene, from the scene cache if there is a valid one
+	void addObjFile(const std::string& path, const Material& mtlcolor, int textureIndex = -1,
+		int bumpMapIndex = -1, int roughnessIndex = -1, int metallicIndex = -1) {
+		ObjFileEntry f;
+		f.path = path;
+		f.mtl = mtlcolor;
+		f.textureIndex = textureIndex;
+		f.normalMapIndex = bumpMapIndex;
+		f.roughnessMapIndex = roughnessIndex;
+		f.metallicMapIndex = metallicIndex;
+		objFiles.push_back(f);
+	}
 
-					else if (j == 2) {
-						t->v2 = Vector3f(v.Position.X, v.Position.Y, v.Position.Z);
-						t->n2 = Vector3f(v.Normal.X, v.Normal.Y, v.Normal.Z);
-						t->uv2 = Vector2f(v.TextureCoordinate.X, v.TextureCoordinate.Y);
-					}
-				}
-				t->mtlcolor = mtlcolor;
-				t->textureIndex = textureIndex;
-				t->normalMapIndex = bumpMapIndex;
-				t->roughnessMapIndex = roughnessIndex;
-				t->metallicMapIndex = metallicIndex;
-				if (t->textureIndex != -1 || t->normalMapIndex != -1 || t->metallicMapIndex != -1
-					|| t->roughnessMapIndex != -1)
-					t->isTextureActivated = true;
-				t->initializeBound();
-				scene.add(std::move(t));
+	// load the queued OBJ files and build the BVH of the whole scene
+	// with a scene cache: a hit replaces both, a miss writes the cache afterwards
+	void loadScene() {
+		SceneCache cache(sceneCacheDir);
+		uint64_t key = 0;
+		if (!sceneCacheDir.empty()) {
+			key = cache.computeKey(scene, objFiles);
+			if (cache.load(key, scene, objFiles)) {
+				scene.reportMemory();
+				return;
 			}
-			std::cout << "object loaded sucessfully\n";
+			std::cout << "scene cache miss " << cache.pathOf(key) << "\n";
 		}
-		
+
+		for (ObjFileEntry& f : objFiles) {
+			objl::Loader loader;
+			size_t before = scene.objList.size();
+			if (loader.LoadFile(f.path))
+				loadObj(loader, f.mtl, f.textureIndex, f.normalMapIndex, f.roughnessMapIndex, f.metallicMapIndex);
+			else std::cout << "can't load " << f.path << "\n";
+			f.nTriangles = scene.objList.size() == before ? 0
+				: static_cast<TriangleMesh*>(scene.objList.back())->triangleCount();
+		}
+		scene.initializeBVH();
+
+		if (!sceneCacheDir.empty())
+			cache.save(key, scene, objFiles);
+		scene.reportMemory();
 	}
 
 	void transObj(objl::Loader& loader, float xOff, float yOff, float zOff) {
@@ -294,6 +345,11 @@ public:
 			if (FLOAT_EQUAL(viewdir.x, updir.x) && FLOAT_EQUAL(viewdir.y, updir.y) && FLOAT_EQUAL(viewdir.z, updir.z)) {
 				throw std::runtime_error("invalid viewPlane infomation: updir and view dir can't be the same");
 			}
+			// spp may come after "adaptive", so its max is checked once everything is read
+			if (ADAPTIVE_THRESHOLD > 0 && ADAPTIVE_MAX_SPP <= SPP) {
+				throw std::runtime_error("adaptive: maxspp " + std::to_string(ADAPTIVE_MAX_SPP) + " has to be greater than spp "
+					+ std::to_string(SPP) + ", or use adaptive off\n");
+			}
 
 			// initialize camera
 			cam.width = width;
@@ -317,7 +373,7 @@ public:
 	void initializeLights() {
 		for (int i = 0; i < scene.objList.size(); i++) {
 			if (scene.objList[i]->mtlcolor.hasEmission()) {
-				lightlist.push_back(scene.objList[i].get());
+				lightlist.push_back(scene.objList[i]);
 			}
 		}
 		std::cout << "light initialization complete \n";
@@ -357,7 +413,7 @@ public:
 		case 1: {	//sphere
 
 			// create sphere object
-			std::unique_ptr<Sphere> s = std::make_unique<Sphere>();
+			Sphere* s = scene.arena.create<Sphere>();
 			s->mtlcolor = mtlcolor;
 
 			checkFin(); fin >> t0; checkFin(); fin >> t1; checkFin(); fin >> t2; checkFin(); fin >> t3;
@@ -398,7 +454,7 @@ public:
 
 			// push it into scene.objList
 			s->initializeBound();
-			scene.add(std::move(s));
+			scene.add(s);
 			break;
 		}
 		case 2: {	// face/triangle
@@ -432,7 +488,7 @@ public:
 
 
 
-			std::unique_ptr<Triangle> s = std::make_unique<Triangle>(t);
+			Triangle* s = scene.arena.create<Triangle>(t);
 
 
 			// see if texure is enable
@@ -448,7 +504,7 @@ public:
 			}
 			s->objectType = OBJTYPE::TRIANGLE;
 			s->initializeBound();
-			scene.add(std::move(s));
+			scene.add(s);
 			break;
 		}
 		case 3: {	// normal vertex		vn
@@ -777,9 +833,110 @@ public:
 			else if (!a.compare("bdpt")) {
 				integrateType = 3;
 			}
+			else if (!a.compare("wavefront")) {
+				integrateType = 4;
+			}
 			else throw std::runtime_error("unknown integrator\n");
 		}
 
+		// BVH split method
+		else if (!key.compare("bvh")) {
+			checkFin(); fin >> a;
+			if (!a.compare("sah")) {
+				scene.bvhSplitMethod = BVH_SAH;
+			}
+			else if (!a.compare("median")) {
+				scene.bvhSplitMethod = BVH_MEDIAN;
+			}
+			else throw std::runtime_error("unknown bvh split method\n");
+		}
+
+		// accelerator: bvh (binary) or qbvh (4-wide)
+		else if (!key.compare("accel")) {
+			checkFin(); fin >> a;
+			if (!a.compare("bvh")) {
+				scene.accelType = ACCEL_BVH;
+			}
+			else if (!a.compare("qbvh")) {
+				scene.accelType = ACCEL_QBVH;
+			}
+			else throw std::runtime_error("unknown accelerator, expect bvh or qbvh\n");
+		}
+
+		// max number of objects in one BVH leaf
+		else if (!key.compare("bvhleaf")) {
+			checkFin(); fin >> a;
+			checkPosInt(a);
+			scene.bvhMaxLeafSize = std::stoi(a);
+			if (scene.bvhMaxLeafSize < 1 || scene.bvhMaxLeafSize > BVH_MAX_LEAF_SIZE)
+				throw std::runtime_error("bvhleaf: expect a number from 1 to 255\n");
+		}
+
+		// number of render threads, default: all hardware threads
+		else if (!key.compare("threads")) {
+			checkFin(); fin >> a;
+			checkPosInt(a);
+			N_THREAD = std::stoi(a);
+			if (N_THREAD < 1)
+				throw std::runtime_error("threads: expect a positive integer\n");
+		}
+
+		// seed of the per pixel random streams
+		else if (!key.compare("seed")) {
+			checkFin(); fin >> a;
+			checkPosInt(a);
+			RNG_SEED = std::stoul(a);
+		}
+
+		// samples per pixel
+		else if (!key.compare("spp")) {
+			checkFin(); fin >> a;
+			checkPosInt(a);
+			SPP = std::max(1, std::stoi(a));
+			SPP_inv = 1.f / SPP;
+		}
+
+		// adaptive sampling: relative error threshold, max samples per pixel. SPP is the minimum, "adaptive off" disables it
+		else if (!key.compare("adaptive")) {
+			checkFin(); fin >> a;
+			if (a == "off") ADAPTIVE_THRESHOLD = 0;
+			else {
+				checkFin(); fin >> b;
+				checkFloat(a);
+				checkPosInt(b);
+				ADAPTIVE_THRESHOLD = std::stof(a);
+				ADAPTIVE_MAX_SPP = std::stoi(b);
+				if (ADAPTIVE_THRESHOLD <= 0)
+					throw std::runtime_error("adaptive expects a threshold > 0, or off\n");
+			}
+		}
+
+		// where the random numbers come from: independent, stratified, halton or sobol
+		else if (!key.compare("sampler")) {
+			checkFin(); fin >> a;
+			SAMPLER_TYPE = parseSamplerType(a);
+		}
+
+		// on: every sample shoots through its own spot of the pixel (antialiasing), off: the pixel center
+		else if (!key.compare("pixeljitter")) {
+			checkFin(); fin >> a;
+			if (a != "on" && a != "off")
+				throw std::runtime_error("pixeljitter expects on or off\n");
+			PIXEL_JITTER = a == "on";
+		}
+
+		// pin the render threads: none, core or numa
+		else if (!key.compare("pin")) {
+			checkFin(); fin >> a;
+			THREAD_PIN = parsePinning(a);
+		}
+
+		// directory of the scene cache, "off" disables it
+		else if (!key.compare("scenecache")) {
+			checkFin(); fin >> a;
+			sceneCacheDir = a.compare("off") ? a : "";
+		}
+
 		// read object
 		else if (existIn(key, objType)) {
 			readObject(key);
@@ -6,10 +6,7 @@
 #define MIN_DEPTH 3
 
 class PathTracing;
-// thread argument
-// 12/23/2023: unknown reason, if I put start and end inside this arg struct
-// instead of passing them as thread function parameters like Im doing now
-// some of upper img is not rendered  
+// thread argument, shared by all the threads, lives until the render is done
 struct Thread_arg_pt {
 	// ul, delta_v  delta_h  g->rgb  eyePos
 	const Vector3f* ul;
@@ -22,7 +19,7 @@ struct Thread_arg_pt {
 	PathTracing* pt;
 };
 
-void sub_render_pt(Thread_arg_pt* a, int threadID, int s, int e);
+void sub_render_pt(Thread_arg_pt* a, int threadID, const Tile& tile);
 
 // for recording
 #if RECORD
@@ -50,7 +47,8 @@ public:
 	Vector3f calcForMirror(const Vector3f& origin, const Vector3f& dir, Intersection& inter, int depth) {
 		if (depth > MAX_DEPTH) return 0;	// 2 mirror reflect forever causing stack overflow
 		Vector3f wi;
-		inter.mtlcolor.sampleDirection(normalized(-dir), inter.Ns, wi);
+		startBounce(depth, SLOT_BSDF);
+		inter.mtl->sampleDirection(inter.surface, normalized(-dir), inter.Ns, wi);
 
 		wi = normalized(wi);
 
@@ -60,8 +58,8 @@ public:
 		if (x_inter.intersected) {
 			float cos = inter.Ng.dot(wi);
 			Vector3f wo = -dir;
-			float pdf = inter.mtlcolor.pdf(wo, wi, inter.Ns);
-			Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, inter.Ng, inter.Ns, g->eta);
+			float pdf = inter.mtl->pdf(inter.surface, wo, wi, inter.Ns);
+			Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, inter.Ng, inter.Ns, g->eta);
 
 			Vector3f res = traceRay(rayOrig, wi, depth + 1, Vector3f(1));
 			return res * f_r * cos / pdf;
@@ -87,18 +85,19 @@ public:
 
 		Vector3f wo = -dir;
 		float eta_i = g->eta;
-		float eta_t = inter.mtlcolor.eta;
+		float eta_t = inter.mtl->eta;
 
 		Vector3f wi;
-		auto [sampleSuccess, TIR] = inter.mtlcolor.sampleDirection(wo, inter.Ns, wi, eta_i);
+		startBounce(depth, SLOT_BSDF);
+		auto [sampleSuccess, TIR] = inter.mtl->sampleDirection(inter.surface, wo, inter.Ns, wi, eta_i);
 		wi = normalized(wi);
-		float pdf = inter.mtlcolor.pdf(wi, wo, inter.Ns, eta_i, eta_t);
+		float pdf = inter.mtl->pdf(inter.surface, wi, wo, inter.Ns, eta_i, eta_t);
 
 		// total internal reflection
 		if (TIR) {
 			wi = normalized(getReflectionDir(wo, Ns));
 			pdf = 1;
-			if (inter.mtlcolor.mType == MICROFACET_T) {
+			if (inter.mtl->mType == MICROFACET_T) {
 				Vector3f interNg = Ng;
 				Vector3f interNs = Ns;
 				if (wo.dot(Ng) < 0) {
@@ -110,10 +109,10 @@ public:
 				float F = fresnel(wi, interNs, eta_i, eta_t);
 				float cosTheta = abs(interNs.dot(h));
 				wi = normalized(getReflectionDir(wo, h));
-				pdf = 1 * D_ndf(h, interNs, inter.mtlcolor.roughness) * cosTheta / (4.f * wo.dot(h));
+				pdf = 1 * D_ndf(h, interNs, inter.surface.roughness) * cosTheta / (4.f * wo.dot(h));
 			}
 		}
-		Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, Ng, Ns, eta_i, false, TIR);
+		Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, Ng, Ns, eta_i, false, TIR);
 
 		Vector3f rayOrig = inter.pos;
 		float cos = 0;
@@ -149,8 +148,8 @@ public:
 		// if ray has no intersection, return bkgcolor
 		if (!inter.intersected)		return g->bkgcolor;
 
-		if (inter.mtlcolor.mType == PERFECT_REFRACTIVE
-			|| inter.mtlcolor.mType == MICROFACET_T)
+		if (inter.mtl->mType == PERFECT_REFRACTIVE
+			|| inter.mtl->mType == MICROFACET_T)
 			return calcForRefractive(origin, dir, inter, depth, thdID, recording);
 
 		// TEXTURE
@@ -158,16 +157,16 @@ public:
 			textureModify(inter, g);
 
 		// if UNLIT material, return diffuse
-		if (inter.mtlcolor.mType == UNLIT) return inter.mtlcolor.diffuse;
+		if (inter.mtl->mType == UNLIT) return inter.surface.diffuse;
 
 		// indirect light hit emissive object, return 0
-		if (inter.mtlcolor.hasEmission() && depth > 0)
+		if (inter.mtl->hasEmission() && depth > 0)
 			return 0;
 
 		// if ray hit emissive object, return the L_o
 		// depth > 0: indirect light, excluded
-		if (inter.mtlcolor.hasEmission())  
-			return inter.mtlcolor.emission;
+		if (inter.mtl->hasEmission())  
+			return inter.mtl->emission;
 		
 
 		Vector3f wo = -dir;
@@ -182,6 +181,7 @@ public:
 		float mat_pdf;
 		float mis_weight_m = 0.f;
 		Intersection light_inter;
+		startBounce(depth, SLOT_LIGHT);
 		sampleLight(light_inter, light_pdf, g);
 
 		bool rayInside = inter.Ns.dot(wo) < 0;
@@ -189,14 +189,14 @@ public:
 		Vector3f lightPos = light_inter.pos;
 		offsetRayOrig(shadowRayOrig, inter.Ns, rayInside);
 		offsetRayOrig(lightPos, light_inter.Ns, false);
-		if (!light_inter.intersected || isShadowRayBlocked(shadowRayOrig, lightPos, g)) {}
+		if (!light_inter.intersected || isShadowRayBlocked(shadowRayOrig, lightPos, g, interStrategy)) {}
 		else {
 			Vector3f wi = light_inter.pos - inter.pos;
 			float r2 = wi.norm2();
 			wi = normalized(wi);
 			if (wi.dot(light_inter.Ns) > 0) {}
 			else {
-				mat_pdf = inter.mtlcolor.pdf(wi, wo, inter.Ns, g->eta, inter.mtlcolor.eta);	// w.r.t solid angle
+				mat_pdf = inter.mtl->pdf(inter.surface, wi, wo, inter.Ns, g->eta, inter.mtl->eta);	// w.r.t solid angle
 				Vector3f light_N = normalized(light_inter.Ns);
 				float cos_theta_prime = light_N.dot(-wi);
 				if (cos_theta_prime <= 0) goto jmp;
@@ -210,8 +210,8 @@ public:
 				float pdfl = light_pdf;
 				light_pdf = light_pdf * r2 / cos_theta_prime;
 				mis_weight_l = getMisWeight(light_pdf, mat_pdf);
-				Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, inter.Ng, inter.Ns, g->eta);
-				Vector3f L_i = light_inter.mtlcolor.emission;
+				Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, inter.Ng, inter.Ns, g->eta);
+				Vector3f L_i = light_inter.mtl->emission;
 				if (r2 * pdfl < MIN_DIVISOR) return sampleValue;
 				sampleValue = sampleValue +
 					(mis_weight_l * L_i * f_r * cos_theta * cos_theta_prime / (r2 * pdfl));
@@ -221,11 +221,12 @@ public:
 		// *********************** Sample BSDF ********************
 	jmp:
 		Vector3f wi;
-		auto [sampleSucess, specialEvent] = inter.mtlcolor.sampleDirection(wo, inter.Ns, wi, g->eta);
+		startBounce(depth, SLOT_BSDF);
+		auto [sampleSucess, specialEvent] = inter.mtl->sampleDirection(inter.surface, wo, inter.Ns, wi, g->eta);
 		if (!sampleSucess)
 			return sampleValue;
 
-		mat_pdf = inter.mtlcolor.pdf(wi, wo, inter.Ns, g->eta, inter.mtlcolor.eta);
+		mat_pdf = inter.mtl->pdf(inter.surface, wi, wo, inter.Ns, g->eta, inter.mtl->eta);
 		Intersection x_inter;
 		Vector3f rayOrig = inter.pos;
 		offsetRayOrig(rayOrig, inter.Ns, wi.dot(inter.Ns) < 0);
@@ -249,10 +250,10 @@ public:
 				float l_pdf_transformed = light_pdf * r2 / cos_theta_prime;
 
 				mis_weight_m = getMisWeight(mat_pdf, l_pdf_transformed);
-				if (inter.mtlcolor.mType == PERFECT_REFLECTIVE && mat_pdf == 1.f)
+				if (inter.mtl->mType == PERFECT_REFLECTIVE && mat_pdf == 1.f)
 					mis_weight_m = 1.f;
-				Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, inter.Ng, inter.Ns, g->eta);
-				Vector3f L_i = x_inter.mtlcolor.emission;
+				Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, inter.Ng, inter.Ns, g->eta);
+				Vector3f L_i = x_inter.mtl->emission;
 
 				if (mat_pdf < MIN_DIVISOR) return sampleValue;
 				sampleValue = sampleValue +
@@ -267,7 +268,7 @@ public:
 				if (getRandomFloat() > rr_prob)
 					return sampleValue;
 
-				Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, inter.Ng, inter.Ns, g->eta);
+				Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, inter.Ng, inter.Ns, g->eta);
 				Vector3f coe = f_r * cos_theta / (mat_pdf * rr_prob);
 				if (mat_pdf * rr_prob < MIN_DIVISOR) return sampleValue;
 				tp = tp * coe;
@@ -279,7 +280,7 @@ public:
 		}
 
 #else // Next Event Estimation Only
-		if (inter.mtlcolor.mType == PERFECT_REFLECTIVE)
+		if (inter.mtl->mType == PERFECT_REFLECTIVE)
 			return calcForMirror(origin, dir, inter, depth);
 
 		Vector3f dir_illu(0.f);
@@ -287,6 +288,7 @@ public:
 		// ****** Direct illumination
 		float light_pdf;
 		Intersection light_inter;
+		startBounce(depth, SLOT_LIGHT);
 		sampleLight(light_inter, light_pdf, g);
 		if (!light_inter.intersected) {}
 		else {
@@ -294,9 +296,9 @@ public:
 			bool rayInside = inter.Ng.dot(wo) < 0;
 			Vector3f shadowRayOrig = inter.pos;
 			offsetRayOrig(shadowRayOrig, inter.Ng, rayInside);
-			if (isShadowRayBlocked(shadowRayOrig, light_inter.pos, g)) {}
+			if (isShadowRayBlocked(shadowRayOrig, light_inter.pos, g, interStrategy)) {}
 			else {	// ray is not blocked, then calculate the direct illumination
-				Vector3f L_i = light_inter.mtlcolor.emission;
+				Vector3f L_i = light_inter.mtl->emission;
 				Vector3f light_N = normalized(light_inter.Ng);
 				Vector3f p_to_light = normalized(light_inter.pos - inter.pos);
 				float cos_theta_prime = light_N.dot(-p_to_light);
@@ -305,7 +307,7 @@ public:
 				else {
 					float dis2 = (light_inter.pos - inter.pos).norm2();
 					float cos_theta = p_to_light.dot(inter.Ns);
-					Vector3f f_r = inter.mtlcolor.BxDF(p_to_light, wo, inter.Ng, inter.Ns, g->eta);
+					Vector3f f_r = inter.mtl->BxDF(inter.surface, p_to_light, wo, inter.Ng, inter.Ns, g->eta);
 
 					dir_illu = L_i * f_r * cos_theta * cos_theta_prime / (dis2 * light_pdf);
 				}
@@ -313,6 +315,7 @@ public:
 		}
 
 		// ****** Indirect Illumination
+		startBounce(depth, SLOT_BSDF);
 		tp = depth > MIN_DEPTH ? tp : 1;
 		float rr_prob = std::max(tp.x, std::max(tp.y, tp.z));
 		if (getRandomFloat() > rr_prob)
@@ -320,7 +323,7 @@ public:
 
 		// inter point p to another point x
 		Vector3f wi;
-		auto [sampleSucess, TIR] = inter.mtlcolor.sampleDirection(wo, inter.Ns, wi, g->eta);
+		auto [sampleSucess, TIR] = inter.mtl->sampleDirection(inter.surface, wo, inter.Ns, wi, g->eta);
 		if (!sampleSucess)
 			return sampleValue;
 
@@ -330,11 +333,11 @@ public:
 		offsetRayOrig(rayOrig, inter.Ng, rayInside);
 		interStrategy->UpdateInter(x_inter, g->scene, rayOrig, wi);
 		// calculate only when inter is on a non-emissive object
-		if (x_inter.intersected && !x_inter.mtlcolor.hasEmission()) {
-			float pdf = inter.mtlcolor.pdf(wi, wo, inter.Ns, g->eta, inter.mtlcolor.eta);
+		if (x_inter.intersected && !x_inter.mtl->hasEmission()) {
+			float pdf = inter.mtl->pdf(inter.surface, wi, wo, inter.Ns, g->eta, inter.mtl->eta);
 			float cos_theta = abs(inter.Ns.dot(wi));
 
-			Vector3f f_r = inter.mtlcolor.BxDF(wi, wo, inter.Ng, inter.Ns, g->eta);
+			Vector3f f_r = inter.mtl->BxDF(inter.surface, wi, wo, inter.Ng, inter.Ns, g->eta);
 			Vector3f coe = f_r * cos_theta / (pdf * rr_prob);
 			tp = tp * coe;
 			if (pdf * rr_prob < MIN_DIVISOR) return sampleValue + dir_illu;
@@ -391,79 +394,80 @@ public:
 		Vector3f c_off_v = (ll - ul) / (float)(g->height * 2); // vertical
 
 #if MULTITHREAD == 1
-		int rowPerthd = g->height / N_THREAD;
-		std::thread thds[N_THREAD];
-
-		for (int i = 0; i < N_THREAD - 1; i++) {
-			Thread_arg_pt arg{
-				&ul,
-				&delta_v,
-				&delta_h,
-				&c_off_h,
-				&c_off_v,
-				&eyePos,
-				g,
-				this
-			};
-
-			thds[i] = std::thread(sub_render_pt, &arg, i, (i * rowPerthd), ((i + 1) * rowPerthd));
-
-		}
-		// last thread
-		Thread_arg_pt arg_end{
-				&ul,
-				&delta_v,
-				&delta_h,
-				&c_off_h,
-				&c_off_v,
-				&eyePos,
-				g,
-				this
+		Thread_arg_pt arg{
+			&ul,
+			&delta_v,
+			&delta_h,
+			&c_off_h,
+			&c_off_v,
+			&eyePos,
+			g,
+			this
 		};
-
-		thds[N_THREAD - 1] = std::thread(sub_render_pt, &arg_end, N_THREAD - 1, (N_THREAD - 1) * rowPerthd, g->height);
-
-
-		for (int i = N_THREAD - 1; i >= 0; i--) {
-			thds[i].join();
-		}
+		TileScheduler scheduler(g->width, g->height, N_THREAD);
+		scheduler.run([&](const Tile& tile, int threadID) {
+			PROF_STAGE(STAGE_TILE);
+			sub_render_pt(&arg, threadID, tile);
+		});
 
 
 		// Single thread
 #else
+		Vector3f rayOrigs[RAY_PACKET_SIZE];
+		Vector3f rayDirs[RAY_PACKET_SIZE];
+		Intersection primaryInters[RAY_PACKET_SIZE];
 		for (int y = 0; y < g->height; y++) {
 			Vector3f v_off = y * delta_v;
 			//PRINT = false;
-			for (int x = 0; x < g->width; x++) {
-				if (x == 433 && y == 387) {
-					PRINT = true;
+			for (int x0 = 0; x0 < g->width; x0 += RAY_PACKET_SIZE) {
+				// camera rays of the next few pixels in the row go as one packet
+				int nRays = std::min(RAY_PACKET_SIZE, g->width - x0);
+				for (int k = 0; k < nRays; k++) {
+					Vector3f h_off = (x0 + k) * delta_h;
+					Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
+					Vector3f eyeLocation;
+					// calculate the rayDir and eyeLocation base on different projection method
+					if (!g->parallel_projection) {	// perspective
+						rayDirs[k] = normalized(pixelPos - eyePos);
+						eyeLocation = eyePos;
+					}
+					else {	// orthographic 
+						// set ray direction orthogonal to the view plane
+						rayDirs[k] = n;
+						eyeLocation = pixelPos - d * n;		// - d * n  only to set a distance between the eye location and near plane(enlarged)
+					}
+					rayOrigs[k] = eyePos;
 				}
-
-				Vector3f& color = g->cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
-				Vector3f h_off = x * delta_h;
-				Vector3f pixelPos = ul + h_off + v_off + c_off_h + c_off_v;		// pixel center position in world space
-				Vector3f rayDir;
-				Vector3f eyeLocation;
-				// calculate the rayDir and eyeLocation base on different projection method
-				if (!g->parallel_projection) {	// perspective
-					rayDir = normalized(pixelPos - eyePos);
-					eyeLocation = eyePos;
-				}
-				else {	// orthographic 
-					// set ray direction orthogonal to the view plane
-					rayDir = n;
-					eyeLocation = pixelPos - d * n;		// - d * n  only to set a distance between the eye location and near plane(enlarged)
-				}
-
-				// trace ray into each pixel
-				Vector3f estimate;
-				for (int i = 0; i < SPP; i++) {
-					estimate = estimate + traceRay(eyePos, rayDir, 0, Vector3f(1), nullptr, -1, RECORD);
+				PROF_ADD(PROF_CAMERA_RAYS, nRays);
+				interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, nRays);
+
+				for (int k = 0; k < nRays; k++) {
+					int x = x0 + k;
+					if (x == 433 && y == 387) {
+						PRINT = true;
+					}
+
+					Vector3f& color = g->cam.FrameBuffer.rgb.at(g->getIndex(x, y));		// update this color to change the rgb array
+
+					// trace ray into each pixel, every sample reuses the packet's first hit
+					// unless it shoots through its own spot of the pixel
+					PixelEstimator est;
+					for (int i = 0; !est.done(); i++) {
+						startSample(g->getIndex(x, y), i);
+						if (PIXEL_JITTER) {
+							Vector3f pixelPos = pixelCenter(ul, delta_h, delta_v, c_off_h, c_off_v, x, y);
+							Vector3f jitteredDir = normalized(jitterPixel(pixelPos, delta_h, delta_v) - eyePos);
+							PROF_COUNT(PROF_CAMERA_RAYS);
+							est.add(traceRay(eyePos, jitteredDir, 0, Vector3f(1), nullptr, -1, RECORD));
+							continue;
+						}
+						est.add(traceRay(eyePos, rayDirs[k], 0, Vector3f(1), &primaryInters[k], -1, RECORD));
+					}
+
+					PRINT = false;
+					color = est.estimate();
+					g->cam.sampleCount[g->getIndex(x, y)] = est.count();
 				}
-				estimate = estimate * SPP_inv;
-
-				PRINT = false;
-				color = estimate;
 			}
 
 			showProgress((float)y / g->height);
@@ -480,9 +484,8 @@ public:
 /// </summary>
 /// <param name="arg"></param>
 /// <param name="threadID"></param>
-/// <param name="s">start row</param>
-/// <param name="e">end row exclusive</param>
-void sub_render_pt(Thread_arg_pt* a, int threadID, int s, int e) {
+/// <param name="tile">pixels to render</param>
+void sub_render_pt(Thread_arg_pt* a, int threadID, const Tile& tile) {
 	Thread_arg_pt arg = *a;
 
 	const Vector3f ul = *arg.ul;
@@ -494,23 +497,71 @@ void sub_render_pt(Thread_arg_pt* a, int threadID, int s, int e) {
 	PathTracing* pt = arg.pt;
 	std::vector<Vector3f>* rgb_array = &(g->cam.FrameBuffer.rgb);
 	const Vector3f eyePos = *arg.eyePos;
-	int Ncol = g->width;
-
-	for (int y = s; y < e; y++) {
-		for (int x = 0; x < Ncol; x++) {
-			Vector3f& color = rgb_array->at(g->getIndex(x, y));
-			Vector3f rayDir = { 0,0,0 };
-			Vector3f pixelPos = ul + x * delta_h + y * delta_v + c_off_v + c_off_v;
-			rayDir = normalized((pixelPos - eyePos));
-
-			// trace ray into each pixel
-			Vector3f estimate;
-			for (int i = 0; i < SPP; i++) {
-				Vector3f res = pt->traceRay(eyePos, rayDir, 0, Vector3f(1), nullptr, threadID);
-				if (!isnan(res.x) && !isnan(res.y) && !isnan(res.z))	// wipe out the white noise
-					estimate = estimate + res;
+
+	Vector3f rayOrigs[RAY_PACKET_SIZE];
+	Vector3f rayDirs[RAY_PACKET_SIZE];
+	Intersection primaryInters[RAY_PACKET_SIZE];
+	PixelEstimator ests[RAY_PACKET_SIZE];
+	int lanes[RAY_PACKET_SIZE];		// pixels of the packet still sampling
+	for (int y = tile.y0; y < tile.y1; y++) {
+		for (int x0 = tile.x0; x0 < tile.x1; x0 += RAY_PACKET_SIZE) {
+			int n = std::min(RAY_PACKET_SIZE, tile.x1 - x0);
+			if (PIXEL_JITTER) {
+				// every sample shoots through its own spot of the pixel, so the packet
+				// holds the camera rays of sample i of the next few pixels that aren't done yet
+				for (int k = 0; k < n; k++) ests[k] = PixelEstimator();
+				for (int i = 0; ; i++) {
+					int m = 0;
+					for (int k = 0; k < n; k++)
+						if (!ests[k].done()) lanes[m++] = k;
+					if (m == 0) break;
+					for (int j = 0; j < m; j++) {
+						int x = x0 + lanes[j];
+						startSample(g->getIndex(x, y), i);
+						Vector3f pixelPos = pixelCenter(ul, delta_h, delta_v, c_off_h, c_off_v, x, y);
+						rayOrigs[j] = eyePos;
+						rayDirs[j] = normalized(jitterPixel(pixelPos, delta_h, delta_v) - eyePos);
+					}
+					PROF_ADD(PROF_CAMERA_RAYS, m);
+					pt->interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, m);
+					for (int j = 0; j < m; j++) {
+						startSample(g->getIndex(x0 + lanes[j], y), i);
+						Vector3f res = pt->traceRay(eyePos, rayDirs[j], 0, Vector3f(1), &primaryInters[j], threadID);
+						if (isnan(res.x) || isnan(res.y) || isnan(res.z)) res = 0;	// wipe out the white noise
+						ests[lanes[j]].add(res);
+					}
+				}
+				for (int k = 0; k < n; k++) {
+					rgb_array->at(g->getIndex(x0 + k, y)) = ests[k].estimate();
+					g->cam.sampleCount[g->getIndex(x0 + k, y)] = ests[k].count();
+				}
+				continue;
+			}
+
+			// camera rays of the next few pixels in the row go as one packet,
+			// every sample of a pixel shoots the same ray so the first hit is reused
+			for (int k = 0; k < n; k++) {
+				Vector3f pixelPos = pixelCenter(ul, delta_h, delta_v, c_off_h, c_off_v, x0 + k, y);
+				rayOrigs[k] = eyePos;
+				rayDirs[k] = normalized((pixelPos - eyePos));
+			}
+			PROF_ADD(PROF_CAMERA_RAYS, n);
+			pt->interStrategy->UpdateInterPacket(primaryInters, g->scene, rayOrigs, rayDirs, n);
+
+			for (int k = 0; k < n; k++) {
+				Vector3f& color = rgb_array->at(g->getIndex(x0 + k, y));
+
+				// trace ray into each pixel
+				PixelEstimator est;
+				for (int i = 0; !est.done(); i++) {
+					startSample(g->getIndex(x0 + k, y), i);
+					Vector3f res = pt->traceRay(eyePos, rayDirs[k], 0, Vector3f(1), &primaryInters[k], threadID);
+					if (isnan(res.x) || isnan(res.y) || isnan(res.z)) res = 0;	// wipe out the white noise
+					est.add(res);
+				}
+				color = est.estimate();
+				g->cam.sampleCount[g->getIndex(x0 + k, y)] = est.count();
 			}
-			color = estimate * SPP_inv;
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,242 @@
+#pragma once
+// hot path counters and stage timers of the render threads, PROFILE in global.hpp turns them on.
+// PROFILE 1 counts and times the coarse stages, PROFILE 2 also times every ray query on its own, that's
+// two time stamp reads per ray and noticeably slower, so it's only there to split intersect from shade
+// every thread counts into its own thread_local block with plain adds, no atomics. the tile scheduler
+// files a thread's block under its ID when the thread runs out of tiles, Renderer::render sums them up,
+// prints a table and writes them as JSON. with PROFILE 0 the macros are empty and nothing is counted
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROFILE_TSC 1
+#else
+#define PROFILE_TSC 0
+#endif
+
+enum ProfileCounter {
+	PROF_CAMERA_RAYS,		// primary rays, counted by the integrators where they make them
+	PROF_RAYS,				// closest hit queries, camera rays included
+	PROF_SHADOW_RAYS,		// any hit queries: shadow rays, BDPT connections
+	PROF_BVH_NODES,			// nodes visited, binary or 4-wide
+	PROF_PRIM_TESTS,		// ray / primitive tests
+	PROF_BSDF_EVALS,		// Material::BxDF, one per lane in the SIMD kernels
+	PROF_BSDF_SAMPLES,		// Material::sampleDirection
+	PROF_MIS_WEIGHTS,		// getMisWeight, BDPT::MISweight
+	PROF_SPLATS,			// light tracing and BDPT splats into the film
+	PROF_COUNTERS
+};
+
+// time goes to the innermost open stage, so nested stages don't count twice
+enum ProfileStage {
+	STAGE_NONE,			// outside of any stage, not reported
+	STAGE_TILE,			// the rest of an integrator's tile: sampling, BSDFs, MIS, path bookkeeping,
+						// and below PROFILE 2 the single ray queries of the recursive integrators
+	STAGE_CAMERA,		// camera rays: making them, packets of primary hits
+	STAGE_INTERSECT,	// closest hits of the other rays: the wavefront extend stage, every query with PROFILE 2
+	STAGE_SHADOW,		// any hit queries: the wavefront connect stage, every query with PROFILE 2
+	STAGE_FILM,			// pixel writes, splat films
+	PROF_STAGES
+};
+
+const char* profileCounterKey(int c) {
+	static const char* keys[PROF_COUNTERS] = { "camera_rays", "rays", "shadow_rays", "bvh_nodes", "primitive_tests",
+		"bsdf_evals", "bsdf_samples", "mis_weights", "splats" };
+	return keys[c];
+}
+
+const char* profileStageName(int s) {
+	static const char* names[PROF_STAGES] = { "none", "tile", "camera", "intersect", "shadow", "film" };
+	return names[s];
+}
+
+struct ProfileCounters {
+	uint64_t count[PROF_COUNTERS];
+	uint64_t ticks[PROF_STAGES];		// profileTicks() spent in the stage
+	uint64_t calls[PROF_STAGES];		// times the stage was entered
+
+	void add(const ProfileCounters& o) {
+		for (int c = 0; c < PROF_COUNTERS; c++) count[c] += o.count[c];
+		for (int s = 0; s < PROF_STAGES; s++) {
+			ticks[s] += o.ticks[s];
+			calls[s] += o.calls[s];
+		}
+	}
+};
+
+// counters of the calling thread and the stage it's in. plain data, zero initialized,
+// so an access is one add relative to the thread pointer
+struct ThreadProfile : ProfileCounters {
+	int stage;			// ProfileStage
+	uint64_t since;		// when the current stage was entered or resumed
+};
+thread_local ThreadProfile threadProfile = {};
+
+// time stamp counter where there is one, it's a few cycles to read
+inline uint64_t profileTicks() {
+#if PROFILE_TSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// the time spent in the scope goes to stage s, minus the stages opened inside it
+class ProfileScope {
+public:
+	ProfileScope(ProfileStage s) {
+		ThreadProfile& p = threadProfile;
+		uint64_t now = profileTicks();
+		p.ticks[p.stage] += now - p.since;
+		p.since = now;
+		parent = p.stage;
+		p.stage = s;
+		p.calls[s]++;
+	}
+
+	~ProfileScope() {
+		ThreadProfile& p = threadProfile;
+		uint64_t now = profileTicks();
+		p.ticks[p.stage] += now - p.since;
+		p.since = now;
+		p.stage = parent;
+	}
+
+private:
+	int parent;
+};
+
+#if PROFILE
+#define PROF_COUNT(c) (threadProfile.count[c]++)
+#define PROF_ADD(c, n) (threadProfile.count[c] += (n))
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_STAGE(s) ProfileScope PROF_CONCAT(profileScope, __LINE__)(s)
+#else
+#define PROF_COUNT(c) ((void)0)
+#define PROF_ADD(c, n) ((void)0)
+#define PROF_STAGE(s) ((void)0)
+#endif
+
+// stage of a single ray query
+#if PROFILE >= 2
+#define PROF_RAY_STAGE(s) PROF_STAGE(s)
+#define PROFILE_RAY_STAGES 1
+#else
+#define PROF_RAY_STAGE(s) ((void)0)
+#define PROFILE_RAY_STAGES 0
+#endif
+// what the intersect / shadow stages cover without PROF_RAY_STAGE, printed with the stage tables
+#define PROFILE_STAGE_NOTE "intersect / shadow are the wavefront stages only, the other integrators' ray queries count as tile (PROFILE 2 times every query)"
+
+
+// the blocks filed by the render threads, one per thread ID and one for the thread calling Renderer::render
+std::vector<ProfileCounters> profileThreads;
+uint64_t profileStartTicks = 0;
+std::chrono::steady_clock::time_point profileStartTime;
+
+// forget everything counted so far, nThreads render threads are coming
+void profileReset(int nThreads) {
+	profileThreads.assign(nThreads + 1, ProfileCounters());
+	threadProfile = ThreadProfile();
+	profileStartTicks = profileTicks();
+	profileStartTime = std::chrono::steady_clock::now();
+}
+
+// add the calling thread's counts to slot `slot` and start over, slots beyond profileReset's are dropped
+void profileFlush(int slot) {
+	if (slot >= 0 && slot < (int)profileThreads.size()) profileThreads[slot].add(threadProfile);
+	int stage = threadProfile.stage;
+	uint64_t since = threadProfile.since;
+	threadProfile = ThreadProfile();
+	threadProfile.stage = stage;
+	threadProfile.since = since;
+}
+
+// the calling thread of Renderer::render, the counts it made outside the tile scheduler
+inline int profileMainSlot() {
+	return (int)profileThreads.size() - 1;
+}
+
+ProfileCounters profileTotal() {
+	ProfileCounters total = ProfileCounters();
+	for (const ProfileCounters& t : profileThreads) total.add(t);
+	return total;
+}
+
+// milliseconds per profileTicks() tick, measured against steady_clock since profileReset
+double profileMsPerTick() {
+#if PROFILE_TSC
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - profileStartTime).count();
+	uint64_t ticks = profileTicks() - profileStartTicks;
+	return ticks ? ms / ticks : 0;
+#else
+	return 1e-6;
+#endif
+}
+
+void writeProfileCounters(std::ofstream& out, const ProfileCounters& p, double msPerTick, const char* indent) {
+	out << "{\n";
+	for (int c = 0; c < PROF_COUNTERS; c++)
+		out << indent << "\t\"" << profileCounterKey(c) << "\": " << p.count[c] << ",\n";
+	out << indent << "\t\"stage_ms\": {";
+	for (int s = STAGE_TILE; s < PROF_STAGES; s++)
+		out << (s > STAGE_TILE ? ", " : " ") << "\"" << profileStageName(s) << "\": " << p.ticks[s] * msPerTick;
+	out << " },\n" << indent << "\t\"stage_calls\": {";
+	for (int s = STAGE_TILE; s < PROF_STAGES; s++)
+		out << (s > STAGE_TILE ? ", " : " ") << "\"" << profileStageName(s) << "\": " << p.calls[s];
+	out << " }\n" << indent << "}";
+}
+
+// summary table on stdout, totals and every thread's block in jsonName
+// stage times are summed over the threads, the shares are of that sum
+void profileReport(const std::string& jsonName, const char* integrator, double wallMs) {
+	ProfileCounters total = profileTotal();
+	double msPerTick = profileMsPerTick();
+	const uint64_t* n = total.count;
+	uint64_t rays = n[PROF_RAYS] + n[PROF_SHADOW_RAYS];
+	double perRay = 1.0 / std::max<uint64_t>(rays, 1);
+
+	printf("\nprofile: %s, %.1f ms\n", integrator, wallMs);
+	printf("  rays        camera %llu  extension %llu  shadow %llu  total %llu  (%.2f Mrays/s)\n",
+		(unsigned long long)n[PROF_CAMERA_RAYS], (unsigned long long)(n[PROF_RAYS] - std::min(n[PROF_RAYS], n[PROF_CAMERA_RAYS])),
+		(unsigned long long)n[PROF_SHADOW_RAYS], (unsigned long long)rays, wallMs > 0 ? rays / wallMs * 1e-3 : 0.0);
+	printf("  BVH         nodes %llu (%.1f per ray)  primitive tests %llu (%.1f per ray)\n",
+		(unsigned long long)n[PROF_BVH_NODES], n[PROF_BVH_NODES] * perRay, (unsigned long long)n[PROF_PRIM_TESTS], n[PROF_PRIM_TESTS] * perRay);
+	printf("  BSDF        evaluations %llu  samples %llu\n", (unsigned long long)n[PROF_BSDF_EVALS], (unsigned long long)n[PROF_BSDF_SAMPLES]);
+	printf("  MIS weights %llu  splats %llu\n", (unsigned long long)n[PROF_MIS_WEIGHTS], (unsigned long long)n[PROF_SPLATS]);
+
+	uint64_t allTicks = 0;
+	for (int s = STAGE_TILE; s < PROF_STAGES; s++) allTicks += total.ticks[s];
+	printf("  %-10s %12s %7s %12s\n", "stage", "ms", "share", "calls");
+	for (int s = STAGE_TILE; s < PROF_STAGES; s++) {
+		if (!total.calls[s]) continue;
+		printf("  %-10s %12.1f %6.1f%% %12llu\n", profileStageName(s), total.ticks[s] * msPerTick,
+			100.0 * total.ticks[s] / std::max<uint64_t>(allTicks, 1), (unsigned long long)total.calls[s]);
+	}
+	if (!PROFILE_RAY_STAGES) printf("  %s\n", PROFILE_STAGE_NOTE);
+
+	std::ofstream out(jsonName);
+	out << "{\n\t\"integrator\": \"" << integrator << "\",\n\t\"wall_ms\": " << wallMs
+		<< ",\n\t\"threads\": " << profileThreads.size() - 1
+		<< ",\n\t\"ray_query_stages\": " << (PROFILE_RAY_STAGES ? "true" : "false") << ",\n\t\"total\": ";
+	writeProfileCounters(out, total, msPerTick, "\t");
+	out << ",\n\t\"per_thread\": [";
+	for (int t = 0; t < (int)profileThreads.size(); t++) {
+		out << (t ? ", " : "");
+		writeProfileCounters(out, profileThreads[t], msPerTick, "\t");
+	}
+	out << "]\n}\n";
+	std::cout << "profile written to " << jsonName << "\n";
+}
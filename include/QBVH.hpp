@@ -0,0 +1,279 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <float.h>
+
+#include "global.hpp"
+#include "Vector.hpp"
+#include "Intersection.hpp"
+#include "BVH.hpp"
+
+// SSE box tests when the compiler targets it, scalar loop otherwise
+#if WIDE_BVH_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define QBVH_SSE 1
+#include <immintrin.h>
+#else
+#define QBVH_SSE 0
+#endif
+
+#define QBVH_STACK_SIZE 256
+
+// which tree the BVHStrategy traverses
+enum AccelType { ACCEL_BVH, ACCEL_QBVH };
+
+// 4-wide node, the bounds of the 4 children are stored SoA
+// so one SSE register holds one plane of all 4 boxes
+struct alignas(16) QBVHNode {
+	float bounds[2][3][4];	// [min/max][x/y/z][child]
+	int child[4];			// interior: index of the child node, leaf: offset into ordered objects, -1: empty slot
+	int nPrims[4];			// number of objects of a leaf child, 0 for interior children
+};
+
+// per ray data for the box tests, computed once per ray
+struct QBVHRay {
+	int dirIsNeg[3];
+#if QBVH_SSE
+	__m128 o[3], invDir[3];
+#else
+	float o[3], invDir[3];
+#endif
+
+	QBVHRay(const Vector3f& rayOrig, const Vector3f& rayDir) {
+		float inv[3] = { 1 / rayDir.x, 1 / rayDir.y, 1 / rayDir.z };
+		float org[3] = { rayOrig.x, rayOrig.y, rayOrig.z };
+		for (int a = 0; a < 3; a++) {
+			dirIsNeg[a] = inv[a] < 0;
+#if QBVH_SSE
+			o[a] = _mm_set1_ps(org[a]);
+			invDir[a] = _mm_set1_ps(inv[a]);
+#else
+			o[a] = org[a];
+			invDir[a] = inv[a];
+#endif
+		}
+	}
+};
+
+// wide BVH collapsed from the binary BVHAccel, every node has up to 4 children
+// the objects (and their precomputed triangles) stay in the binary BVH, leaves index into them
+// collapsed into a growing vector, then copied into the scene's arena next to the binary tree
+class QBVHAccel {
+public:
+	QBVHAccel(const BVHAccel& binary, MemoryArena& arena) : bvh(binary) {
+		auto start = std::chrono::steady_clock::now();
+
+		const ArenaArray<LinearBVHNode>& bnodes = bvh.getNodes();
+		if (!bnodes.empty()) {
+			if (bnodes[0].nPrimitives > 0) {
+				// the whole scene is one leaf
+				collapsed.emplace_back();
+				initNode(collapsed[0]);
+				setChild(0, 0, 0, -1);
+			}
+			else collapse(0);
+		}
+		nodes = arena.copyArray(collapsed.data(), collapsed.size());
+		collapsed.clear();
+		collapsed.shrink_to_fit();
+
+		auto end = std::chrono::steady_clock::now();
+		std::cout << "QBVH collapsing Time consumed: " << std::chrono::duration<double, std::milli>(end - start).count()
+			<< " ms, nodes: " << nodes.size()
+			<< (QBVH_SSE ? ", SSE box tests\n" : ", scalar box tests\n");
+	}
+
+	// closest hit closer than inter.t, fill inter if found
+	bool Intersect(const Vector3f& rayOrig, const Vector3f& rayDir, Intersection& inter) const {
+		if (nodes.empty()) return false;
+
+		QBVHRay ray(rayOrig, rayDir);
+		float tMax = inter.t;
+		int hitIdx = -1;
+		float hitB1 = 0, hitB2 = 0;
+
+		// interior children are pushed as their node index,
+		// leaf children as -(4 * parent + slot) - 1 so they get ordered with the rest
+		BVHStackEntry toVisit[QBVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		toVisit[toVisitOffset++] = { 0, 0.f };
+		while (toVisitOffset > 0) {
+			BVHStackEntry entry = toVisit[--toVisitOffset];
+			if (entry.tEnter > tMax) continue;		// entered behind the closest hit
+
+			if (entry.node < 0) {
+				int leaf = -entry.node - 1;
+				const QBVHNode& parent = nodes[leaf >> 2];
+				int first = parent.child[leaf & 3];
+				for (int i = first; i < first + parent.nPrims[leaf & 3]; i++) {
+					float t, b1, b2;
+					if (bvh.intersectPrim(i, rayOrig, rayDir, tMax, t, b1, b2)) {
+						tMax = t;
+						hitIdx = i;
+						hitB1 = b1;
+						hitB2 = b2;
+					}
+				}
+				continue;
+			}
+
+			const QBVHNode& node = nodes[entry.node];
+			PROF_COUNT(PROF_BVH_NODES);
+			float tNear[4];
+			int mask = intersectChildren(node, ray, tMax, tNear);
+			if (mask == 0) continue;
+
+			// sort the hit children far to near, then push so the nearest is visited next
+			BVHStackEntry hits[4];
+			int nHits = 0;
+			for (int k = 0; k < 4; k++) {
+				if (!(mask & (1 << k))) continue;
+				BVHStackEntry e = { node.nPrims[k] > 0 ? -(4 * entry.node + k) - 1 : node.child[k], tNear[k] };
+				int j = nHits++;
+				while (j > 0 && hits[j - 1].tEnter < e.tEnter) {
+					hits[j] = hits[j - 1];
+					j--;
+				}
+				hits[j] = e;
+			}
+			for (int j = 0; j < nHits; j++)
+				toVisit[toVisitOffset++] = hits[j];
+		}
+
+		if (hitIdx == -1) return false;
+		bvh.fillPrim(hitIdx, rayOrig, rayDir, tMax, hitB1, hitB2, inter);
+		return true;
+	}
+
+	// any-hit query in (tMin, tMax), returns at the first blocker
+	bool Occluded(const Vector3f& rayOrig, const Vector3f& rayDir, float tMin, float tMax) const {
+		if (nodes.empty()) return false;
+
+		QBVHRay ray(rayOrig, rayDir);
+		int toVisit[QBVH_STACK_SIZE];
+		int toVisitOffset = 0;
+		toVisit[toVisitOffset++] = 0;
+		while (toVisitOffset > 0) {
+			const QBVHNode& node = nodes[toVisit[--toVisitOffset]];
+			PROF_COUNT(PROF_BVH_NODES);
+			float tNear[4];
+			int mask = intersectChildren(node, ray, tMax, tNear);
+			for (int k = 0; k < 4; k++) {
+				if (!(mask & (1 << k))) continue;
+				if (node.nPrims[k] == 0) {
+					toVisit[toVisitOffset++] = node.child[k];
+					continue;
+				}
+				for (int i = node.child[k]; i < node.child[k] + node.nPrims[k]; i++) {
+					if (bvh.occludedPrim(i, rayOrig, rayDir, tMin, tMax))
+						return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	int nodeCount() const { return nodes.size(); }
+	size_t memoryUsage() const { return nodes.size() * sizeof(QBVHNode); }
+
+private:
+	const BVHAccel& bvh;
+	ArenaArray<QBVHNode> nodes;
+	std::vector<QBVHNode> collapsed;	// construction only
+
+	// test the ray against the 4 child boxes, return a bit mask of the hit ones
+	// tNear: where the ray enters each box, clamped to 0
+	int intersectChildren(const QBVHNode& node, const QBVHRay& ray, float tMax, float tNear[4]) const {
+#if QBVH_SSE
+		__m128 tN = _mm_setzero_ps();
+		__m128 tF = _mm_set1_ps(tMax);
+		for (int a = 0; a < 3; a++) {
+			__m128 nearPlane = _mm_load_ps(node.bounds[ray.dirIsNeg[a]][a]);
+			__m128 farPlane = _mm_load_ps(node.bounds[1 - ray.dirIsNeg[a]][a]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(nearPlane, ray.o[a]), ray.invDir[a]);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(farPlane, ray.o[a]), ray.invDir[a]);
+			// max/min return the second operand on NaN (0 * inf), so a NaN slab is ignored
+			tN = _mm_max_ps(t0, tN);
+			tF = _mm_min_ps(t1, tF);
+		}
+		_mm_storeu_ps(tNear, tN);
+		return _mm_movemask_ps(_mm_cmple_ps(tN, tF));
+#else
+		int mask = 0;
+		for (int k = 0; k < 4; k++) {
+			float tN = 0.f, tF = tMax;
+			for (int a = 0; a < 3; a++) {
+				float t0 = (node.bounds[ray.dirIsNeg[a]][a][k] - ray.o[a]) * ray.invDir[a];
+				float t1 = (node.bounds[1 - ray.dirIsNeg[a]][a][k] - ray.o[a]) * ray.invDir[a];
+				tN = t0 > tN ? t0 : tN;
+				tF = t1 < tF ? t1 : tF;
+			}
+			tNear[k] = tN;
+			if (tN <= tF) mask |= 1 << k;
+		}
+		return mask;
+#endif
+	}
+
+	// empty slots get an inverted box so no ray ever hits them
+	void initNode(QBVHNode& node) {
+		for (int k = 0; k < 4; k++) {
+			for (int a = 0; a < 3; a++) {
+				node.bounds[0][a][k] = FLT_MAX;
+				node.bounds[1][a][k] = -FLT_MAX;
+			}
+			node.child[k] = -1;
+			node.nPrims[k] = 0;
+		}
+	}
+
+	// copy binary node bnode into slot k of collapsed[q], child is the wide node index for interior children
+	void setChild(int q, int k, int bnode, int child) {
+		const LinearBVHNode& b = bvh.getNodes()[bnode];
+		QBVHNode& node = collapsed[q];
+		node.bounds[0][0][k] = b.bound.pMin.x; node.bounds[0][1][k] = b.bound.pMin.y; node.bounds[0][2][k] = b.bound.pMin.z;
+		node.bounds[1][0][k] = b.bound.pMax.x; node.bounds[1][1][k] = b.bound.pMax.y; node.bounds[1][2][k] = b.bound.pMax.z;
+		if (b.nPrimitives > 0) {
+			node.child[k] = b.primitivesOffset;
+			node.nPrims[k] = b.nPrimitives;
+		}
+		else {
+			node.child[k] = child;
+			node.nPrims[k] = 0;
+		}
+	}
+
+	// turn the interior binary node into a wide node: keep opening the largest
+	// interior child until there are 4, return the index of the wide node
+	int collapse(int bnode) {
+		const ArenaArray<LinearBVHNode>& bnodes = bvh.getNodes();
+		int q = collapsed.size();
+		collapsed.emplace_back();
+		initNode(collapsed[q]);
+
+		int children[4] = { bnode + 1, bnodes[bnode].secondChildOffset };
+		int n = 2;
+		while (n < 4) {
+			int open = -1;
+			float maxArea = -1.f;
+			for (int k = 0; k < n; k++) {
+				const LinearBVHNode& c = bnodes[children[k]];
+				if (c.nPrimitives == 0 && c.bound.SurfaceArea() > maxArea) {
+					maxArea = c.bound.SurfaceArea();
+					open = k;
+				}
+			}
+			if (open == -1) break;		// all leaves
+			int c = children[open];
+			children[open] = c + 1;
+			children[n++] = bnodes[c].secondChildOffset;
+		}
+
+		for (int k = 0; k < n; k++) {
+			int child = bnodes[children[k]].nPrimitives > 0 ? -1 : collapse(children[k]);
+			setChild(q, k, children[k], child);		// collapsed may have grown, index again
+		}
+		return q;
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// PCG32 (pcg-random.org, minimal pcg32_random_r): 64 bit LCG state, xorshift + rotate output
+// 16 bytes of state and a few instructions per number, vs 5 KB for std::mt19937
+class PCG32 {
+public:
+	PCG32() { seed(0x853c49e6748fea9bull, 0xda3e39cb94b95bdbull); }
+
+	// initstate: where in the sequence to start, initseq: which of the 2^63 streams
+	void seed(uint64_t initstate, uint64_t initseq) {
+		state = 0u;
+		inc = (initseq << 1u) | 1u;
+		nextUInt();
+		state += initstate;
+		nextUInt();
+	}
+
+	uint32_t nextUInt() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ull + inc;
+		uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+		uint32_t rot = (uint32_t)(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// uniform in [0, 1): the top 24 bits scaled by 2^-24, never rounds up to 1
+	float nextFloat() {
+		return (nextUInt() >> 8) * 0x1p-24f;
+	}
+
+private:
+	uint64_t state;
+	uint64_t inc;
+};
+
+// splitmix64 finalizer, spreads nearby keys (pixel, sample) over the whole state space
+inline uint64_t mixBits(uint64_t v) {
+	v ^= v >> 30;
+	v *= 0xbf58476d1ce4e5b9ull;
+	v ^= v >> 27;
+	v *= 0x94d049bb133111ebull;
+	v ^= v >> 31;
+	return v;
+}
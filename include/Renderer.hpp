@@ -9,6 +9,7 @@
 #include<stack>
 #include<thread>
 #include<mutex>
+#include<chrono>
 
 #include "Vector.hpp"
 #include "global.hpp"
@@ -27,6 +28,7 @@
 #include "LightTracing.hpp"
 #include "NaivePT.hpp"
 #include "BDPT.hpp"
+#include "WavefrontPT.hpp"
 
 
 class Renderer {
@@ -47,10 +49,12 @@ public:
 			integrator = new NaivePT(g, interStrategy);
 		else if (inteType == 3)
 			integrator = new BDPT(g, interStrategy);
+		else if (inteType == 4)
+			integrator = new WavefrontPT(g, interStrategy);
 
 		records = std::vector<std::string>(N_THREAD, std::string());
 
-		g->scene.initializeBVH();
+		g->loadScene();
 	}
 
 	~Renderer() {
@@ -62,11 +66,31 @@ public:
 	// takes a PPMGenerator and render its rgb array
 	void render() {
 		g->initializeLights();
+		// integrators without adaptive sampling leave it at SPP everywhere
+		g->cam.sampleCount.assign(g->width * g->height, SPP);
+#if PROFILE
+		profileReset(N_THREAD);
+#endif
+		auto start = std::chrono::steady_clock::now();
 		integrator->integrate(g);
+		renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+#if PROFILE
+		// what the integrator counted outside of the tile scheduler's threads
+		profileFlush(profileMainSlot());
+		// counters and stage times as a table, and as JSON next to the image
+		profileReport(g->outputName("_profile.json"), integratorName(), renderMs);
+#endif
 	}
 
 public:
+	// the "integrator" keyword of the config
+	const char* integratorName() const {
+		static const char* names[] = { "path", "light", "naivept", "bdpt", "wavefront" };
+		return names[g->integrateType];
+	}
+
 	PPMGenerator* g;
 	IIntersectStrategy* interStrategy;
 	IIntegrator* integrator;
+	double renderMs = 0;	// wall time of the last render()
 };
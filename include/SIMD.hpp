@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// 4 and 8 float lanes for the vector math: Float4 is SSE or NEON, Float8 is AVX or two Float4.
+// -DVECTOR_SIMD=0 (or 0 here) falls back to plain float arrays with the same interface
+#ifndef VECTOR_SIMD
+#define VECTOR_SIMD 1
+#endif
+
+#if VECTOR_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_SSE 1
+#include <immintrin.h>
+#elif VECTOR_SIMD && defined(__aarch64__) && defined(__ARM_NEON)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#ifndef SIMD_SSE
+#define SIMD_SSE 0
+#endif
+#ifndef SIMD_NEON
+#define SIMD_NEON 0
+#endif
+
+#if SIMD_SSE && defined(__AVX__)
+#define SIMD_AVX 1
+#else
+#define SIMD_AVX 0
+#endif
+
+// comparisons give masks: lanes with all bits set where true, all zero where false.
+// &, andnot and select take such masks
+struct Float4 {
+#if SIMD_SSE
+	__m128 v;
+	Float4() {}
+	Float4(__m128 v) : v(v) {}
+	explicit Float4(float f) : v(_mm_set1_ps(f)) {}
+	Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+	static Float4 load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+#elif SIMD_NEON
+	float32x4_t v;
+	Float4() {}
+	Float4(float32x4_t v) : v(v) {}
+	explicit Float4(float f) : v(vdupq_n_f32(f)) {}
+	Float4(float a, float b, float c, float d) { float t[4] = { a, b, c, d }; v = vld1q_f32(t); }
+	static Float4 load(const float* p) { return vld1q_f32(p); }
+	void store(float* p) const { vst1q_f32(p, v); }
+#else
+	float v[4];
+	Float4() {}
+	explicit Float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+	Float4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+	static Float4 load(const float* p) { Float4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(float* p) const { memcpy(p, v, sizeof(v)); }
+#endif
+
+	float operator[](int i) const {
+		float t[4];
+		store(t);
+		return t[i];
+	}
+};
+
+#if SIMD_SSE
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+inline Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+inline Float4 andnot(Float4 mask, Float4 a) { return _mm_andnot_ps(mask.v, a.v); }
+inline Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline Float4 operator==(Float4 a, Float4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline Float4 operator!=(Float4 a, Float4 b) { return _mm_cmpneq_ps(a.v, b.v); }
+inline Float4 isOrdered(Float4 a) { return _mm_cmpord_ps(a.v, a.v); }
+inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+#if defined(__FMA__)
+inline Float4 fmadd(Float4 a, Float4 b, Float4 c) { return _mm_fmadd_ps(a.v, b.v, c.v); }
+#else
+inline Float4 fmadd(Float4 a, Float4 b, Float4 c) { return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+#endif
+// lane i of a in every lane
+template <int i> inline Float4 broadcast(Float4 a) { return _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(i, i, i, i)); }
+inline void transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) { _MM_TRANSPOSE4_PS(r0.v, r1.v, r2.v, r3.v); }
+
+#elif SIMD_NEON
+inline Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return vdivq_f32(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+inline Float4 operator|(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+inline Float4 andnot(Float4 mask, Float4 a) { return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(mask.v))); }
+inline Float4 operator<(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+inline Float4 operator>(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)); }
+inline Float4 operator==(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vceqq_f32(a.v, b.v)); }
+inline Float4 operator!=(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a.v, b.v))); }
+inline Float4 isOrdered(Float4 a) { return vreinterpretq_f32_u32(vceqq_f32(a.v, a.v)); }
+inline Float4 min(Float4 a, Float4 b) { return vminq_f32(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return vmaxq_f32(a.v, b.v); }
+inline Float4 sqrt(Float4 a) { return vsqrtq_f32(a.v); }
+inline Float4 fmadd(Float4 a, Float4 b, Float4 c) { return vfmaq_f32(c.v, a.v, b.v); }
+template <int i> inline Float4 broadcast(Float4 a) { return vdupq_laneq_f32(a.v, i); }
+inline void transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+	float32x4x2_t t01 = vtrnq_f32(r0.v, r1.v), t23 = vtrnq_f32(r2.v, r3.v);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+namespace simd_scalar {
+	inline uint32_t bits(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+	inline float fromBits(uint32_t u) { float f; memcpy(&f, &u, 4); return f; }
+	inline float mask(bool b) { return fromBits(b ? 0xffffffffu : 0u); }
+
+	template <typename F>
+	inline Float4 map(Float4 a, Float4 b, F f) { return Float4(f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3])); }
+}
+inline Float4 operator+(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x + y; }); }
+inline Float4 operator-(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x - y; }); }
+inline Float4 operator*(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x * y; }); }
+inline Float4 operator/(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x / y; }); }
+inline Float4 operator&(Float4 a, Float4 b) {
+	using namespace simd_scalar;
+	return map(a, b, [](float x, float y) { return fromBits(bits(x) & bits(y)); });
+}
+inline Float4 operator|(Float4 a, Float4 b) {
+	using namespace simd_scalar;
+	return map(a, b, [](float x, float y) { return fromBits(bits(x) | bits(y)); });
+}
+inline Float4 andnot(Float4 mask, Float4 a) {
+	using namespace simd_scalar;
+	return map(mask, a, [](float m, float x) { return fromBits(~bits(m) & bits(x)); });
+}
+inline Float4 operator<(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return simd_scalar::mask(x < y); }); }
+inline Float4 operator>(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return simd_scalar::mask(x > y); }); }
+inline Float4 operator==(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return simd_scalar::mask(x == y); }); }
+inline Float4 operator!=(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return simd_scalar::mask(x != y); }); }
+inline Float4 isOrdered(Float4 a) { return simd_scalar::map(a, a, [](float x, float) { return simd_scalar::mask(x == x); }); }
+// same NaN handling as minps / maxps: the second operand unless the comparison holds
+inline Float4 min(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+inline Float4 max(Float4 a, Float4 b) { return simd_scalar::map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+inline Float4 sqrt(Float4 a) { return Float4(sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3])); }
+inline Float4 fmadd(Float4 a, Float4 b, Float4 c) { return a * b + c; }
+template <int i> inline Float4 broadcast(Float4 a) { return Float4(a.v[i]); }
+inline void transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+	Float4 c0(r0.v[0], r1.v[0], r2.v[0], r3.v[0]), c1(r0.v[1], r1.v[1], r2.v[1], r3.v[1]);
+	Float4 c2(r0.v[2], r1.v[2], r2.v[2], r3.v[2]), c3(r0.v[3], r1.v[3], r2.v[3], r3.v[3]);
+	r0 = c0; r1 = c1; r2 = c2; r3 = c3;
+}
+#endif
+
+// mask ? a : b per lane
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return (mask & a) | andnot(mask, b); }
+inline Float4 abs(Float4 a) { return andnot(Float4(-0.f), a); }
+
+
+struct Float8 {
+#if SIMD_AVX
+	__m256 v;
+	Float8() {}
+	Float8(__m256 v) : v(v) {}
+	explicit Float8(float f) : v(_mm256_set1_ps(f)) {}
+	static Float8 load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+#else
+	Float4 lo, hi;
+	Float8() {}
+	Float8(Float4 lo, Float4 hi) : lo(lo), hi(hi) {}
+	explicit Float8(float f) : lo(f), hi(f) {}
+	static Float8 load(const float* p) { return Float8(Float4::load(p), Float4::load(p + 4)); }
+	void store(float* p) const { lo.store(p); hi.store(p + 4); }
+#endif
+
+	float operator[](int i) const {
+		float t[8];
+		store(t);
+		return t[i];
+	}
+};
+
+#if SIMD_AVX
+inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.v, b.v); }
+inline Float8 operator&(Float8 a, Float8 b) { return _mm256_and_ps(a.v, b.v); }
+inline Float8 operator|(Float8 a, Float8 b) { return _mm256_or_ps(a.v, b.v); }
+inline Float8 andnot(Float8 mask, Float8 a) { return _mm256_andnot_ps(mask.v, a.v); }
+inline Float8 operator<(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline Float8 operator>(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Float8 operator==(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline Float8 operator!=(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_OQ); }
+inline Float8 isOrdered(Float8 a) { return _mm256_cmp_ps(a.v, a.v, _CMP_ORD_Q); }
+inline Float8 min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+inline Float8 max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+inline Float8 sqrt(Float8 a) { return _mm256_sqrt_ps(a.v); }
+inline Float8 select(Float8 mask, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+#if defined(__FMA__)
+inline Float8 fmadd(Float8 a, Float8 b, Float8 c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+#else
+inline Float8 fmadd(Float8 a, Float8 b, Float8 c) { return _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v); }
+#endif
+#else
+inline Float8 operator+(Float8 a, Float8 b) { return Float8(a.lo + b.lo, a.hi + b.hi); }
+inline Float8 operator-(Float8 a, Float8 b) { return Float8(a.lo - b.lo, a.hi - b.hi); }
+inline Float8 operator*(Float8 a, Float8 b) { return Float8(a.lo * b.lo, a.hi * b.hi); }
+inline Float8 operator/(Float8 a, Float8 b) { return Float8(a.lo / b.lo, a.hi / b.hi); }
+inline Float8 operator&(Float8 a, Float8 b) { return Float8(a.lo & b.lo, a.hi & b.hi); }
+inline Float8 operator|(Float8 a, Float8 b) { return Float8(a.lo | b.lo, a.hi | b.hi); }
+inline Float8 andnot(Float8 mask, Float8 a) { return Float8(andnot(mask.lo, a.lo), andnot(mask.hi, a.hi)); }
+inline Float8 operator<(Float8 a, Float8 b) { return Float8(a.lo < b.lo, a.hi < b.hi); }
+inline Float8 operator>(Float8 a, Float8 b) { return Float8(a.lo > b.lo, a.hi > b.hi); }
+inline Float8 operator==(Float8 a, Float8 b) { return Float8(a.lo == b.lo, a.hi == b.hi); }
+inline Float8 operator!=(Float8 a, Float8 b) { return Float8(a.lo != b.lo, a.hi != b.hi); }
+inline Float8 isOrdered(Float8 a) { return Float8(isOrdered(a.lo), isOrdered(a.hi)); }
+inline Float8 min(Float8 a, Float8 b) { return Float8(min(a.lo, b.lo), min(a.hi, b.hi)); }
+inline Float8 max(Float8 a, Float8 b) { return Float8(max(a.lo, b.lo), max(a.hi, b.hi)); }
+inline Float8 sqrt(Float8 a) { return Float8(sqrt(a.lo), sqrt(a.hi)); }
+inline Float8 select(Float8 mask, Float8 a, Float8 b) { return Float8(select(mask.lo, a.lo, b.lo), select(mask.hi, a.hi, b.hi)); }
+inline Float8 fmadd(Float8 a, Float8 b, Float8 c) { return Float8(fmadd(a.lo, b.lo, c.lo), fmadd(a.hi, b.hi, c.hi)); }
+#endif
+
+inline Float8 abs(Float8 a) { return andnot(Float8(-0.f), a); }
+
+inline const char* simdBackend() {
+	return SIMD_AVX ? "AVX" : SIMD_SSE ? "SSE" : SIMD_NEON ? "NEON" : "scalar";
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include "RNG.hpp"
+
+// where the random numbers of a sample come from.
+// a sample is a point in a high dimensional cube: dimensions 0, 1 place the camera ray inside the pixel,
+// then every bounce owns a light slot and a BSDF slot of SAMPLER_SLOT_DIMS dimensions each.
+// the integrators jump to the slot before they draw, so the n-th bounce's light sample uses
+// the same dimensions in every sample of the pixel, no matter how many numbers earlier bounces drew.
+// getRandomFloat() hands out the next dimension of the current sample.
+#define SAMPLER_PIXEL_DIMS 2		// position inside the pixel
+#define SAMPLER_SLOT_DIMS 4			// light: pick light, pick triangle, u, v   BSDF: lobe, u, v, russian roulette
+#define SAMPLER_STREAM_BOUNCES 64	// bounces of the eye stream, the light stream (BDPT) comes after them
+#define HALTON_DIMS 32				// one prime base per dimension, padded with independent numbers after that
+
+enum SamplerType {
+	SAMPLER_INDEPENDENT,	// uniform random numbers, PCG32
+	SAMPLER_STRATIFIED,		// every dimension split into SPP strata, strata shuffled per dimension and pixel
+	SAMPLER_HALTON,			// Halton sequence, digits Owen-scrambled per pixel
+	SAMPLER_SOBOL			// Sobol sequence, Owen-scrambled per pixel
+};
+
+enum SampleSlot { SLOT_LIGHT, SLOT_BSDF };		// what a bounce draws its numbers for
+enum SampleStream { STREAM_EYE, STREAM_LIGHT };	// eye subpath / light subpath of BDPT
+
+SamplerType SAMPLER_TYPE = SAMPLER_INDEPENDENT;	// "sampler" in config
+bool PIXEL_JITTER = false;		// "pixeljitter on" in config: every sample shoots through its own spot of the pixel
+
+SamplerType parseSamplerType(const std::string& s) {
+	if (s == "independent") return SAMPLER_INDEPENDENT;
+	if (s == "stratified") return SAMPLER_STRATIFIED;
+	if (s == "halton") return SAMPLER_HALTON;
+	if (s == "sobol") return SAMPLER_SOBOL;
+	throw std::runtime_error("unknown sampler " + s + ", expect independent, stratified, halton or sobol\n");
+}
+
+const char* samplerName(SamplerType t) {
+	return t == SAMPLER_STRATIFIED ? "stratified" : t == SAMPLER_HALTON ? "halton" : t == SAMPLER_SOBOL ? "sobol" : "independent";
+}
+
+// 32 bits to [0, 1), never rounds up to 1
+inline float bitsToFloat(uint32_t v) {
+	return (v >> 8) * 0x1p-24f;
+}
+
+inline uint32_t hashCombine(uint32_t a, uint32_t b) {
+	return (uint32_t)mixBits(((uint64_t)a << 32) | b);
+}
+
+inline uint32_t reverseBits(uint32_t v) {
+	v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+	v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+	v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+	v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+
+// one sample of one pixel at a time, every thread has its own
+class Sampler {
+public:
+	virtual ~Sampler() {}
+
+	// start sample `index` of the nSamples of pixel `pixel`, the next draw is dimension 0
+	void startSample(uint32_t pixel, uint32_t index, uint32_t nSamples, uint32_t seed) {
+		this->pixel = pixel;
+		this->index = index;
+		this->nSamples = std::max(nSamples, 1u);
+		pixelSeed = hashCombine(seed, pixel);
+		setDimension(0);
+	}
+
+	// continue at dimension dim
+	void setDimension(uint32_t dim) {
+		dimension = dim;
+		// the numbers past maxDimension(): pixel picks the stream, sample and dimension the start
+		rng.seed(mixBits(((uint64_t)index << 32) | dim) ^ pixelSeed, pixel);
+	}
+
+	// continue at the light or BSDF slot of bounce `depth`
+	void startBounce(int depth, SampleSlot slot, SampleStream stream) {
+		uint32_t bounce = stream * SAMPLER_STREAM_BOUNCES + std::min(depth, SAMPLER_STREAM_BOUNCES - 1);
+		setDimension(SAMPLER_PIXEL_DIMS + (bounce * 2 + slot) * SAMPLER_SLOT_DIMS);
+	}
+
+	float get1D() {
+		uint32_t d = dimension++;
+		if (d < maxDimension()) return sample(d);
+		return rng.nextFloat();
+	}
+
+protected:
+	uint32_t pixel = 0, index = 0, nSamples = 1, pixelSeed = 0;
+
+	// dimension dim of the current sample, dim < maxDimension()
+	virtual float sample(uint32_t dim) = 0;
+	// dimensions the sampler covers, the rest are independent numbers
+	virtual uint32_t maxDimension() const = 0;
+
+private:
+	uint32_t dimension = 0;
+	PCG32 rng;
+};
+
+
+class IndependentSampler : public Sampler {
+protected:
+	float sample(uint32_t) override { return 0; }
+	uint32_t maxDimension() const override { return 0; }
+};
+
+
+// padded 1D strata: in every dimension the SPP samples of a pixel fall into different strata,
+// each dimension shuffles the strata on its own (Kensler, Correlated Multi-Jittered Sampling)
+class StratifiedSampler : public Sampler {
+protected:
+	float sample(uint32_t dim) override {
+		// samples past nSamples (adaptive sampling) start another round of strata
+		uint32_t round = index / nSamples;
+		uint32_t p = hashCombine(pixelSeed, dim * 0x9e3779b9u + round);
+		uint32_t stratum = permute(index % nSamples, nSamples, p);
+		float jitter = randFloat(index, p ^ 0xa511e9b3u);
+		return std::min((stratum + jitter) / nSamples, 0x1.fffffep-1f);
+	}
+	uint32_t maxDimension() const override { return UINT32_MAX; }
+
+public:
+	// element i of a random permutation of [0, l), p selects the permutation
+	static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+		uint32_t w = l - 1;
+		w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+		do {
+			i ^= p; i *= 0xe170893d; i ^= p >> 16; i ^= (i & w) >> 4;
+			i ^= p >> 8; i *= 0x0929eb3f; i ^= p >> 23; i ^= (i & w) >> 1;
+			i *= 1 | p >> 27; i *= 0x6935fa69; i ^= (i & w) >> 11; i *= 0x74dcb303;
+			i ^= (i & w) >> 2; i *= 0x9e501cc3; i ^= (i & w) >> 2; i *= 0xc860a3df;
+			i &= w; i ^= i >> 5;
+		} while (i >= l);
+		return (i + p) % l;
+	}
+
+private:
+	static float randFloat(uint32_t i, uint32_t p) {
+		i ^= p; i ^= i >> 17; i ^= i >> 10; i *= 0xb36534e5;
+		i ^= i >> 12; i ^= i >> 21; i *= 0x93fc4795; i ^= 0xdf6e307f;
+		i ^= i >> 17; i *= 1 | p >> 18;
+		return bitsToFloat(i);
+	}
+};
+
+
+// Halton: dimension d is the radical inverse of the sample index in the d-th prime base.
+// every pixel permutes the digits with its own random permutations (Owen scrambling), which also
+// breaks up the correlation between neighboring high bases
+class HaltonSampler : public Sampler {
+protected:
+	float sample(uint32_t dim) override {
+		static const uint32_t primes[HALTON_DIMS] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+			59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131 };
+		return scrambledRadicalInverse(primes[dim], index, hashCombine(pixelSeed, dim));
+	}
+	uint32_t maxDimension() const override { return HALTON_DIMS; }
+
+private:
+	// digits of i in base `base` mirrored around the decimal point, every digit permuted
+	// depending on the digits before it. runs to float precision since zero digits get permuted too
+	static float scrambledRadicalInverse(uint32_t base, uint32_t i, uint32_t seed) {
+		float invBase = 1.f / base, invBi = 1.f;
+		uint64_t reversed = 0;
+		while (1 - invBi < 1) {
+			uint32_t next = i / base;
+			uint32_t digit = i - next * base;
+			digit = StratifiedSampler::permute(digit, base, (uint32_t)mixBits(seed ^ reversed));
+			reversed = reversed * base + digit;
+			invBi *= invBase;
+			i = next;
+		}
+		return std::min(reversed * invBi, 0x1.fffffep-1f);
+	}
+};
+
+
+// direction numbers of the first 4 Sobol dimensions (Joe & Kuo), v[d][bit]
+struct SobolMatrices {
+	uint32_t v[4][32];
+
+	SobolMatrices() {
+		// dimension 0 is van der Corput, 1-3 from the polynomials s, a and initial m of new-joe-kuo-6.21201
+		const uint32_t s[3] = { 1, 2, 3 }, a[3] = { 0, 1, 1 };
+		const uint32_t m[3][3] = { { 1 }, { 1, 3 }, { 1, 3, 1 } };
+		for (int k = 0; k < 32; k++) v[0][k] = 1u << (31 - k);
+		for (int d = 1; d < 4; d++) {
+			const uint32_t sd = s[d - 1], ad = a[d - 1];
+			for (uint32_t k = 0; k < 32; k++) {
+				if (k < sd) v[d][k] = m[d - 1][k] << (31 - k);
+				else {
+					v[d][k] = v[d][k - sd] ^ (v[d][k - sd] >> sd);
+					for (uint32_t j = 1; j < sd; j++)
+						if ((ad >> (sd - 1 - j)) & 1) v[d][k] ^= v[d][k - j];
+				}
+			}
+		}
+	}
+};
+const SobolMatrices sobolMatrices;
+
+// Owen-scrambled Sobol, hash based (Burley, Practical Hash-based Owen Scrambling):
+// dimensions go in blocks of 4, each block shuffles the sample order and scrambles the points with its own seed,
+// so any number of dimensions is covered by the first 4 Sobol dimensions
+class SobolSampler : public Sampler {
+protected:
+	float sample(uint32_t dim) override {
+		uint32_t seed = hashCombine(pixelSeed, dim >> 2);
+		uint32_t i = nestedUniformScramble(index, seed);
+		uint32_t x = 0;
+		const uint32_t* v = sobolMatrices.v[dim & 3];
+		for (int bit = 0; i; bit++, i >>= 1)
+			if (i & 1) x ^= v[bit];
+		return bitsToFloat(nestedUniformScramble(x, hashCombine(seed, dim & 3)));
+	}
+	uint32_t maxDimension() const override { return UINT32_MAX; }
+
+private:
+	static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed) {
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+		return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+	}
+};
+
+
+// the sampler of the calling thread for type t, no heap allocation
+inline Sampler* threadSamplerOf(SamplerType t) {
+	thread_local IndependentSampler independent;
+	thread_local StratifiedSampler stratified;
+	thread_local HaltonSampler halton;
+	thread_local SobolSampler sobol;
+	switch (t) {
+	case SAMPLER_STRATIFIED: return &stratified;
+	case SAMPLER_HALTON: return &halton;
+	case SAMPLER_SOBOL: return &sobol;
+	default: return &independent;
+	}
+}
@@ -1,41 +1,58 @@
 #pragma once
 
 #include <vector>
-#include <memory>	// smart pointer
+#include <iostream>
 
 #include "Vector.hpp"
 #include "Object.hpp"
 #include "BVH.hpp"
+#include "QBVH.hpp"
+#include "MemoryArena.hpp"
 
 
 class Scene {
 public:
-	// use pointer array instead of "object" array for 
-	// unique_ptr<T>'s declared move constructor
-	// move instead of copy for efficiency
-	std::vector<std::unique_ptr<Object>> objList;
+	// owns the objects, the BVH arrays and the accelerators of the scene
+	// declared first so it is destroyed last, everything is freed with it in one go
+	MemoryArena arena;
+
+	// objects are created in the arena (arena.create<Sphere>() ...) and then added here
+	std::vector<Object*> objList;
 	
-	BVHAccel* BVHaccelerator;
+	BVHAccel* BVHaccelerator = nullptr;
+	BVHSplitMethod bvhSplitMethod = BVH_SAH;	// set by the "bvh" keyword in config
+	int bvhMaxLeafSize = 4;						// set by the "bvhleaf" keyword in config
+	QBVHAccel* QBVHaccelerator = nullptr;		// collapsed from BVHaccelerator
+	AccelType accelType = ACCEL_BVH;			// set by the "accel" keyword in config
 
 	// add object into object list
-	void add(std::unique_ptr<Object> obj) {
-		objList.emplace_back(std::move(obj));
+	void add(Object* obj) {
+		objList.emplace_back(obj);
 	}
 
 
 
 	// initalize bounding box
 	void initializeBVH() {
-		std::vector<Object*> objl;
-		for (auto &i : objList) {
-			objl.emplace_back(i.get());
-		}
+		setBVH(arena.create<BVHAccel>(objList, arena, bvhSplitMethod, bvhMaxLeafSize));
+	}
 
-		BVHaccelerator = new BVHAccel(objl);
+	// take a built (or cached) BVH from the arena, collapse it to the wide tree if that is the selected one
+	void setBVH(BVHAccel* bvh) {
+		BVHaccelerator = bvh;
+		if (accelType == ACCEL_QBVH)
+			QBVHaccelerator = arena.create<QBVHAccel>(*BVHaccelerator, arena);
 	}
 
-	~Scene() {
-		delete BVHaccelerator;
+	// memory footprint of the loaded scene
+	void reportMemory() const {
+		size_t heapBytes = 0;
+		for (const Object* obj : objList) heapBytes += obj->memoryUsage();
+		std::cout << "\nscene memory: " << objList.size() << " objects, arena " << (arena.bytesUsed() >> 10) << " KB used / "
+			<< (arena.bytesReserved() >> 10) << " KB reserved in " << arena.blockCount() << " blocks\n";
+		std::cout << "  BVH " << (BVHaccelerator ? BVHaccelerator->memoryUsage() >> 10 : 0) << " KB, QBVH "
+			<< (QBVHaccelerator ? QBVHaccelerator->memoryUsage() >> 10 : 0) << " KB (in the arena), mesh arrays "
+			<< (heapBytes >> 10) << " KB (heap)\n";
 	}
 
 };
\ No newline at end of file
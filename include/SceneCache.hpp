@@ -0,0 +1,446 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "global.hpp"
+#include "Vector.hpp"
+#include "Material.hpp"
+#include "Object.hpp"
+#include "Triangle.hpp"
+#include "TriangleMesh.hpp"
+#include "Sphere.hpp"
+#include "Scene.hpp"
+#include "BVH.hpp"
+
+// binary cache of the loaded meshes, their materials and the flattened BVH
+// a hit skips OBJ parsing and the BVH build, the file is mapped and the arrays are copied out of it
+
+#define SCENE_CACHE_VERSION 2
+#define SCENE_CACHE_ALIGN 32		// every section starts 32 byte aligned, LinearBVHNode needs it
+
+// one OBJ file queued by PPMGenerator::addObjFile, loaded into one TriangleMesh
+struct ObjFileEntry {
+	std::string path;
+	Material mtl;
+	int textureIndex = -1;
+	int normalMapIndex = -1;
+	int roughnessMapIndex = -1;
+	int metallicMapIndex = -1;
+	int nTriangles = 0;		// filled after the file is loaded
+};
+
+// ---- file layout: header, meshes, positions, normals, uvs, indices, BVH nodes, leaf order ----
+// the vertex arrays of all meshes are stored back to back, mesh after mesh
+struct SceneCacheHeader {
+	char magic[8];			// "PTSCACHE"
+	uint32_t version;
+	uint32_t nMeshes;
+	uint64_t key;
+	uint32_t nTriangles;
+	uint32_t nVertices;
+	uint32_t nObjects;		// objects in the BVH, the ones defined in the config included
+	uint32_t nPrims;		// primitives in the BVH, one per triangle of a mesh
+	uint32_t nNodes;
+	uint32_t pad;
+};
+
+// material and textures of one OBJ file
+struct CachedMesh {
+	float diffuse[3], specular[3], emission[3];
+	int32_t mType;
+	float alpha, eta, roughness, metallic;
+	int32_t textureIndex, normalMapIndex, roughnessMapIndex, metallicMapIndex;
+	uint32_t nVertices;
+	uint32_t nTriangles;	// 0: the file had no triangles, no mesh in the scene
+};
+
+// read only view of a whole file, mmap / MapViewOfFile
+class MappedFile {
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) { close(); return false; }
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping) { close(); return false; }
+		ptr = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!ptr) { close(); return false; }
+		len = size.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);		// the mapping stays valid
+		if (p == MAP_FAILED) return false;
+		ptr = (const unsigned char*)p;
+		len = st.st_size;
+#endif
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (ptr) UnmapViewOfFile(ptr);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (ptr) munmap((void*)ptr, len);
+#endif
+		ptr = nullptr;
+		len = 0;
+	}
+
+	const unsigned char* data() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	const unsigned char* ptr = nullptr;
+	size_t len = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+// 64 bit FNV-1a
+struct SceneHasher {
+	uint64_t h = 14695981039346656037ull;
+
+	void add(const void* data, size_t n) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < n; i++) {
+			h ^= p[i];
+			h *= 1099511628211ull;
+		}
+	}
+	void add(int v) { add(&v, sizeof(v)); }
+	void add(float v) { add(&v, sizeof(v)); }
+	void add(const Vector3f& v) { add(v.x); add(v.y); add(v.z); }
+	void add(const Vector2f& v) { add(v.x); add(v.y); }
+	void add(const std::string& s) { add((int)s.size()); add(s.data(), s.size()); }
+
+	// field by field, the padding of Material is never hashed
+	void add(const Material& m) {
+		add(m.diffuse); add(m.specular); add(m.emission); add((int)m.mType);
+		add(m.alpha); add(m.eta); add(m.roughness); add(m.metallic);
+	}
+};
+
+
+class SceneCache {
+public:
+	SceneCache(const std::string& cacheDir) : dir(cacheDir) {}
+
+	// key of the scene: every OBJ file's bytes with its material and textures,
+	// the objects already in the scene (spheres and triangles from the config) and the BVH settings.
+	// camera and integrator settings don't change the geometry, so they are left out
+	uint64_t computeKey(const Scene& scene, const std::vector<ObjFileEntry>& files) const {
+		SceneHasher hs;
+		hs.add(SCENE_CACHE_VERSION);
+		hs.add((int)sizeof(SceneCacheHeader)); hs.add((int)sizeof(CachedMesh));
+		hs.add((int)sizeof(BVHPrimRef)); hs.add((int)sizeof(LinearBVHNode));
+		hs.add((int)scene.bvhSplitMethod);
+		hs.add(scene.bvhMaxLeafSize);
+
+		hs.add((int)scene.objList.size());
+		for (Object* obj : scene.objList) {
+			hs.add((int)obj->objectType);
+			hs.add(obj->mtlcolor);
+			hs.add((int)obj->isTextureActivated);
+			hs.add(obj->textureIndex); hs.add(obj->normalMapIndex);
+			hs.add(obj->roughnessMapIndex); hs.add(obj->metallicMapIndex);
+			if (Triangle* t = dynamic_cast<Triangle*>(obj)) {
+				hs.add(t->v0); hs.add(t->v1); hs.add(t->v2);
+				hs.add(t->n0); hs.add(t->n1); hs.add(t->n2);
+				hs.add(t->uv0); hs.add(t->uv1); hs.add(t->uv2);
+			}
+			else if (Sphere* s = dynamic_cast<Sphere*>(obj)) {
+				hs.add(s->centerPos); hs.add(s->radius);
+			}
+			else if (TriangleMesh* m = dynamic_cast<TriangleMesh*>(obj)) {
+				hs.add(m->positions.data(), m->positions.size() * sizeof(Vector3f));
+				hs.add(m->normals.data(), m->normals.size() * sizeof(Vector3f));
+				hs.add(m->uvs.data(), m->uvs.size() * sizeof(Vector2f));
+				hs.add(m->indices.data(), m->indices.size() * sizeof(uint32_t));
+			}
+		}
+
+		hs.add((int)files.size());
+		for (const ObjFileEntry& f : files) {
+			hs.add(f.path);
+			hs.add(f.mtl);
+			hs.add(f.textureIndex); hs.add(f.normalMapIndex);
+			hs.add(f.roughnessMapIndex); hs.add(f.metallicMapIndex);
+
+			std::ifstream in(f.path, std::ios::binary);
+			if (!in.is_open()) {
+				hs.add(-1);		// a missing file is part of the key too
+				continue;
+			}
+			std::stringstream buffer;
+			buffer << in.rdbuf();
+			hs.add(buffer.str());
+		}
+		return hs.h;
+	}
+
+	std::string pathOf(uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+		return dir + "/" + name;
+	}
+
+	// append the cached meshes to scene.objList and set up its BVH from the cached tree
+	// returns false (scene untouched) if there is no valid cache for this key
+	bool load(uint64_t key, Scene& scene, std::vector<ObjFileEntry>& files) const {
+		auto start = std::chrono::steady_clock::now();
+		MappedFile mf;
+		if (!mf.open(pathOf(key))) return false;
+		if (mf.size() < sizeof(SceneCacheHeader)) return false;
+
+		const SceneCacheHeader& header = *(const SceneCacheHeader*)mf.data();
+		if (memcmp(header.magic, "PTSCACHE", 8) != 0 || header.version != SCENE_CACHE_VERSION || header.key != key
+			|| header.nMeshes != files.size()) {
+			std::cout << "scene cache " << pathOf(key) << " doesn't match the scene, ignored\n";
+			return false;
+		}
+		size_t offsets[8];
+		if (layout(header, offsets) != mf.size()) {
+			std::cout << "scene cache " << pathOf(key) << " is truncated, ignored\n";
+			return false;
+		}
+		const CachedMesh* meshes = (const CachedMesh*)(mf.data() + offsets[0]);
+		const Vector3f* positions = (const Vector3f*)(mf.data() + offsets[1]);
+		const Vector3f* normals = (const Vector3f*)(mf.data() + offsets[2]);
+		const Vector2f* uvs = (const Vector2f*)(mf.data() + offsets[3]);
+		const uint32_t* indices = (const uint32_t*)(mf.data() + offsets[4]);
+		const LinearBVHNode* nodes = (const LinearBVHNode*)(mf.data() + offsets[5]);
+		const BVHPrimRef* order = (const BVHPrimRef*)(mf.data() + offsets[6]);
+
+		// primitive count of every object the BVH will see, the config ones first
+		std::vector<int> primCount;
+		for (Object* obj : scene.objList) primCount.push_back(obj->primitiveCount());
+		uint32_t nTris = 0, nVerts = 0;
+		for (uint32_t m = 0; m < header.nMeshes; m++) {
+			const CachedMesh& cm = meshes[m];
+			for (uint32_t i = 0; i < 3 * cm.nTriangles; i++) {
+				if (indices[3 * nTris + i] >= cm.nVertices) return false;
+			}
+			nTris += cm.nTriangles;
+			nVerts += cm.nVertices;
+			if (cm.nTriangles > 0) primCount.push_back(cm.nTriangles);
+		}
+		size_t nPrims = 0;
+		for (int c : primCount) nPrims += c;
+		if (nTris != header.nTriangles || nVerts != header.nVertices || header.nObjects != primCount.size()
+			|| header.nPrims != nPrims) {
+			std::cout << "scene cache " << pathOf(key) << " doesn't match the scene, ignored\n";
+			return false;
+		}
+		for (uint32_t i = 0; i < header.nPrims; i++) {
+			if (order[i].obj < 0 || order[i].obj >= (int32_t)header.nObjects
+				|| order[i].prim < 0 || order[i].prim >= primCount[order[i].obj]) return false;
+		}
+
+		for (uint32_t m = 0; m < header.nMeshes; m++) {
+			const CachedMesh& cm = meshes[m];
+			files[m].nTriangles = cm.nTriangles;
+			if (cm.nTriangles == 0) continue;
+
+			TriangleMesh* mesh = scene.arena.create<TriangleMesh>();
+			mesh->positions.assign(positions, positions + cm.nVertices);
+			mesh->normals.assign(normals, normals + cm.nVertices);
+			mesh->uvs.assign(uvs, uvs + cm.nVertices);
+			mesh->indices.assign(indices, indices + 3 * cm.nTriangles);
+			positions += cm.nVertices;
+			normals += cm.nVertices;
+			uvs += cm.nVertices;
+			indices += 3 * cm.nTriangles;
+
+			Material& mtl = mesh->mtlcolor;
+			mtl.diffuse = Vector3f(cm.diffuse[0], cm.diffuse[1], cm.diffuse[2]);
+			mtl.specular = Vector3f(cm.specular[0], cm.specular[1], cm.specular[2]);
+			mtl.emission = Vector3f(cm.emission[0], cm.emission[1], cm.emission[2]);
+			mtl.mType = (MaterialType)cm.mType;
+			mtl.alpha = cm.alpha; mtl.eta = cm.eta;
+			mtl.roughness = cm.roughness; mtl.metallic = cm.metallic;
+			mesh->textureIndex = cm.textureIndex;
+			mesh->normalMapIndex = cm.normalMapIndex;
+			mesh->roughnessMapIndex = cm.roughnessMapIndex;
+			mesh->metallicMapIndex = cm.metallicMapIndex;
+			mesh->isTextureActivated = cm.textureIndex != -1 || cm.normalMapIndex != -1
+				|| cm.roughnessMapIndex != -1 || cm.metallicMapIndex != -1;
+			mesh->initializeBound();
+			scene.add(mesh);
+		}
+
+		scene.setBVH(scene.arena.create<BVHAccel>(scene.objList, scene.arena, nodes, header.nNodes, order, header.nPrims,
+			scene.bvhSplitMethod, scene.bvhMaxLeafSize));
+
+		auto end = std::chrono::steady_clock::now();
+		std::cout << "scene cache hit " << pathOf(key) << ": " << header.nTriangles << " triangles, "
+			<< header.nVertices << " vertices, " << header.nNodes << " BVH nodes loaded in "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+		return true;
+	}
+
+	// write the meshes loaded from files (the last ones in scene.objList) and the BVH of the scene
+	// written to a temporary file first, so a reader never sees half a cache
+	void save(uint64_t key, const Scene& scene, const std::vector<ObjFileEntry>& files) const {
+		if (!scene.BVHaccelerator) return;
+		makeDir(dir);
+
+		// files without triangles added no mesh
+		size_t nMeshObjects = 0;
+		for (const ObjFileEntry& f : files) nMeshObjects += f.nTriangles > 0;
+		if (nMeshObjects > scene.objList.size()) return;
+		size_t firstMesh = scene.objList.size() - nMeshObjects;
+
+		SceneCacheHeader header = {};
+		memcpy(header.magic, "PTSCACHE", 8);
+		header.version = SCENE_CACHE_VERSION;
+		header.key = key;
+		header.nMeshes = files.size();
+		header.nObjects = scene.objList.size();
+		header.nPrims = scene.BVHaccelerator->primitiveCount();
+		header.nNodes = scene.BVHaccelerator->getNodes().size();
+
+		std::vector<CachedMesh> meshes;
+		std::vector<const TriangleMesh*> meshObjs;
+		for (const ObjFileEntry& f : files) {
+			CachedMesh cm = {};
+			const Material& m = f.mtl;
+			float vals[9] = { m.diffuse.x, m.diffuse.y, m.diffuse.z, m.specular.x, m.specular.y, m.specular.z,
+				m.emission.x, m.emission.y, m.emission.z };
+			memcpy(cm.diffuse, vals, sizeof(cm.diffuse));
+			memcpy(cm.specular, vals + 3, sizeof(cm.specular));
+			memcpy(cm.emission, vals + 6, sizeof(cm.emission));
+			cm.mType = m.mType;
+			cm.alpha = m.alpha; cm.eta = m.eta;
+			cm.roughness = m.roughness; cm.metallic = m.metallic;
+			cm.textureIndex = f.textureIndex; cm.normalMapIndex = f.normalMapIndex;
+			cm.roughnessMapIndex = f.roughnessMapIndex; cm.metallicMapIndex = f.metallicMapIndex;
+			if (f.nTriangles > 0) {
+				const TriangleMesh* mesh = dynamic_cast<const TriangleMesh*>(scene.objList[firstMesh + meshObjs.size()]);
+				if (!mesh || mesh->triangleCount() != f.nTriangles) return;
+				meshObjs.push_back(mesh);
+				cm.nVertices = mesh->positions.size();
+				cm.nTriangles = f.nTriangles;
+			}
+			header.nTriangles += cm.nTriangles;
+			header.nVertices += cm.nVertices;
+			meshes.push_back(cm);
+		}
+		size_t offsets[8];
+		layout(header, offsets);
+
+		std::string path = pathOf(key);
+		std::string tmp = path + ".tmp";
+		{
+			std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				std::cout << "can't write the scene cache " << path << "\n";
+				return;
+			}
+			writeSection(out, &header, sizeof(header), offsets[0]);
+			writeSection(out, meshes.data(), meshes.size() * sizeof(CachedMesh), offsets[1]);
+			// one section per vertex attribute, every mesh appends its array
+			for (const TriangleMesh* m : meshObjs) out.write((const char*)m->positions.data(), m->positions.size() * sizeof(Vector3f));
+			writeSection(out, nullptr, 0, offsets[2]);
+			for (const TriangleMesh* m : meshObjs) out.write((const char*)m->normals.data(), m->normals.size() * sizeof(Vector3f));
+			writeSection(out, nullptr, 0, offsets[3]);
+			for (const TriangleMesh* m : meshObjs) out.write((const char*)m->uvs.data(), m->uvs.size() * sizeof(Vector2f));
+			writeSection(out, nullptr, 0, offsets[4]);
+			for (const TriangleMesh* m : meshObjs) out.write((const char*)m->indices.data(), m->indices.size() * sizeof(uint32_t));
+			writeSection(out, nullptr, 0, offsets[5]);
+			writeSection(out, scene.BVHaccelerator->getNodes().data(), header.nNodes * sizeof(LinearBVHNode), offsets[6]);
+			writeSection(out, scene.BVHaccelerator->getOrderedPrims().data(), header.nPrims * sizeof(BVHPrimRef), offsets[7]);
+			if (!out.good()) {
+				std::cout << "can't write the scene cache " << path << "\n";
+				out.close();
+				std::remove(tmp.c_str());
+				return;
+			}
+		}
+		std::remove(path.c_str());		// rename doesn't replace an existing file on windows
+		if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+			std::remove(tmp.c_str());
+			return;
+		}
+		std::cout << "scene cache written to " << path << "\n";
+	}
+
+private:
+	std::string dir;
+
+	static size_t alignUp(size_t n) {
+		return (n + SCENE_CACHE_ALIGN - 1) / SCENE_CACHE_ALIGN * SCENE_CACHE_ALIGN;
+	}
+
+	// start of the meshes, positions, normals, uvs, indices, nodes and order sections, returns the file size
+	static size_t layout(const SceneCacheHeader& h, size_t offsets[8]) {
+		offsets[0] = alignUp(sizeof(SceneCacheHeader));
+		offsets[1] = alignUp(offsets[0] + h.nMeshes * sizeof(CachedMesh));
+		offsets[2] = alignUp(offsets[1] + (size_t)h.nVertices * sizeof(Vector3f));
+		offsets[3] = alignUp(offsets[2] + (size_t)h.nVertices * sizeof(Vector3f));
+		offsets[4] = alignUp(offsets[3] + (size_t)h.nVertices * sizeof(Vector2f));
+		offsets[5] = alignUp(offsets[4] + (size_t)h.nTriangles * 3 * sizeof(uint32_t));
+		offsets[6] = alignUp(offsets[5] + (size_t)h.nNodes * sizeof(LinearBVHNode));
+		offsets[7] = offsets[6] + (size_t)h.nPrims * sizeof(BVHPrimRef);
+		return offsets[7];
+	}
+
+	// write n bytes and pad with zeros up to the next section
+	static void writeSection(std::ofstream& out, const void* data, size_t n, size_t next) {
+		out.write((const char*)data, n);
+		static const char zeros[SCENE_CACHE_ALIGN] = {};
+		size_t pos = (size_t)out.tellp();
+		if (next > pos) out.write(zeros, next - pos);
+	}
+
+	static void makeDir(const std::string& path) {
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "PPMGenerator.hpp"
+#include "Material.hpp"
+
+#include <string>
+
+// the scenes of the mains, shared with tutu_bench
+// modelDir is the model folder with a trailing slash, the mains run from src/ or a build folder next to it
+
+
+// Cornell box, lambertian walls and boxes, one area light in the ceiling
+void addCornellBox(PPMGenerator& g, const std::string& modelDir = "../model/") {
+	Material floorMtl;
+	floorMtl.mType = LAMBERTIAN;
+	floorMtl.diffuse = { 0.725f, 0.71f, 0.68f };
+
+	g.addObjFile(modelDir + "cornellBox/floor.obj", floorMtl, -1, -1);
+
+	Material lightMtl;
+	lightMtl.diffuse = { 0.725f, 0.71f, 0.68f };
+	lightMtl.emission = { 47.8348007,38.5663986, 31.0807991 };
+
+	g.addObjFile(modelDir + "cornellBox/light.obj", lightMtl, -1, -1);
+
+	Material green;
+	green.mType = LAMBERTIAN;
+	green.diffuse = { 0.14f, 0.45f, 0.091f };
+
+	g.addObjFile(modelDir + "cornellBox/right.obj", green, -1, -1);
+
+	Material red;
+	red.mType = LAMBERTIAN;
+	red.diffuse = { 0.63f, 0.065f, 0.05f };
+
+	g.addObjFile(modelDir + "cornellBox/left.obj", red, -1, -1);
+
+	Material white;
+	white.mType = LAMBERTIAN;
+	white.diffuse = { 0.725f, 0.71f, 0.68f };
+
+	g.addObjFile(modelDir + "cornellBox/tallbox.obj", white, -1, -1);
+
+	g.addObjFile(modelDir + "cornellBox/shortbox.obj", white, -1, -1);
+}
+
+
+// Veach's BDPT room: a lamp shining on the wall, a glass on the table, mostly lit indirectly
+// use EPSILON 0.0005f   in global
+void addVeachBdpt(PPMGenerator& g, const std::string& modelDir = "../model/") {
+	Material roomMtl;
+	roomMtl.mType = LAMBERTIAN;
+	roomMtl.diffuse = { 0.725f, 0.71f, 0.68f };
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_room.obj", roomMtl);
+
+	Material LlightMtl;
+	LlightMtl.diffuse = { 0.725f, 0.71f, 0.68f };
+	LlightMtl.emission = { 500.0 , 500.0 , 500.0 };
+	LlightMtl.emission = LlightMtl.emission * 0.5;
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_Llight.obj", LlightMtl);
+
+	Material sLlightMtl;
+	sLlightMtl.diffuse = { 0.725f, 0.71f, 0.68f };
+	sLlightMtl.emission = { 6999.999881f, 5450.000167f, 3630.000055f} ;
+	sLlightMtl.emission = sLlightMtl.emission * 0.5;
+
+	// the file is veach_sLight.obj, spelled with a lower case l it only loads on case insensitive file systems
+	g.addObjFile(modelDir + "veach_bdpt/veach_sLight.obj", sLlightMtl);
+
+	Material tableMtl;
+	tableMtl.mType = LAMBERTIAN;
+	tableMtl.diffuse = { 0.32962962985, 0.257976263762, 0.150291711092 };
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_table.obj", tableMtl);
+
+	Material glassMtl;
+	glassMtl.mType = PERFECT_REFRACTIVE;
+	glassMtl.eta = 1.5f;
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_glass.obj", glassMtl);
+
+	Material tallLampMtl;
+	tallLampMtl.mType = MICROFACET_R;
+	tallLampMtl.roughness = 0.2775146484375f;
+	tallLampMtl.metallic = 0.5f;
+	tallLampMtl.diffuse = { 0.32962962985, 0.257976263762, 0.150291711092 };
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_tallLamp.obj", tallLampMtl);
+
+
+	g.addObjFile(modelDir + "veach_bdpt/veach_wallLamp.obj", roomMtl);
+}
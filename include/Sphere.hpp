@@ -11,19 +11,21 @@ public:
 	Sphere() {
 		centerPos = Vector3f(0.f, 0.f, 0.f);
 		radius = 1.f;
+		objectType = OBJTYPE::SPEHRE;
 	}
 
 	Sphere(float x, float y, float z, float r) {
 		centerPos = Vector3f(x, y, z);
 		radius = r;
+		objectType = OBJTYPE::SPEHRE;
 	}
 
 
 	virtual ~Sphere() {};
 
 	// check if the ray will intersect with this sphere or not
-	// if true, then set the nearest time of intersection as tNear, and mtlColor
-	bool intersect(const Vector3f& orig, const Vector3f& dir, Intersection& inter) override {
+	// if true, then set the nearest time of intersection as t
+	bool intersectT(int prim, const Vector3f& orig, const Vector3f& dir, float tMax, float& t, float& b1, float& b2) override {
 		float A = 1.f;	// here is 1 since we are using normalized vector
 		float B = 2 * (dir.x * (orig.x - centerPos.x) + dir.y * (orig.y - centerPos.y)
 			+ dir.z * (orig.z - centerPos.z));
@@ -34,8 +36,6 @@ public:
 		float t2 = 0;
 		solveQuadratic(t1, t2, A, B, C);
 
-		inter.intersected = false;
-
 		// miss, no real solution
 		if (FLOAT_EQUAL(t1, FLT_MAX) && FLOAT_EQUAL(t2, FLT_MAX)) {
 			return false;
@@ -45,84 +45,69 @@ public:
 		else if (FLOAT_EQUAL(t1, t2)) {
 			// intersection is behind the ray direction, then false
 			if (t1 < 0 ) return false;
-			else {
-				inter.t = t1;
-				// update intersection data
-				inter.intersected = true;
-				inter.obj = this;
-				inter.mtlcolor = this->mtlcolor;
-				inter.pos = orig + inter.t * dir;
-				inter.Ng = normalized(inter.pos - centerPos);
-				inter.Ns = inter.Ng;
-				if (isTextureActivated)
-				{
-					// calculate the uv coordinate of this intersection
-					float u, v;
-					float phi = acos(inter.Ng.z);
-					v = phi / M_PI;
-
-					float theta = atan2(inter.Ng.y, inter.Ng.x);	// return [-pi, pi]
-					// we need to map it to [0, 1]
-					if (theta < 0) theta += 2 * M_PI;	// trigonometric functions are periodic
-					u = (theta / (2.f * M_PI));			// 0 + [0, 1]    then if theta == 0, it is the left most point in width
-
-					// or 
-					// u = 0.5 + (theta / (2.f * M_PI));  // 0.5 + [-0.5, 0.5]	  then if theta == 0, it is the middle point in width
-
-					inter.textPos = Vector2f(u, v);
-					inter.diffuseIndex = this->textureIndex;
-					inter.normalMapIndex = normalMapIndex;
-					inter.roughnessMapIndex = roughnessMapIndex;
-					inter.metallicMapIndex = metallicMapIndex;
-				}
-				return true;
-			}
-
+			t = t1;
 		}
 		// TWO solution
 		else {
 			if (t1 > 0 && t2 > 0) {
-				inter.t = t1;
+				t = t1;
 			}
 			else if (t1 > 0 && t2 < 0) {
-				inter.t = t1;
+				t = t1;
 			}
 			else if (t1 < 0 && t2 > 0) {
-				inter.t = t2;
+				t = t2;
 			}
 			else return false;
+		}
+		return t < tMax;
+	}
 
-			// update intersection data
-			inter.intersected = true;
-			inter.obj = this;
-			inter.mtlcolor = this->mtlcolor;
-			inter.pos = orig + inter.t * dir;
-			inter.Ng = normalized(inter.pos - centerPos);
-			inter.Ns = inter.Ng;
-			if (isTextureActivated)
-			{
-				// calculate the uv coordinate of this intersection
-				float u, v;
-				float phi = acos(inter.Ng.z);	// return [0, pi]
-				v = phi / M_PI;
-
-				float theta = atan2(inter.Ng.y, inter.Ng.x);	// return [-pi, pi]
-				// we need to map it to [0, 1]
-				if (theta < 0) theta += 2 * M_PI;	// trigonometric functions are periodic
-				u = (theta / (2.f * M_PI));			// 0 + [0, 1]    then if theta == 0, it is the left most point in width
-
-				// or 
-				// u = 0.5 + (theta / (2.f * M_PI));  // 0.5 + [-0.5, 0.5]	  then if theta == 0, it is the middle point in width
-
-				inter.textPos = Vector2f(u, v);
-				inter.diffuseIndex = this->textureIndex;
-				inter.normalMapIndex = normalMapIndex;
-				inter.roughnessMapIndex = roughnessMapIndex;
-				inter.metallicMapIndex = metallicMapIndex;
-			}
-			return true;
+	// either of the two hits may block a shadow ray, e.g. ray starting inside the sphere
+	bool occluded(int prim, const Vector3f& orig, const Vector3f& dir, float tMin, float tMax) override {
+		float A = 1.f;
+		Vector3f oc = orig - centerPos;
+		float B = 2 * dir.dot(oc);
+		float C = oc.dot(oc) - radius * radius;
+
+		float t1 = 0;
+		float t2 = 0;
+		solveQuadratic(t1, t2, A, B, C);
+		if (t1 == FLT_MAX) return false;
+		return (t1 > tMin && t1 < tMax) || (t2 > tMin && t2 < tMax);
+	}
+
+	void fillIntersection(int prim, const Vector3f& orig, const Vector3f& dir, float t, float b1, float b2, Intersection& inter) override {
+		// update intersection data
+		inter.t = t;
+		inter.intersected = true;
+		inter.obj = this;
+		inter.prim = 0;
+		inter.setMaterial(mtlcolor);
+		inter.pos = orig + inter.t * dir;
+		inter.Ng = normalized(inter.pos - centerPos);
+		inter.Ns = inter.Ng;
+		if (isTextureActivated)
+		{
+			// calculate the uv coordinate of this intersection
+			float u, v;
+			float phi = acos(inter.Ng.z);	// return [0, pi]
+			v = phi / M_PI;
+
+			float theta = atan2(inter.Ng.y, inter.Ng.x);	// return [-pi, pi]
+			// we need to map it to [0, 1]
+			if (theta < 0) theta += 2 * M_PI;	// trigonometric functions are periodic
+			u = (theta / (2.f * M_PI));			// 0 + [0, 1]    then if theta == 0, it is the left most point in width
+
+			// or 
+			// u = 0.5 + (theta / (2.f * M_PI));  // 0.5 + [-0.5, 0.5]	  then if theta == 0, it is the middle point in width
+
+			inter.textPos = Vector2f(u, v);
+			inter.diffuseIndex = this->textureIndex;
+			inter.normalMapIndex = normalMapIndex;
+			inter.roughnessMapIndex = roughnessMapIndex;
+			inter.metallicMapIndex = metallicMapIndex;
 		}
-		return false;
 	}
 
 
@@ -155,8 +140,9 @@ public:
 		inter.Ns = inter.Ng;
 
 		inter.intersected = true;
-		inter.mtlcolor = mtlcolor;
+		inter.setMaterial(mtlcolor);
 		inter.obj = this;
+		inter.prim = 0;
 
 		// I don't update the texture corrdinate here	7/2/2023
 
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+#include "global.hpp"
+#include "Vector.hpp"
+#include "Texture.hpp"
+
+std::mutex mutex_color;			// shared film writes when PER_THREAD_FILM is 0
+std::atomic<long long> colorLockWaits{ 0 };	// times a thread found mutex_color taken
+
+// lock m, counting the times it was contended
+void lockCounted(std::mutex& m) {
+	if (!m.try_lock()) {
+		colorLockWaits++;
+		m.lock();
+	}
+}
+
+void lockColor() {
+	lockCounted(mutex_color);
+}
+
+// film of light tracing and BDPT: the t = 1 camera connections (splats) can land in any pixel,
+// so threads rendering different tiles write the same pixels.
+// every thread adds its splats into its own film without locking, the films are summed
+// into the target in thread order when the render is done.
+// a film is as big as the image, so there are at most SPLAT_FILMS of them: with more threads,
+// thread i splats into film i % SPLAT_FILMS and locks it, the film's other threads write it too.
+// with PER_THREAD_FILM 0 every splat goes into one shared film behind mutex_color
+class SplatFilm {
+public:
+	SplatFilm(Texture& target, int nThreads) : target(target), films(std::max(1, std::min(nThreads, SPLAT_FILMS))),
+		filmLocks(new std::mutex[films.size()]), sharedFilms(nThreads > (int)films.size()) {
+		colorLockWaits = 0;
+	}
+
+	// contribution of a light path to the pixel it projects to
+	// the film of a thread is allocated on its first splat, threads that never splat cost nothing
+	void splat(int threadID, int index, const Vector3f& v) {
+		PROF_COUNT(PROF_SPLATS);
+		if (index < 0 || index >= target.width * target.height) return;
+#if PER_THREAD_FILM
+		int f = threadID % films.size();
+		std::vector<Vector3f>& film = films[f];
+		if (sharedFilms) lockCounted(filmLocks[f]);
+		if (film.empty()) film.assign(target.width * target.height, Vector3f(0.f));
+		film[index] += v;
+		if (sharedFilms) filmLocks[f].unlock();
+#else
+		lockColor();
+		std::vector<Vector3f>& film = films[0];
+		if (film.empty()) film.assign(target.width * target.height, Vector3f(0.f));
+		film[index] += v;
+		mutex_color.unlock();
+#endif
+	}
+
+	// estimate of the pixel a tile owns, no other thread writes it outside of splats
+	void addPixel(int index, const Vector3f& v) {
+#if PER_THREAD_FILM
+		target.addRGB(index, v);
+#else
+		lockColor();
+		target.addRGB(index, v);
+		mutex_color.unlock();
+#endif
+	}
+
+	// add every film into the target, film 0 first
+	// scale corrects the splats' 1 / SPP when the pixels took different numbers of samples (adaptive sampling)
+	void merge(float scale = 1.f) {
+		PROF_STAGE(STAGE_FILM);
+		int nFilms = 0;
+		for (std::vector<Vector3f>& film : films) {
+			if (film.empty()) continue;
+			nFilms++;
+			if (scale == 1.f)
+				for (int i = 0; i < film.size(); i++) target.rgb[i] += film[i];
+			else
+				for (int i = 0; i < film.size(); i++) target.rgb[i] += film[i] * scale;
+			film.clear();
+			film.shrink_to_fit();
+		}
+		std::cout << "splat films merged: " << nFilms << " (" << ((nFilms * target.rgb.size() * sizeof(Vector3f)) >> 10)
+			<< " KB), film lock waits: " << colorLockWaits << "\n";
+	}
+
+private:
+	Texture& target;
+	std::vector<std::vector<Vector3f>> films;	// one per thread, up to SPLAT_FILMS
+	std::unique_ptr<std::mutex[]> filmLocks;	// one per film, taken when threads share films
+	bool sharedFilms;
+};
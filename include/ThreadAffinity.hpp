@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#include "global.hpp"
+
+// where the render threads are allowed to run
+enum ThreadPinning {
+	PIN_NONE,		// let the OS schedule them
+	PIN_CORE,		// render thread i on the i-th cpu
+	PIN_NUMA		// render thread i on all cpus of numa node i % node count
+};
+
+ThreadPinning THREAD_PIN = PIN_NONE;	// set by "pin" in config or --pin on the command line
+
+ThreadPinning parsePinning(const std::string& s) {
+	if (s == "none") return PIN_NONE;
+	if (s == "core") return PIN_CORE;
+	if (s == "numa") return PIN_NUMA;
+	throw std::runtime_error("unknown thread pinning " + s + ", expect none, core or numa\n");
+}
+
+// command line settings after the config path, they override the config file:
+// --threads N    number of render threads
+// --pin none|core|numa
+void parseThreadArgs(int argc, char* argv[], int first = 2) {
+	for (int i = first; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			std::string n = argv[++i];
+			checkPosInt(n);
+			N_THREAD = std::stoi(n);
+			if (N_THREAD < 1)
+				throw std::runtime_error("--threads: expect a positive integer\n");
+		}
+		else if (arg == "--pin" && i + 1 < argc) {
+			THREAD_PIN = parsePinning(argv[++i]);
+		}
+		else throw std::runtime_error("unknown argument " + arg + ", expect --threads N or --pin none|core|numa\n");
+	}
+}
+
+#if defined(__linux__)
+// "0-3,8,10-11" -> 0 1 2 3 8 10 11, the format of /sys/devices/system/node/node*/cpulist
+std::vector<int> parseCpuList(const std::string& list) {
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		if (range.empty() || range[0] == '\n') continue;
+		size_t dash = range.find('-');
+		int lo = std::stoi(range.substr(0, dash));
+		int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+		for (int c = lo; c <= hi; c++) cpus.push_back(c);
+	}
+	return cpus;
+}
+
+// cpus of every numa node, one node with all allowed cpus if there is no numa info
+std::vector<std::vector<int>> numaNodeCpus(const std::vector<int>& allowed) {
+	std::vector<std::vector<int>> nodes;
+	for (int n = 0; ; n++) {
+		std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+		if (!in.is_open()) break;
+		std::string list;
+		std::getline(in, list);
+		std::vector<int> cpus;
+		for (int c : parseCpuList(list)) {
+			if (std::find(allowed.begin(), allowed.end(), c) != allowed.end()) cpus.push_back(c);
+		}
+		if (!cpus.empty()) nodes.push_back(cpus);
+	}
+	if (nodes.empty()) nodes.push_back(allowed);
+	return nodes;
+}
+#endif
+
+// pin the calling render thread according to THREAD_PIN
+// the cpus are taken from the ones the process may use, so it plays along with taskset / numactl
+void pinThread(int threadID) {
+	if (THREAD_PIN == PIN_NONE) return;
+#if defined(__linux__)
+	// cpus this process may run on, read once by the first thread that gets here
+	static const std::vector<int> allowed = []() {
+		std::vector<int> cpus;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			for (int c = 0; c < CPU_SETSIZE; c++)
+				if (CPU_ISSET(c, &set)) cpus.push_back(c);
+		}
+		return cpus;
+	}();
+	static const std::vector<std::vector<int>> nodes = numaNodeCpus(allowed);
+	if (allowed.empty()) return;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (THREAD_PIN == PIN_CORE) CPU_SET(allowed[threadID % allowed.size()], &set);
+	else {
+		for (int c : nodes[threadID % nodes.size()]) CPU_SET(c, &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || processMask == 0) return;
+	DWORD_PTR mask = 0;
+	if (THREAD_PIN == PIN_CORE) {
+		std::vector<int> cpus;
+		for (int c = 0; c < sizeof(DWORD_PTR) * 8; c++)
+			if (processMask & ((DWORD_PTR)1 << c)) cpus.push_back(c);
+		mask = (DWORD_PTR)1 << cpus[threadID % cpus.size()];
+	}
+	else {
+		ULONG highest = 0;
+		GetNumaHighestNodeNumber(&highest);
+		ULONGLONG nodeMask = 0;
+		GetNumaNodeProcessorMask((UCHAR)(threadID % (highest + 1)), &nodeMask);
+		mask = (DWORD_PTR)nodeMask & processMask;
+	}
+	if (mask) SetThreadAffinityMask(GetCurrentThread(), mask);
+#else
+	// no affinity api (e.g. macOS), the OS decides
+#endif
+}
+
+const char* pinningName(ThreadPinning p) {
+	return p == PIN_CORE ? "core" : p == PIN_NUMA ? "numa" : "none";
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <iostream>
+#include <stdio.h>
+
+#include "ThreadAffinity.hpp"
+#include "global.hpp"
+
+#define TILE_SIZE 16		// tiles are TILE_SIZE x TILE_SIZE pixels, smaller at the right and bottom border
+
+// pixels [x0, x1) x [y0, y1) of the image
+struct Tile {
+	int x0, y0, x1, y1;
+};
+
+// tiles of one thread. the owner pops from the bottom, the other threads steal from the top
+// (Chase-Lev deque). all tiles are pushed before the render starts, so it never grows
+class TileDeque {
+public:
+	enum StealResult { STEAL_OK, STEAL_EMPTY, STEAL_ABORT };
+
+	void push(const Tile& t) {
+		tiles.push_back(t);
+		bottom.store(tiles.size());
+	}
+
+	bool pop(Tile& t) {
+		long b = bottom.load() - 1;
+		bottom.store(b);
+		long tp = top.load();
+		if (tp > b) {			// empty
+			bottom.store(tp);
+			return false;
+		}
+		t = tiles[b];
+		if (tp == b) {			// last tile, race a thief for it
+			// a failed exchange writes the new top into its argument, bottom has to go back to the old one + 1
+			long expected = tp;
+			bool won = top.compare_exchange_strong(expected, tp + 1);
+			bottom.store(tp + 1);
+			return won;
+		}
+		return true;
+	}
+
+	StealResult steal(Tile& t) {
+		long tp = top.load();
+		long b = bottom.load();
+		if (tp >= b) return STEAL_EMPTY;
+		t = tiles[tp];
+		if (!top.compare_exchange_strong(tp, tp + 1)) return STEAL_ABORT;	// the owner or another thief was faster
+		return STEAL_OK;
+	}
+
+private:
+	std::vector<Tile> tiles;
+	std::atomic<long> top{ 0 };
+	std::atomic<long> bottom{ 0 };
+};
+
+// splits the image into tiles and renders them on nThreads threads with work stealing,
+// so threads that got cheap tiles help with the expensive ones instead of waiting at join
+class TileScheduler {
+public:
+	TileScheduler(int width, int height, int nThreads, int tileSize = TILE_SIZE)
+		: nThreads(std::max(nThreads, 1)), queues(std::max(nThreads, 1)), stats(std::max(nThreads, 1)) {
+		for (int y = 0; y < height; y += tileSize) {
+			for (int x = 0; x < width; x += tileSize) {
+				tiles.push_back({ x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) });
+			}
+		}
+		// every thread starts on a contiguous block of tiles
+		int nTiles = tiles.size();
+		for (int i = 0; i < this->nThreads; i++) {
+			queues[i] = std::make_unique<TileDeque>();
+			for (int k = (long)i * nTiles / this->nThreads; k < (long)(i + 1) * nTiles / this->nThreads; k++)
+				queues[i]->push(tiles[k]);
+		}
+	}
+
+	// render(tile, threadID) for every tile, returns when all are done
+	// with 1 thread everything runs on the calling thread
+	template <typename F>
+	void run(F render) {
+		auto start = std::chrono::steady_clock::now();
+		if (nThreads == 1) work(0, render);
+		else {
+			std::vector<std::thread> thds;
+			for (int i = 0; i < nThreads; i++)
+				thds.emplace_back([this, i, &render]() {
+					pinThread(i);
+					work(i, render);
+				});
+			for (std::thread& t : thds) t.join();
+		}
+		wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		report();
+	}
+
+	const std::vector<Tile>& getTiles() const { return tiles; }
+
+	// busy: time spent rendering tiles, idle: the rest of the render (stealing, waiting for the slowest thread)
+	void report() const {
+		std::cout << "\ntile scheduler: " << tiles.size() << " tiles, " << nThreads << " threads (pin "
+			<< pinningName(THREAD_PIN) << "), " << wallMs << " ms\n";
+		for (int i = 0; i < nThreads; i++) {
+			const ThreadStats& s = stats[i];
+			printf("  thread %2d: busy %10.1f ms  idle %8.1f ms  tiles %5d (stolen %d)\n",
+				i, s.busyMs, wallMs - s.busyMs, s.tiles, s.stolen);
+		}
+	}
+
+private:
+	struct ThreadStats {
+		double busyMs = 0;
+		int tiles = 0;
+		int stolen = 0;
+	};
+
+	int nThreads;
+	std::vector<Tile> tiles;
+	std::vector<std::unique_ptr<TileDeque>> queues;		// one per thread
+	std::vector<ThreadStats> stats;						// one per thread, only written by its owner
+	double wallMs = 0;
+
+	template <typename F>
+	void work(int threadID, F& render) {
+		ThreadStats& s = stats[threadID];
+		Tile tile;
+		while (true) {
+			bool stolen = false;
+			if (!queues[threadID]->pop(tile)) {
+				if (!stealTile(threadID, tile)) break;
+				stolen = true;
+			}
+			auto t0 = std::chrono::steady_clock::now();
+			render(tile, threadID);
+			s.busyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+			s.tiles++;
+			s.stolen += stolen;
+		}
+		profileFlush(threadID);
+	}
+
+	// try every other thread's queue, starting at the next one
+	// no tile is ever added, so a round where every queue is empty means the work is done
+	bool stealTile(int threadID, Tile& tile) {
+		while (true) {
+			bool retry = false;
+			for (int k = 1; k < nThreads; k++) {
+				TileDeque::StealResult r = queues[(threadID + k) % nThreads]->steal(tile);
+				if (r == TileDeque::STEAL_OK) return true;
+				if (r == TileDeque::STEAL_ABORT) retry = true;
+			}
+			if (!retry) return false;
+		}
+	}
+};
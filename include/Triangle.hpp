@@ -5,6 +5,28 @@
 
 
 
+// Moller Trumbore ray triangle test, hit if t in (tMin, tMax)
+// E1 = v1 - v0, E2 = v2 - v0, b1 b2 are the barycentric coordinates of v1 v2
+// the determinant alone rejects parallel rays, under surface rays are hits too
+inline bool rayTriangle(const Vector3f& v0, const Vector3f& E1, const Vector3f& E2,
+	const Vector3f& orig, const Vector3f& dir, float tMin, float tMax, float& t, float& b1, float& b2) {
+	Vector3f S1 = crossProduct(dir, E2);		// pvec
+	float det = S1.dot(E1);
+	if (det == 0.f) return false;
+	float invDet = 1.f / det;
+
+	Vector3f S = orig - v0;
+	b1 = S1.dot(S) * invDet;
+	if (b1 <= 0.f || b1 >= 1.f) return false;
+
+	Vector3f S2 = crossProduct(S, E1);
+	b2 = S2.dot(dir) * invDet;
+	if (b2 <= 0.f || b1 + b2 >= 1.f) return false;
+
+	t = S2.dot(E2) * invDet;
+	return t > tMin && t < tMax;
+}
+
 class Triangle : public Object{
 public:
 	// 3 vertices, from lower left counterclockwise 
@@ -16,61 +38,47 @@ public:
 	Vector3f n0, n1, n2;
 	Vector2f uv0, uv1, uv2;	// texture coordinate u,v   (-1,-1) initially means no texture 
 
-	// Using Moller Trumbore Algorithm to update the intersection between ray and triangle
+	Triangle() {
+		objectType = OBJTYPE::TRIANGLE;
+	}
+
+	// Using Moller Trumbore Algorithm to find the ray triangle hit distance
 	// solve with Cramer's rule
 	// https://www.geeksforgeeks.org/system-linear-equations-three-variables-using-cramers-rule/#
-	// i didnt read it carefully
-	bool intersect(const Vector3f& orig, const Vector3f& dir, Intersection& inter) override {
-		
+	bool intersectT(int prim, const Vector3f& orig, const Vector3f& dir, float tMax, float& t, float& b1, float& b2) override {
+		return rayTriangle(v0, v1 - v0, v2 - v0, orig, dir, 0.f, tMax, t, b1, b2);
+	}
+
+	// no normal and no Intersection, only for shadow rays
+	bool occluded(int prim, const Vector3f& orig, const Vector3f& dir, float tMin, float tMax) override {
+		float t, b1, b2;
+		return rayTriangle(v0, v1 - v0, v2 - v0, orig, dir, tMin, tMax, t, b1, b2);
+	}
+
+	void fillIntersection(int prim, const Vector3f& orig, const Vector3f& dir, float t, float b1, float b2, Intersection& inter) override {
 		Vector3f E1 = v1 - v0;
-		Vector3f E2 = v2 - v0;          // v2 - v1   get the strange res
-		Vector3f S = orig - v0;
-		Vector3f S1 = crossProduct(dir, E2);		// pvec
-		Vector3f S2 = crossProduct(S, E1);			
-
-		// check if ray parallel to the surface
-		// and 
-		// under surface ray					
-		Vector3f normal = crossProduct(E1, E2);
-		normal = normalized(normal);
-
-		// if the ray is parallel to the surface, then no inter
-		// I CONSIDER undersurface ray, so it's not >=
-		if (FLOAT_EQUAL( dir.dot(normal), 0.f))
-			return false;
-		
+		Vector3f E2 = v2 - v0;
 
-		Vector3f rightVec(S2.dot(E2), S1.dot(S),S2.dot(dir));	// right handside part in my note games101
-		if (S1.dot(E1) == 0.f) return false;
-		float left = 1.0f / S1.dot(E1);
-
-		Vector3f res = left * rightVec;		// t u v are in res now
-
-		if (res.x  > 0 && 1 - res.y - res.z  > 0 && res.y  > 0 && res.z  > 0) {
-			// then update intersection
-			inter.intersected = true;
-			inter.obj = this;
-			inter.t = res.x;
-			inter.pos = orig + inter.t * dir;
-			inter.mtlcolor = this->mtlcolor;
-			inter.Ns = normalized((n0 * (1 - res.y - res.z)) + n1 * res.y + n2 * res.z);	// smooth shading
-			inter.Ng = normal;
-
-			// inter.nDir = normalized(crossProduct(E1, E2));	// flat shading
-
-			// calculate texture coordinates
-			if (isTextureActivated)
-			{
-				inter.textPos = uv0 * (1 - res.y - res.z) + uv1 * res.y + uv2 * res.z;
-				inter.diffuseIndex = this->textureIndex;
-				inter.normalMapIndex = this->normalMapIndex;
-				inter.roughnessMapIndex = roughnessMapIndex;
-				inter.metallicMapIndex = metallicMapIndex;
-			}
-			return true;
+		inter.intersected = true;
+		inter.obj = this;
+		inter.prim = 0;
+		inter.t = t;
+		inter.pos = orig + inter.t * dir;
+		inter.setMaterial(mtlcolor);
+		inter.Ns = normalized((n0 * (1 - b1 - b2)) + n1 * b1 + n2 * b2);	// smooth shading
+		inter.Ng = normalized(crossProduct(E1, E2));
+
+		// inter.nDir = normalized(crossProduct(E1, E2));	// flat shading
+
+		// calculate texture coordinates
+		if (isTextureActivated)
+		{
+			inter.textPos = uv0 * (1 - b1 - b2) + uv1 * b1 + uv2 * b2;
+			inter.diffuseIndex = this->textureIndex;
+			inter.normalMapIndex = this->normalMapIndex;
+			inter.roughnessMapIndex = roughnessMapIndex;
+			inter.metallicMapIndex = metallicMapIndex;
 		}
-		return false;
-		
 	}
 
 
@@ -106,6 +114,11 @@ public:
 		bound = Union(bound, v2);
 	}
 
+	bool getTriangle(int prim, Vector3f& p0, Vector3f& p1, Vector3f& p2) const override {
+		p0 = v0; p1 = v1; p2 = v2;
+		return true;
+	}
+
 	float getArea() override {
 		Vector3f e1 = v1 - v0;
 		Vector3f e2 = v2 - v0;
@@ -128,8 +141,9 @@ public:
 		inter.Ng = normalized(inter.Ng);
 		inter.Ns = inter.Ng;
 		inter.intersected = true;
-		inter.mtlcolor = mtlcolor;
+		inter.setMaterial(mtlcolor);
 		inter.obj = this;
+		inter.prim = 0;
 		
 		float area = getArea();
 		pdf = 1.f / area ;
@@ -140,4 +154,32 @@ public:
 			inter.diffuseIndex = textureIndex;
 		}
 	}
-};
\ No newline at end of file
+};
+
+
+// compact copy of the triangle data the BVH needs to find a hit, 40 bytes
+// built once after the scene is loaded, shading attributes stay in Triangle / TriangleMesh
+struct TriAccel {
+	Vector3f v0;
+	Vector3f e1;	// v1 - v0
+	Vector3f e2;	// v2 - v0
+	int isTriangle = 0;		// 0: other objects, go through Object::intersectT
+
+	TriAccel() {}
+	TriAccel(const Object* obj, int prim) {
+		Vector3f v1, v2;
+		if (!obj->getTriangle(prim, v0, v1, v2)) return;
+		e1 = v1 - v0;
+		e2 = v2 - v0;
+		isTriangle = 1;
+	}
+
+	bool intersectT(const Vector3f& orig, const Vector3f& dir, float tMax, float& t, float& b1, float& b2) const {
+		return rayTriangle(v0, e1, e2, orig, dir, 0.f, tMax, t, b1, b2);
+	}
+
+	bool occluded(const Vector3f& orig, const Vector3f& dir, float tMin, float tMax) const {
+		float t, b1, b2;
+		return rayTriangle(v0, e1, e2, orig, dir, tMin, tMax, t, b1, b2);
+	}
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+
+#include "Object.hpp"
+#include "Triangle.hpp"
+
+// all triangles of one OBJ file in one object: shared vertex arrays and an index buffer,
+// one material and one set of texture maps for the whole mesh.
+// the BVH sees every triangle as a primitive of the mesh, so a triangle costs 12 bytes of indices
+// plus its share of the vertices instead of a whole Triangle object on the heap
+class TriangleMesh : public Object {
+public:
+	// per vertex, all three have the same size
+	std::vector<Vector3f> positions;
+	std::vector<Vector3f> normals;
+	std::vector<Vector2f> uvs;		// texture coordinates, (0, 0) if the file has none
+	std::vector<uint32_t> indices;	// 3 per triangle, counterclockwise like Triangle
+
+	TriangleMesh() {
+		objectType = OBJTYPE::MESH;
+	}
+
+	int triangleCount() const { return indices.size() / 3; }
+	int primitiveCount() const override { return triangleCount(); }
+
+	BoundBox primitiveBound(int prim) const override {
+		const uint32_t* idx = &indices[3 * prim];
+		return Union(BoundBox(positions[idx[0]], positions[idx[1]]), positions[idx[2]]);
+	}
+
+	bool getTriangle(int prim, Vector3f& v0, Vector3f& v1, Vector3f& v2) const override {
+		const uint32_t* idx = &indices[3 * prim];
+		v0 = positions[idx[0]];
+		v1 = positions[idx[1]];
+		v2 = positions[idx[2]];
+		return true;
+	}
+
+	bool intersectT(int prim, const Vector3f& orig, const Vector3f& dir, float tMax, float& t, float& b1, float& b2) override {
+		Vector3f v0, v1, v2;
+		getTriangle(prim, v0, v1, v2);
+		return rayTriangle(v0, v1 - v0, v2 - v0, orig, dir, 0.f, tMax, t, b1, b2);
+	}
+
+	bool occluded(int prim, const Vector3f& orig, const Vector3f& dir, float tMin, float tMax) override {
+		Vector3f v0, v1, v2;
+		getTriangle(prim, v0, v1, v2);
+		float t, b1, b2;
+		return rayTriangle(v0, v1 - v0, v2 - v0, orig, dir, tMin, tMax, t, b1, b2);
+	}
+
+	// same shading as Triangle::fillIntersection
+	void fillIntersection(int prim, const Vector3f& orig, const Vector3f& dir, float t, float b1, float b2, Intersection& inter) override {
+		const uint32_t* idx = &indices[3 * prim];
+		const Vector3f& v0 = positions[idx[0]];
+		Vector3f E1 = positions[idx[1]] - v0;
+		Vector3f E2 = positions[idx[2]] - v0;
+		float b0 = 1 - b1 - b2;
+
+		inter.intersected = true;
+		inter.obj = this;
+		inter.prim = prim;
+		inter.t = t;
+		inter.pos = orig + inter.t * dir;
+		inter.setMaterial(mtlcolor);
+		inter.Ns = normalized(normals[idx[0]] * b0 + normals[idx[1]] * b1 + normals[idx[2]] * b2);	// smooth shading
+		inter.Ng = normalized(crossProduct(E1, E2));
+
+		if (isTextureActivated) {
+			inter.textPos = uvs[idx[0]] * b0 + uvs[idx[1]] * b1 + uvs[idx[2]] * b2;
+			inter.diffuseIndex = textureIndex;
+			inter.normalMapIndex = normalMapIndex;
+			inter.roughnessMapIndex = roughnessMapIndex;
+			inter.metallicMapIndex = metallicMapIndex;
+		}
+	}
+
+	// bound, area and the triangle picking table, call once the arrays are filled
+	void initializeBound() override {
+		int n = triangleCount();
+		areaCdf.resize(n);
+		area = 0;
+		for (int i = 0; i < n; i++) {
+			bound = i == 0 ? primitiveBound(0) : Union(bound, primitiveBound(i));
+			area += triangleArea(i);
+			areaCdf[i] = area;
+		}
+	}
+
+	float getArea() override {
+		return area;
+	}
+
+	// pick a triangle by area, then a point on it the way Triangle::samplePoint does
+	// so the pdf stays 1 / area of the whole mesh
+	void samplePoint(Intersection& inter, float& pdf) override {
+		int prim = std::lower_bound(areaCdf.begin(), areaCdf.end(), getRandomFloat() * area) - areaCdf.begin();
+		prim = std::min(prim, triangleCount() - 1);
+		const uint32_t* idx = &indices[3 * prim];
+
+		float u = getRandomFloat();
+		float v = getRandomFloat() * (1 - u);
+
+		inter.pos = (1 - u - v) * positions[idx[0]] + u * positions[idx[1]] + v * positions[idx[2]];
+		inter.Ng = normalized((1 - u - v) * normals[idx[0]] + u * normals[idx[1]] + v * normals[idx[2]]);
+		inter.Ns = inter.Ng;
+		inter.intersected = true;
+		inter.setMaterial(mtlcolor);
+		inter.obj = this;
+		inter.prim = prim;
+
+		pdf = 1.f / area;
+
+		if (isTextureActivated) {
+			inter.normalMapIndex = normalMapIndex;
+			inter.textPos = uvs[idx[0]] * (1 - u - v) + uvs[idx[1]] * u + uvs[idx[2]] * v;
+			inter.diffuseIndex = textureIndex;
+		}
+	}
+
+	// texture coordinates of the corners of triangle prim, for normal mapping
+	void getTriangleUV(int prim, Vector2f& uv0, Vector2f& uv1, Vector2f& uv2) const {
+		const uint32_t* idx = &indices[3 * prim];
+		uv0 = uvs[idx[0]];
+		uv1 = uvs[idx[1]];
+		uv2 = uvs[idx[2]];
+	}
+
+	// drop the spare capacity the loader left behind
+	void shrink_to_fit() {
+		positions.shrink_to_fit();
+		normals.shrink_to_fit();
+		uvs.shrink_to_fit();
+		indices.shrink_to_fit();
+	}
+
+	// bytes of the vertex and index arrays
+	size_t memoryUsage() const override {
+		return positions.capacity() * sizeof(Vector3f) + normals.capacity() * sizeof(Vector3f)
+			+ uvs.capacity() * sizeof(Vector2f) + indices.capacity() * sizeof(uint32_t) + areaCdf.capacity() * sizeof(float);
+	}
+
+private:
+	float area = 0;
+	std::vector<float> areaCdf;		// running sum of the triangle areas
+
+	float triangleArea(int prim) const {
+		Vector3f v0, v1, v2;
+		getTriangle(prim, v0, v1, v2);
+		return crossProduct(v1 - v0, v2 - v0).norm() * 0.5f;
+	}
+};
+
+// position, normal and uv of a vertex, the loader merges vertices with the same bits
+struct MeshVertexKey {
+	float v[8];
+
+	bool operator==(const MeshVertexKey& o) const {
+		return memcmp(v, o.v, sizeof(v)) == 0;
+	}
+};
+
+struct MeshVertexKeyHash {
+	size_t operator()(const MeshVertexKey& k) const {
+		// FNV-1a over the bytes
+		uint64_t h = 1469598103934665603ull;
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(k.v);
+		for (size_t i = 0; i < sizeof(k.v); i++) {
+			h ^= p[i];
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+};
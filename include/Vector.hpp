@@ -3,6 +3,8 @@
 #include <math.h>
 #include <iostream>
 
+#include "SIMD.hpp"
+
 
 
 
@@ -21,7 +23,8 @@ public:
 	}
 };
 
-class Vector4f {
+// one SSE / NEON register, see SIMD.hpp
+class alignas(16) Vector4f {
 public:
 	float x;
 	float y;
@@ -29,6 +32,7 @@ public:
 	float w;
 
 	Vector4f(float xval, float yval, float zval, float wval) : x(xval), y(yval), z(zval), w(wval) {}
+	Vector4f(const Float4& v) { v.store(&x); }
 
 	Vector4f() {
 		x = 0.f;
@@ -37,12 +41,18 @@ public:
 		w = 0.f;
 	}
 
-	void normalizeW() {
+	Float4 simd() const { return Float4::load(&x); }
+
+	Vector4f operator+(const Vector4f& v) const { return simd() + v.simd(); }
+	Vector4f operator-(const Vector4f& v) const { return simd() - v.simd(); }
+	Vector4f operator*(float c) const { return simd() * Float4(c); }
+
+	float dot(const Vector4f& v) const {
+		return x * v.x + y * v.y + z * v.z + w * v.w;
+	}
 
-		x = x / w;
-		y = y / w;
-		z = z / w;
-		w = w / w;
+	void normalizeW() {
+		*this = simd() / Float4(w);
 	}
 };
 
@@ -56,7 +66,7 @@ public:
 		y = -1.f;
 	}
 
-	Vector2f operator*(const float& c) {
+	Vector2f operator*(float c) const {
 		return Vector2f(x * c, y * c);
 	}
 	Vector2f operator+(const Vector2f& v) const
@@ -121,12 +131,13 @@ public:
 		return "(" + std::to_string(x) + ", " + std::to_string(y) + ", " + std::to_string(z);
 	}
 	
-	// const float&		const lvalue reference, can point to both lvalue and rvalue
-	Vector3f operator*(const float& c) {
+	// scalars by value, vectors by const reference: a Vector3f is 12 bytes and stays that way,
+	// meshes, TriAccel and the scene cache store arrays of it. batches of them go through Vec3x8
+	Vector3f operator*(float c) const {
 		return Vector3f(x * c, y * c, z * c);
 	}
 
-	Vector3f operator/(const float& c) const{
+	Vector3f operator/(float c) const {
 		return Vector3f(x / c, y / c, z / c);
 	}
 
@@ -165,16 +176,10 @@ public:
 		return Vector3f(-x, -y, -z); 
 	}
 
-	// copy assignment operator
-	Vector3f& operator= (const Vector3f& other) {
-		this->x = other.x;
-		this->y = other.y;
-		this->z = other.z;
-
-		return *this;
-	}
+	// copy assignment operator, the default one keeps Vector3f trivially copyable
+	Vector3f& operator= (const Vector3f& other) = default;
 	
-	Vector3f& operator= (const float& scaler) {
+	Vector3f& operator= (float scaler) {
 		this->x = scaler;
 		this->y = scaler;
 		this->z = scaler;
@@ -199,11 +204,11 @@ public:
 	// ************************* vector operations ends ***********************
 
 	// get norm of this vector
-	float norm() {
+	float norm() const {
 		return sqrtf(x * x + y * y + z * z);
 	}
 
-	float norm2() {
+	float norm2() const {
 		return x * x + y * y + z * z;
 	}
 
@@ -220,12 +225,52 @@ inline Vector3f normalized(const Vector3f& v) {
 }
 
 // return the crossProduct of v1 and v2
-Vector3f crossProduct(const Vector3f& v1, const Vector3f& v2) {
+inline Vector3f crossProduct(const Vector3f& v1, const Vector3f& v2) {
 	return Vector3f(v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x);
 }
 
 
-class Mat4f {
+// 8 Vector3f as structure of arrays, one Float8 per component, for kernels that work on batches
+// (MicrofacetSIMD.hpp). lanes come from and go to float[3][8] staging arrays
+struct Vec3x8 {
+	Float8 x, y, z;
+
+	Vec3x8() {}
+	Vec3x8(Float8 x, Float8 y, Float8 z) : x(x), y(y), z(z) {}
+	explicit Vec3x8(const Vector3f& v) : x(v.x), y(v.y), z(v.z) {}	// v in every lane
+
+	static Vec3x8 load(const float v[3][8]) { return Vec3x8(Float8::load(v[0]), Float8::load(v[1]), Float8::load(v[2])); }
+	void store(float v[3][8]) const { x.store(v[0]); y.store(v[1]); z.store(v[2]); }
+	Vector3f get(int lane) const { return Vector3f(x[lane], y[lane], z[lane]); }
+
+	Vec3x8 operator+(const Vec3x8& v) const { return Vec3x8(x + v.x, y + v.y, z + v.z); }
+	Vec3x8 operator-(const Vec3x8& v) const { return Vec3x8(x - v.x, y - v.y, z - v.z); }
+	Vec3x8 operator*(const Vec3x8& v) const { return Vec3x8(x * v.x, y * v.y, z * v.z); }
+	Vec3x8 operator*(Float8 c) const { return Vec3x8(x * c, y * c, z * c); }
+	Vec3x8 operator/(Float8 c) const { return Vec3x8(x / c, y / c, z / c); }
+	Vec3x8 operator-() const { return Vec3x8(Float8(0.f) - x, Float8(0.f) - y, Float8(0.f) - z); }
+};
+
+inline Float8 dot(const Vec3x8& a, const Vec3x8& b) {
+	return fmadd(a.x, b.x, fmadd(a.y, b.y, a.z * b.z));
+}
+
+inline Vec3x8 crossProduct(const Vec3x8& a, const Vec3x8& b) {
+	return Vec3x8(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// zero length lanes stay as they are, like normalized(Vector3f)
+inline Vec3x8 normalized(const Vec3x8& v) {
+	Float8 mag = sqrt(dot(v, v));
+	Float8 magInv = Float8(1.f) / mag;
+	Float8 ok = mag > Float8(0.f);
+	return Vec3x8(select(ok, v.x * magInv, v.x), select(ok, v.y * magInv, v.y), select(ok, v.z * magInv, v.z));
+}
+
+
+// row major, a row is one Float4: products with vectors and matrices go a row or column per instruction.
+// the SIMD versions add up in the order of the scalar loops, the results don't depend on VECTOR_SIMD
+class alignas(16) Mat4f {
 public:
 	Mat4f() {
 		for (int i = 0; i < 16; i++)
@@ -248,6 +293,10 @@ public:
 	void set(int r, int c, float val) {
 		ele[c + r * 4] = val;
 	}
+	Float4 row(int r) const {
+		return Float4::load(ele + r * 4);
+	}
+
 	void setRow(int r, const Vector3f& vec, float val) {
 		ele[0 + r * 4] = vec.x;
 		ele[1 + r * 4] = vec.y;
@@ -287,45 +336,25 @@ public:
 		return r;
 	}
 
-	Vector4f operator*(const Vector4f& v) {
-		Vector4f res;
-		res.x = v.x * ele[0] + v.y * ele[1] + v.z * ele[2] + v.w * ele[3];
-		res.y = v.x * ele[4] + v.y * ele[5] + v.z * ele[6] + v.w * ele[7];
-		res.z = v.x * ele[8] + v.y * ele[9] + v.z * ele[10] + v.w * ele[11];
-		res.w = v.x * ele[12] + v.y * ele[13] + v.z * ele[14] + v.w * ele[15];
-		return res;
+	// the columns scaled by the components of v, res.x = v.x * ele[0] + v.y * ele[1] + v.z * ele[2] + v.w * ele[3] etc.
+	Vector4f operator*(const Vector4f& v) const {
+		Float4 c0 = row(0), c1 = row(1), c2 = row(2), c3 = row(3);
+		transpose(c0, c1, c2, c3);
+		Float4 p = v.simd();
+		return c0 * broadcast<0>(p) + c1 * broadcast<1>(p) + c2 * broadcast<2>(p) + c3 * broadcast<3>(p);
 	}
 
 	// copy from smallVCM
-	Vector3f transformPoint(const Vector3f& p) {
-		// get calculated W,vector.w, the forth dimension
-		float w = get(3, 3);
-
-		for (int c = 0; c < 3; c++)
-			w += get(3, c) * p.get(c);
+	Vector3f transformPoint(const Vector3f& p) const {
+		Float4 c0 = row(0), c1 = row(1), c2 = row(2), c3 = row(3);
+		transpose(c0, c1, c2, c3);
+		// translation first, then the dot product with the rows, w in the last lane
+		Float4 res = c3 + c0 * Float4(p.x) + c1 * Float4(p.y) + c2 * Float4(p.z);
 
 		// normalization factor
-		const float invW = 1.f / w;
-
-		Vector3f res(0);
-		// translate value
-		res.x = get(0, 3);
-		// dot product
-		for (int c = 0; c < 3; c++)
-			res.x += p.get(c) * get(0, c);
-		res.x *= invW;
-
-		res.y = get(1, 3);
-		for (int c = 0; c < 3; c++)
-			res.y += p.get(c) * get(1, c);
-		res.y *= invW;
-
-		res.z = get(2, 3);
-		for (int c = 0; c < 3; c++)
-			res.z += p.get(c) * get(2, c);
-		res.z *= invW;
-
-		return res;
+		const float invW = 1.f / res[3];
+		res = res * Float4(invW);
+		return Vector3f(res[0], res[1], res[2]);
 	}
 
 
@@ -336,14 +365,13 @@ public:
 // copy from SmallVCM
 Mat4f operator*(const Mat4f& left, const Mat4f& right)
 {
+	// a row of res is the rows of right weighted by a row of left
 	Mat4f res;
+	Float4 r0 = right.row(0), r1 = right.row(1), r2 = right.row(2), r3 = right.row(3);
 	for (int row = 0; row < 4; row++) {
-		for (int col = 0; col < 4; col++) {
-			float r = 0;
-			for (int i = 0; i < 4; i++)
-				r += left.get(row, i) * right.get(i, col);
-			res.set(row, col, r);
-		}
+		Float4 l = left.row(row);
+		Float4 r = Float4(0.f) + broadcast<0>(l) * r0 + broadcast<1>(l) * r1 + broadcast<2>(l) * r2 + broadcast<3>(l) * r3;
+		r.store(res.ele + row * 4);
 	}
 	return res;
 }
@@ -0,0 +1,610 @@
+#pragma once
+// Integrator: wavefront
+#include <algorithm>
+#include "PathTracing.hpp"
+#include "AdaptiveSampling.hpp"
+#include "MicrofacetSIMD.hpp"
+
+#define WAVEFRONT_POOL_SIZE 4096	// paths in flight per thread
+#define SHADE_BUCKETS (UNLIT + 2)	// shade queue order: misses, then one bucket per MaterialType
+
+// what a path of the pool waits for
+enum PathState : uint8_t {
+	PATH_FREE,		// slot unused
+	PATH_SHADE,		// hit is ready to be shaded
+	PATH_EXTEND,	// ray to trace, then shade what it hits (camera and refraction rays)
+	PATH_CONTINUE,	// BSDF sampled ray to trace, then MIS the light it hits or bounce on
+	PATH_DONE		// L is final, to be accumulated
+};
+
+// one sample of one pixel, a path the pool takes on
+struct WavefrontJob {
+	int pixel;		// image index
+	int local;		// pixel within the tile
+	int sample;
+};
+
+// the paths in flight of one thread, structure of arrays: every stage only touches the arrays it needs
+struct PathPool {
+	std::vector<uint8_t> state;
+	std::vector<int> job;			// index into the jobs of the current round
+	std::vector<int> depth;
+	std::vector<Vector3f> rayOrig;	// the ray that found hit
+	std::vector<Vector3f> rayDir;
+	std::vector<Intersection> hit;
+	std::vector<Vector3f> beta;		// product of f * cos / pdf of the bounces so far
+	std::vector<Vector3f> tp;		// russian roulette throughput, reset like PathTracing does
+	std::vector<Vector3f> L;		// radiance gathered so far
+
+	// BSDF sample of the last vertex, waiting for its ray's hit
+	std::vector<Vector3f> prevPos;
+	std::vector<Vector3f> bsdfF;
+	std::vector<float> bsdfPdf;
+	std::vector<float> bsdfCos;
+	std::vector<float> rrU;			// russian roulette number, drawn right after the direction like PathTracing does
+	std::vector<uint8_t> bsdfSpecular;
+
+	// light sample of the last vertex
+	std::vector<Vector3f> wo;		// -rayDir of the shaded hit
+	std::vector<Vector3f> lightLe;
+	std::vector<float> lightPdf;	// w.r.t. area
+	std::vector<float> lightR2;
+	std::vector<float> lightCos;	// at the light
+
+	// shadow ray of the light sample
+	std::vector<Vector3f> shadowOrig;
+	std::vector<Vector3f> shadowTarget;
+	std::vector<Vector3f> shadowL;	// added to L if the light is visible
+	std::vector<uint8_t> shadowKill;	// PathTracing drops the whole path if this light sample is visible
+
+	std::vector<int> freeSlots;
+	std::vector<int> active;		// slots in use, the stages walk these instead of the whole pool
+	// queues of slot indices, rebuilt by every stage
+	std::vector<int> extendQueue, shadeQueue, shadowQueue, cameraQueue;
+	std::vector<int> unsorted;
+	std::vector<uint8_t> sortKey;
+	// BxDF evaluations of one shade batch: the path, the direction, light or BSDF sample, results
+	std::vector<int> evalSlot;
+	std::vector<Vector3f> evalWi;
+	std::vector<uint8_t> evalLight;
+	std::vector<Vector3f> evalF;
+	std::vector<float> evalPdf;
+
+	void init(int n) {
+		state.assign(n, PATH_FREE);
+		job.resize(n); depth.resize(n);
+		rayOrig.resize(n); rayDir.resize(n); hit.resize(n);
+		beta.resize(n); tp.resize(n); L.resize(n);
+		prevPos.resize(n); bsdfF.resize(n); bsdfPdf.resize(n); bsdfCos.resize(n); rrU.resize(n); bsdfSpecular.resize(n);
+		wo.resize(n); lightLe.resize(n); lightPdf.resize(n); lightR2.resize(n); lightCos.resize(n);
+		shadowOrig.resize(n); shadowTarget.resize(n); shadowL.resize(n); shadowKill.resize(n);
+		sortKey.resize(n);
+		freeSlots.clear();
+		for (int i = n - 1; i >= 0; i--) freeSlots.push_back(i);
+		extendQueue.reserve(n); shadeQueue.reserve(n); shadowQueue.reserve(n); cameraQueue.reserve(n); unsorted.reserve(n);
+		evalSlot.reserve(2 * n); evalWi.reserve(2 * n); evalLight.reserve(2 * n); evalF.reserve(2 * n); evalPdf.reserve(2 * n);
+	}
+};
+
+
+// path tracing one stage at a time: instead of following one path to its end by recursion,
+// every thread keeps a pool of paths and runs each stage over all of them
+//   generate: new camera paths into the free slots
+//   extend:   trace the rays the last shade stage sampled
+//   shade:    light sample and BSDF sample of every hit, sorted by material type
+//   connect:  shadow rays of the light samples
+//   accumulate: finished paths go to their pixel, their slots are free again
+// same estimator (MIS), random numbers and russian roulette as PathTracing::traceRay,
+// so both converge to the same image. MIS 0 (NEE only) isn't mirrored, this is always MIS
+class WavefrontPT : public IIntegrator {
+public:
+	WavefrontPT(PPMGenerator* g, IIntersectStrategy* inters) {
+		this->g = g;
+		this->interStrategy = inters;
+	}
+
+	virtual void integrate(PPMGenerator* g) {
+		Camera& cam = g->cam;
+		Vector3f u = normalized(crossProduct(cam.fwdDir, cam.upDir));
+		Vector3f v = normalized(crossProduct(u, cam.fwdDir));
+		float d = cam.imagePlaneDist;
+		if (g->parallel_projection) d = 4.f;
+		float width_half = fabs(tan(degree2Radians(cam.hfov / 2.f)) * d);
+		float aspect_ratio = cam.width / (float)cam.height;
+		float height_half = width_half / aspect_ratio;
+
+		Vector3f n = normalized(g->viewdir);
+		eyePos = cam.position;
+		ul = eyePos + d * n - width_half * u + height_half * v;
+		Vector3f ur = eyePos + d * n + width_half * u + height_half * v;
+		Vector3f ll = eyePos + d * n - width_half * u - height_half * v;
+
+		delta_h = Vector3f(0, 0, 0);
+		if (g->width != 1) delta_h = (ur - ul) / (g->width - 1);
+		delta_v = Vector3f(0, 0, 0);
+		if (g->height != 1) delta_v = (ll - ul) / (g->height - 1);
+		c_off_h = (ur - ul) / (float)(g->width * 2);
+		c_off_v = (ll - ul) / (float)(g->height * 2);
+
+		pools = std::vector<PathPool>(N_THREAD);
+		stats = std::vector<WaveStats>(N_THREAD);
+		TileScheduler scheduler(g->width, g->height, N_THREAD);
+		scheduler.run([&](const Tile& tile, int threadID) {
+			PROF_STAGE(STAGE_TILE);
+			renderTile(tile, threadID);
+		});
+
+		WaveStats total;
+		for (const WaveStats& s : stats) {
+			total.paths += s.paths;
+			total.waves += s.waves;
+			total.busySlots += s.busySlots;
+		}
+		std::cout << "wavefront: " << total.paths << " paths in " << total.waves << " waves, "
+			<< 100.0 * total.busySlots / std::max(1LL, total.waves * WAVEFRONT_POOL_SIZE) << "% of the pool busy per wave\n";
+	}
+
+private:
+	struct WaveStats {
+		long long paths = 0;
+		long long waves = 0;
+		long long busySlots = 0;
+	};
+
+	Vector3f eyePos, ul, delta_h, delta_v, c_off_h, c_off_v;
+	std::vector<PathPool> pools;	// one per thread
+	std::vector<WaveStats> stats;	// one per thread
+
+	// camera ray through the pixel, the same one sub_render_pt shoots
+	Vector3f pixelPosition(int x, int y) const {
+		return pixelCenter(ul, delta_h, delta_v, c_off_h, c_off_v, x, y);
+	}
+
+	void renderTile(const Tile& tile, int threadID) {
+		PathPool& pool = pools[threadID];
+		if (pool.state.empty()) pool.init(WAVEFRONT_POOL_SIZE);
+		int tw = tile.x1 - tile.x0;
+		int nPixels = tw * (tile.y1 - tile.y0);
+
+		// without jitter every sample of a pixel shoots the same camera ray, trace it once per pixel
+		std::vector<Vector3f> primaryDirs;
+		std::vector<Intersection> primaryInters;
+		if (!PIXEL_JITTER) {
+			primaryDirs.resize(nPixels);
+			primaryInters.resize(nPixels);
+			Vector3f rayOrigs[RAY_PACKET_SIZE];
+			for (int k = 0; k < RAY_PACKET_SIZE; k++) rayOrigs[k] = eyePos;
+			for (int y = tile.y0; y < tile.y1; y++) {
+				for (int x0 = tile.x0; x0 < tile.x1; x0 += RAY_PACKET_SIZE) {
+					int m = std::min(RAY_PACKET_SIZE, tile.x1 - x0);
+					int first = (y - tile.y0) * tw + x0 - tile.x0;
+					for (int k = 0; k < m; k++)
+						primaryDirs[first + k] = normalized(pixelPosition(x0 + k, y) - eyePos);
+					PROF_ADD(PROF_CAMERA_RAYS, m);
+					interStrategy->UpdateInterPacket(&primaryInters[first], g->scene, rayOrigs, &primaryDirs[first], m);
+				}
+			}
+		}
+
+		// rounds of samples: SPP per pixel first, then with adaptive sampling a batch more for every
+		// pixel that isn't converged. samples are added in order once the round is done
+		std::vector<PixelEstimator> ests(nPixels);
+		std::vector<WavefrontJob> jobs;
+		std::vector<Vector3f> results;
+		while (true) {
+			jobs.clear();
+			for (int p = 0; p < nPixels; p++) {
+				int pixel = g->getIndex(tile.x0 + p % tw, tile.y0 + p / tw);
+				for (int s = 0, k = ests[p].pending(); s < k; s++)
+					jobs.push_back({ pixel, p, ests[p].count() + s });
+			}
+			if (jobs.empty()) break;
+			results.resize(jobs.size());
+			runWaves(pool, jobs, results, primaryDirs, primaryInters, stats[threadID]);
+			for (size_t j = 0; j < jobs.size(); j++)
+				ests[jobs[j].local].add(results[j]);
+		}
+
+		for (int p = 0; p < nPixels; p++) {
+			int pixel = g->getIndex(tile.x0 + p % tw, tile.y0 + p / tw);
+			g->cam.FrameBuffer.rgb.at(pixel) = ests[p].estimate();
+			g->cam.sampleCount[pixel] = ests[p].count();
+		}
+	}
+
+	// all jobs of one round, the pool refills from them until they are all done
+	void runWaves(PathPool& pool, const std::vector<WavefrontJob>& jobs, std::vector<Vector3f>& results,
+		const std::vector<Vector3f>& primaryDirs, const std::vector<Intersection>& primaryInters, WaveStats& st) {
+		size_t next = 0;
+		int active = 0;
+		while (next < jobs.size() || active > 0) {
+			active += generate(pool, jobs, next, primaryDirs, primaryInters);
+			st.waves++;
+			st.busySlots += active;
+			extend(pool);
+			shade(pool, jobs);
+			connect(pool);
+			int finished = accumulate(pool, results);
+			active -= finished;
+			st.paths += finished;
+		}
+	}
+
+	// start the next jobs in the free slots, returns how many
+	int generate(PathPool& pool, const std::vector<WavefrontJob>& jobs, size_t& next,
+		const std::vector<Vector3f>& primaryDirs, const std::vector<Intersection>& primaryInters) {
+		PROF_STAGE(STAGE_CAMERA);
+		int started = 0;
+		pool.cameraQueue.clear();
+		while (next < jobs.size() && !pool.freeSlots.empty()) {
+			int i = pool.freeSlots.back();
+			pool.freeSlots.pop_back();
+			pool.active.push_back(i);
+			const WavefrontJob& job = jobs[next];
+			pool.job[i] = next++;
+			pool.depth[i] = 0;
+			pool.beta[i] = Vector3f(1);
+			pool.tp[i] = Vector3f(1);
+			pool.L[i] = Vector3f(0);
+			pool.rayOrig[i] = eyePos;
+			started++;
+			if (!PIXEL_JITTER) {
+				pool.rayDir[i] = primaryDirs[job.local];
+				pool.hit[i] = primaryInters[job.local];
+				pool.state[i] = PATH_SHADE;
+				continue;
+			}
+			int x = job.pixel % g->width, y = job.pixel / g->width;
+			startSample(job.pixel, job.sample);
+			pool.rayDir[i] = normalized(jitterPixel(pixelPosition(x, y), delta_h, delta_v) - eyePos);
+			pool.state[i] = PATH_SHADE;
+			pool.cameraQueue.push_back(i);
+		}
+
+		// jittered camera rays of neighbouring samples go as packets
+		Vector3f rayOrigs[RAY_PACKET_SIZE], rayDirs[RAY_PACKET_SIZE];
+		Intersection inters[RAY_PACKET_SIZE];
+		for (size_t k0 = 0; k0 < pool.cameraQueue.size(); k0 += RAY_PACKET_SIZE) {
+			int m = std::min((size_t)RAY_PACKET_SIZE, pool.cameraQueue.size() - k0);
+			for (int k = 0; k < m; k++) {
+				rayOrigs[k] = eyePos;
+				rayDirs[k] = pool.rayDir[pool.cameraQueue[k0 + k]];
+			}
+			PROF_ADD(PROF_CAMERA_RAYS, m);
+			interStrategy->UpdateInterPacket(inters, g->scene, rayOrigs, rayDirs, m);
+			for (int k = 0; k < m; k++) pool.hit[pool.cameraQueue[k0 + k]] = inters[k];
+		}
+		return started;
+	}
+
+	// trace the rays sampled by the last shade stage
+	void extend(PathPool& pool) {
+		PROF_STAGE(STAGE_INTERSECT);
+		pool.extendQueue.clear();
+		for (int i : pool.active)
+			if (pool.state[i] == PATH_EXTEND || pool.state[i] == PATH_CONTINUE) pool.extendQueue.push_back(i);
+
+		for (int i : pool.extendQueue) {
+			pool.hit[i] = Intersection();
+			interStrategy->UpdateInter(pool.hit[i], g->scene, pool.rayOrig[i], pool.rayDir[i]);
+		}
+
+		for (int i : pool.extendQueue) {
+			if (pool.state[i] == PATH_EXTEND) pool.state[i] = PATH_SHADE;
+			else continueBsdf(pool, i);
+		}
+	}
+
+	// the BSDF sampled ray of the last vertex hit something: the light it hits is weighted
+	// against light sampling (MIS), anything else is the next vertex if russian roulette lets it
+	void continueBsdf(PathPool& pool, int i) {
+		Intersection& x = pool.hit[i];
+		pool.state[i] = PATH_DONE;
+		if (!x.intersected) return;
+
+		const Vector3f& wi = pool.rayDir[i];
+		float matPdf = pool.bsdfPdf[i];
+		float cos_theta = pool.bsdfCos[i];
+		float light_pdf = getLightPdf(x, g);
+		if (light_pdf) {
+			float cos_theta_prime = normalized(x.Ns).dot(-wi);
+			if (cos_theta_prime > 0) {
+				float r2 = (x.pos - pool.prevPos[i]).norm2();
+				float mis_weight_m = getMisWeight(matPdf, light_pdf * r2 / cos_theta_prime);
+				if (pool.bsdfSpecular[i]) mis_weight_m = 1.f;
+				if (matPdf < MIN_DIVISOR) return;
+				pool.L[i] = pool.L[i] + pool.beta[i] * (mis_weight_m * x.mtl->emission * pool.bsdfF[i] * cos_theta / matPdf);
+				return;
+			}
+		}
+
+		// indirect illumination
+		Vector3f tp = pool.depth[i] > MIN_DEPTH ? pool.tp[i] : Vector3f(1);
+		float rr_prob = std::max(tp.x, std::max(tp.y, tp.z));
+		if (pool.rrU[i] > rr_prob) return;
+		if (matPdf * rr_prob < MIN_DIVISOR) return;
+		Vector3f coe = pool.bsdfF[i] * cos_theta / (matPdf * rr_prob);
+		pool.tp[i] = tp * coe;
+		pool.beta[i] = pool.beta[i] * coe;
+		pool.depth[i]++;
+		pool.state[i] = PATH_SHADE;
+	}
+
+	// shade every hit, one kernel per type of material over all hits of that type
+	void shade(PathPool& pool, const std::vector<WavefrontJob>& jobs) {
+		// counting sort by material type, slots keep their order inside a bucket
+		int start[SHADE_BUCKETS + 1] = {};
+		pool.unsorted.clear();
+		pool.shadowQueue.clear();
+		for (int i : pool.active) {
+			if (pool.state[i] != PATH_SHADE) continue;
+			pool.unsorted.push_back(i);
+			pool.sortKey[i] = pool.hit[i].intersected ? 1 + pool.hit[i].mtl->mType : 0;
+			start[pool.sortKey[i] + 1]++;
+		}
+		for (int b = 1; b <= SHADE_BUCKETS; b++) start[b] += start[b - 1];
+		pool.shadeQueue.resize(pool.unsorted.size());
+		for (int i : pool.unsorted) pool.shadeQueue[start[pool.sortKey[i]]++] = i;
+
+		// start[b] is where bucket b ends now
+		for (int b = 0, first = 0; b < SHADE_BUCKETS; first = start[b++]) {
+			const int* slots = pool.shadeQueue.data() + first;
+			int n = start[b] - first;
+			if (n == 0) continue;
+			switch (b) {
+			case 0: shadeMisses(pool, slots, n); break;
+			case 1 + LAMBERTIAN: shadeBatch<LAMBERTIAN>(pool, jobs, slots, n); break;
+			case 1 + PERFECT_REFLECTIVE: shadeBatch<PERFECT_REFLECTIVE>(pool, jobs, slots, n); break;
+			case 1 + MICROFACET_R: shadeBatch<MICROFACET_R>(pool, jobs, slots, n); break;
+			case 1 + PERFECT_REFRACTIVE: shadeRefractive<PERFECT_REFRACTIVE>(pool, jobs, slots, n); break;
+			case 1 + MICROFACET_T: shadeRefractive<MICROFACET_T>(pool, jobs, slots, n); break;
+			case 1 + UNLIT: shadeBatch<UNLIT>(pool, jobs, slots, n); break;
+			}
+		}
+	}
+
+	// camera and refraction rays that left the scene
+	void shadeMisses(PathPool& pool, const int* slots, int n) {
+		for (int k = 0; k < n; k++) {
+			int i = slots[k];
+			pool.state[i] = PATH_DONE;
+			if (pool.depth[i] > MAX_DEPTH) continue;
+			pool.L[i] = pool.L[i] + pool.beta[i] * g->bkgcolor;
+		}
+	}
+
+	// PathTracing::traceRay for n hits on materials of type T, the recursion is the next wave.
+	// samples first, then the BxDF and pdf of every sampled direction of the batch in one go, then MIS
+	template <MaterialType T>
+	void shadeBatch(PathPool& pool, const std::vector<WavefrontJob>& jobs, const int* slots, int n) {
+		pool.evalSlot.clear();
+		pool.evalWi.clear();
+		pool.evalLight.clear();
+		for (int k = 0; k < n; k++) {
+			int i = slots[k];
+			const WavefrontJob& job = jobs[pool.job[i]];
+			startSample(job.pixel, job.sample);
+			Intersection& inter = pool.hit[i];
+			int depth = pool.depth[i];
+			pool.state[i] = PATH_DONE;
+			if (depth > MAX_DEPTH) continue;
+			if (inter.obj->isTextureActivated)
+				textureModify(inter, g);
+			if constexpr (T == UNLIT) {
+				pool.L[i] = pool.L[i] + pool.beta[i] * inter.surface.diffuse;
+				continue;
+			}
+			// lights seen through a bounce are counted by the bounce (MIS)
+			if (inter.mtl->hasEmission()) {
+				if (depth == 0) pool.L[i] = pool.L[i] + pool.beta[i] * inter.mtl->emission;
+				continue;
+			}
+
+			Vector3f wo = -pool.rayDir[i];
+			pool.wo[i] = wo;
+
+			// light sample, its shadow ray goes to the connect stage
+			float light_pdf;
+			Intersection light_inter;
+			startBounce(depth, SLOT_LIGHT);
+			sampleLight(light_inter, light_pdf, g);
+			if (light_inter.intersected) {
+				Vector3f wi = light_inter.pos - inter.pos;
+				float r2 = wi.norm2();
+				wi = normalized(wi);
+				float cos_theta_prime = normalized(light_inter.Ns).dot(-wi);
+				if (wi.dot(light_inter.Ns) <= 0 && cos_theta_prime > 0) {
+					pool.lightLe[i] = light_inter.mtl->emission;
+					pool.lightPdf[i] = light_pdf;
+					pool.lightR2[i] = r2;
+					pool.lightCos[i] = cos_theta_prime;
+					pool.shadowOrig[i] = inter.pos;
+					offsetRayOrig(pool.shadowOrig[i], inter.Ns, inter.Ns.dot(wo) < 0);
+					pool.shadowTarget[i] = light_inter.pos;
+					offsetRayOrig(pool.shadowTarget[i], light_inter.Ns, false);
+					pool.evalSlot.push_back(i);
+					pool.evalWi.push_back(wi);
+					pool.evalLight.push_back(1);
+				}
+			}
+
+			// BSDF sample, traced by the next extend stage
+			Vector3f wi;
+			startBounce(depth, SLOT_BSDF);
+			auto [sampleSucess, specialEvent] = inter.mtl->template sampleDirectionOf<T>(inter.surface, wo, inter.Ns, wi, g->eta);
+			if (!sampleSucess) continue;
+			pool.rrU[i] = getRandomFloat();
+			pool.bsdfCos[i] = abs(inter.Ng.dot(wi));
+			pool.prevPos[i] = inter.pos;
+			pool.rayOrig[i] = inter.pos;
+			offsetRayOrig(pool.rayOrig[i], inter.Ns, wi.dot(inter.Ns) < 0);
+			pool.rayDir[i] = wi;
+			pool.state[i] = PATH_CONTINUE;
+			pool.evalSlot.push_back(i);
+			pool.evalWi.push_back(wi);
+			pool.evalLight.push_back(0);
+		}
+
+		evaluate<T>(pool);
+
+		for (size_t e = 0; e < pool.evalSlot.size(); e++) {
+			int i = pool.evalSlot[e];
+			float mat_pdf = pool.evalPdf[e];
+			if (!pool.evalLight[e]) {
+				pool.bsdfPdf[i] = mat_pdf;
+				pool.bsdfF[i] = pool.evalF[e];
+				pool.bsdfSpecular[i] = T == PERFECT_REFLECTIVE && mat_pdf == 1.f;
+				continue;
+			}
+			float r2 = pool.lightR2[i], light_pdf = pool.lightPdf[i], cos_theta_prime = pool.lightCos[i];
+			float cos_theta = abs(pool.hit[i].Ng.dot(pool.evalWi[e]));
+			float mis_weight_l = getMisWeight(light_pdf * r2 / cos_theta_prime, mat_pdf);
+			pool.shadowKill[i] = r2 * light_pdf < MIN_DIVISOR;
+			if (!pool.shadowKill[i])
+				pool.shadowL[i] = pool.beta[i] * (mis_weight_l * pool.lightLe[i] * pool.evalF[e] * cos_theta * cos_theta_prime / (r2 * light_pdf));
+			pool.shadowQueue.push_back(i);
+		}
+	}
+
+	// BxDF and pdf of the directions the batch sampled, all on materials of type T
+	template <MaterialType T>
+	void evaluate(PathPool& pool) {
+		size_t n = pool.evalSlot.size(), e = 0;
+		pool.evalF.resize(n);
+		pool.evalPdf.resize(n);
+#if SHADE_AVX2
+		if constexpr (T == MICROFACET_R) {
+			// SHADE_LANES at a time, the last call is padded with copies of its first lane
+			MicrofacetLanes lanes;
+			for (; e < n; e += SHADE_LANES) {
+				int m = std::min((size_t)SHADE_LANES, n - e);
+				for (int j = 0; j < SHADE_LANES; j++) {
+					size_t ej = e + (j < m ? j : 0);
+					int i = pool.evalSlot[ej];
+					const Intersection& inter = pool.hit[i];
+					const Vector3f* v[5] = { &pool.evalWi[ej], &pool.wo[i], &inter.Ng, &inter.Ns, &inter.surface.diffuse };
+					float(*dst[5])[SHADE_LANES] = { lanes.wi, lanes.wo, lanes.Ng, lanes.Ns, lanes.diffuse };
+					for (int f = 0; f < 5; f++) {
+						dst[f][0][j] = v[f]->x;
+						dst[f][1][j] = v[f]->y;
+						dst[f][2][j] = v[f]->z;
+					}
+					lanes.roughness[j] = inter.surface.roughness;
+					lanes.metallic[j] = inter.surface.metallic;
+				}
+				evalMicrofacetR8(lanes);
+				PROF_ADD(PROF_BSDF_EVALS, m);
+				for (int j = 0; j < m; j++) {
+					pool.evalF[e + j] = Vector3f(lanes.f[0][j], lanes.f[1][j], lanes.f[2][j]);
+					pool.evalPdf[e + j] = lanes.pdf[j];
+				}
+			}
+		}
+#endif
+		for (; e < n; e++) {
+			int i = pool.evalSlot[e];
+			const Intersection& inter = pool.hit[i];
+			const Vector3f& wi = pool.evalWi[e];
+			pool.evalPdf[e] = inter.mtl->template pdfOf<T>(inter.surface, wi, pool.wo[i], inter.Ns, g->eta, inter.mtl->eta);
+			pool.evalF[e] = inter.mtl->template BxDFOf<T>(inter.surface, wi, pool.wo[i], inter.Ng, inter.Ns, g->eta);
+		}
+	}
+
+	// PathTracing::calcForRefractive for n hits on materials of type T:
+	// the refracted (or reflected) ray goes on without MIS
+	template <MaterialType T>
+	void shadeRefractive(PathPool& pool, const std::vector<WavefrontJob>& jobs, const int* slots, int n) {
+		for (int k = 0; k < n; k++) {
+			int i = slots[k];
+			const WavefrontJob& job = jobs[pool.job[i]];
+			startSample(job.pixel, job.sample);
+			pool.state[i] = PATH_DONE;
+			if (pool.depth[i] > MAX_DEPTH) continue;
+
+			Intersection& inter = pool.hit[i];
+			Vector3f Ng = inter.Ng;
+			Vector3f Ns = inter.Ns;
+			Vector3f wo = -pool.rayDir[i];
+			float eta_i = g->eta;
+			float eta_t = inter.mtl->eta;
+
+			Vector3f wi;
+			startBounce(pool.depth[i], SLOT_BSDF);
+			auto [sampleSuccess, TIR] = inter.mtl->template sampleDirectionOf<T>(inter.surface, wo, inter.Ns, wi, eta_i);
+			wi = normalized(wi);
+			float pdf = inter.mtl->template pdfOf<T>(inter.surface, wi, wo, inter.Ns, eta_i, eta_t);
+
+			// total internal reflection
+			if (TIR) {
+				wi = normalized(getReflectionDir(wo, Ns));
+				pdf = 1;
+				if constexpr (T == MICROFACET_T) {
+					Vector3f interNs = Ns;
+					if (wo.dot(Ng) < 0) {
+						std::swap(eta_i, eta_t);
+						interNs = -interNs;
+					}
+					Vector3f h = normalized(wo + wi);
+					float cosTheta = abs(interNs.dot(h));
+					wi = normalized(getReflectionDir(wo, h));
+					pdf = 1 * D_ndf(h, interNs, inter.surface.roughness) * cosTheta / (4.f * wo.dot(h));
+				}
+			}
+			Vector3f f_r = inter.mtl->template BxDFOf<T>(inter.surface, wi, wo, Ng, Ns, eta_i, false, TIR);
+
+			Vector3f rayOrig = inter.pos;
+			float cos = 0;
+			if (wi.dot(Ns) > 0) {
+				rayOrig = rayOrig + Ns * EPSILON;
+				cos = abs(Ng.dot(wi));
+			}
+			else {
+				rayOrig = rayOrig - Ns * EPSILON;
+				cos = abs((-Ng).dot(wi));
+			}
+			// past MAX_DEPTH the refracted ray would bring back nothing
+			if (pdf < MIN_DIVISOR || pool.depth[i] + 1 > MAX_DEPTH) continue;
+
+			pool.beta[i] = pool.beta[i] * (cos * f_r / pdf);
+			pool.tp[i] = Vector3f(1);
+			pool.depth[i]++;
+			pool.rayOrig[i] = rayOrig;
+			pool.rayDir[i] = wi;
+			pool.state[i] = PATH_EXTEND;
+		}
+	}
+
+	// shadow rays of this wave's light samples
+	void connect(PathPool& pool) {
+		PROF_STAGE(STAGE_SHADOW);
+		for (int i : pool.shadowQueue) {
+			if (isShadowRayBlocked(pool.shadowOrig[i], pool.shadowTarget[i], g, interStrategy)) continue;
+			if (pool.shadowKill[i]) {
+				pool.state[i] = PATH_DONE;
+				continue;
+			}
+			pool.L[i] = pool.L[i] + pool.shadowL[i];
+		}
+	}
+
+	// finished paths hand their radiance to their job, returns how many
+	int accumulate(PathPool& pool, std::vector<Vector3f>& results) {
+		PROF_STAGE(STAGE_FILM);
+		int finished = 0;
+		size_t kept = 0;
+		for (int i : pool.active) {
+			if (pool.state[i] != PATH_DONE) {
+				pool.active[kept++] = i;
+				continue;
+			}
+			Vector3f res = pool.L[i];
+			if (isnan(res.x) || isnan(res.y) || isnan(res.z)) res = 0;	// wipe out the white noise
+			results[pool.job[i]] = res;
+			pool.state[i] = PATH_FREE;
+			pool.freeSlots.push_back(i);
+			finished++;
+		}
+		pool.active.resize(kept);
+		return finished;
+	}
+};
@@ -4,24 +4,34 @@
 #include <stdexcept>
 #include <math.h>
 #include <algorithm>
-#include <random>
 #include <iostream>
 #include <stdio.h>
 #include <mutex>
+#include <thread>
 
 #include "Vector.hpp"
+#include "RNG.hpp"
+#include "Sampler.hpp"
 
-#define DEBUG 0	// fix random num seeds or not
 #define M_PI 3.1415926535897f
 #define EPSILON 0.0005f		// be picky about it, change it to accommodate object size
+#define SHADOW_EPSILON 0.0001f	// shadow rays stop this short of the target point
 
 bool PRINT = false;			// debug helper
 int SPP = 64;
 float SPP_inv = 1.f / SPP;
+int N_THREAD = std::max(1, (int)std::thread::hardware_concurrency());	// render threads, "threads" in config or --threads
+uint32_t RNG_SEED = 0;		// "seed" in config, a different seed gives a different noise pattern
 
 #define EXPEDITE 1		// BVH to expedite intersection
+#define PRECOMPUTE_TRI 1	// BVH tests triangles on a compact precomputed copy (TriAccel)
+#define WIDE_BVH_SIMD 1		// SSE box tests in the 4-wide BVH, 0 for the scalar fallback
+#define SHADE_SIMD 1		// AVX2 microfacet kernels in the wavefront shade stage (needs -mavx2 -mfma), 0 for the scalar ones
 #define MULTITHREAD	1	// multi threads to expedite, 0 for none, 1 for std::thread, 2 for openmp
-#define N_THREAD 20
+#define PER_THREAD_FILM 1	// light splats go to per-thread films merged after the render, 0 for one film behind a mutex
+#define SPLAT_FILMS 8		// at most this many films of width x height x 12 B, more threads share them (thread i % SPLAT_FILMS, locked)
+#define COUNT_ALLOCS 0		// count heap allocations per thread (AllocCounter.hpp), BDPT reports them per sample
+#define PROFILE 1			// per-thread ray / BVH / BSDF counters and stage timers, reported after the render (Profiler.hpp), 2 also times every ray query, 0 compiles them out
 #define MIS	1			// Multiple Importance Sampling
 #define MIN_DIVISOR 0.04f
 
@@ -32,6 +42,8 @@ float SPP_inv = 1.f / SPP;
 #define HDR_BLOOM
 //#define BLOOM_ONLY
 
+#include "Profiler.hpp"
+
 
 // lerp(x,v0,v1) = v0 + x(v1-v0);
 // x is the portion
@@ -178,26 +190,36 @@ bool existIn(std::string& ele, std::vector<std::string>& v) {
 
 
 
-// get a uniformly distributed number in range [0,1)
-float getRandomFloat() {
-	// see 
-	// https://stackoverflow.com/questions/38367976/do-stdrandom-device-and-stdmt19937-follow-an-uniform-distribution
-	//static int callt = 0;
+// sampler of the calling thread, picked by SAMPLER_TYPE at every sample
+thread_local Sampler* threadSampler = threadSamplerOf(SAMPLER_INDEPENDENT);
 
-	// an uniformly - distributed random number generator, use it to seed a pseudo-random generator
-	thread_local static std::random_device dev;
-	// a fast pseudo-random number generator, use this to seed a particular distribution
-#if DEBUG
-	thread_local static std::mt19937 rng(1);			// use when debug
-#else
-	thread_local static std::mt19937 rng(dev());	// use when release
-#endif
-	thread_local static std::uniform_real_distribution<float> dist(0,1); // distribution in range [0.0, 1.0)
-	
-	//std::cout << "call random " << ++callt << "times \n";
-	return dist(rng);	
+// get a uniformly distributed number in range [0,1): the next dimension of the current sample
+inline float getRandomFloat() {
+	return threadSampler->get1D();
+}
+
+// start sample `sample` of pixel `pixel`
+// every pixel and sample has its own numbers no matter which thread renders it,
+// so the image doesn't depend on which thread rendered which tile or on the thread count
+inline void startSample(int pixel, int sample) {
+	threadSampler = threadSamplerOf(SAMPLER_TYPE);
+	threadSampler->startSample(pixel, sample, SPP, RNG_SEED);
+}
+
+// the next draws are for the light or BSDF sampling of bounce depth
+inline void startBounce(int depth, SampleSlot slot, SampleStream stream = STREAM_EYE) {
+	threadSampler->startBounce(depth, slot, stream);
+}
+
+// position of the current sample inside its pixel, (0.5, 0.5) is the center
+inline void getPixelSample(float& dx, float& dy) {
+	threadSampler->setDimension(0);
+	dx = getRandomFloat();
+	dy = getRandomFloat();
 }
 
+
+
 // cout to terminal the progress
 void showProgress(float prog) {
 	int barWidth = 60;
@@ -372,6 +394,7 @@ float GeometrySmith(Vector3f& N, Vector3f& wi, Vector3f& wo, float k)
 }
 
 float getMisWeight(float pdf, float otherPdf) {
+	PROF_COUNT(PROF_MIS_WEIGHTS);
 	// balance heuristic
 	//return pdf / (pdf + otherPdf);
 
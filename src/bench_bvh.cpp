@@ -0,0 +1,147 @@
+#include "../include/PPMGenerator.hpp"
+#include "../include/Scene.hpp"
+#include "../include/BVH.hpp"
+#include "../include/QBVH.hpp"
+#include "../include/OBJ_Loader.h"
+
+#include <string>
+#include <chrono>
+#include <random>
+
+// binary BVH vs 4-wide BVH on the veach_bdpt models, single thread
+// primary: one ray through every pixel center
+// secondary: uniform random directions from the primary hits
+// shadow: occlusion rays between pairs of primary hits
+// usage: bench_bvh ../configs/config_veach_bdpt.txt [repeat]
+
+struct Ray {
+	Vector3f orig, dir;
+	float tMax = FLT_MAX;
+};
+
+template <typename F>
+double timeRays(int repeat, F trace) {
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < repeat; r++) trace();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cout << "ERROR: lack of the input configuration file, please provide its path as the first argument.\n";
+		return 0;
+	}
+	int repeat = argc > 2 ? std::stoi(argv[2]) : 5;
+
+	PPMGenerator g(argv[1]);
+
+	// materials don't matter here, only the geometry
+	Material mtl;
+	const char* models[] = { "veach_room", "veach_Llight", "veach_sLight", "veach_table",
+		"veach_glass", "veach_tallLamp", "veach_wallLamp" };
+	for (const char* m : models) {
+		objl::Loader loader;
+		if (loader.LoadFile(std::string("../model/veach_bdpt/") + m + ".obj"))
+			g.loadObj(loader, mtl);
+	}
+
+	g.scene.initializeBVH();
+	BVHAccel& bvh = *g.scene.BVHaccelerator;
+	QBVHAccel qbvh(bvh, g.scene.arena);
+	g.scene.reportMemory();
+
+	// primary rays through the pixel centers, same setup as the integrators
+	Camera& cam = g.cam;
+	Vector3f u = normalized(crossProduct(cam.fwdDir, cam.upDir));
+	Vector3f v = normalized(crossProduct(u, cam.fwdDir));
+	float d = cam.imagePlaneDist;
+	float width_half = fabs(tan(degree2Radians(cam.hfov / 2.f)) * d);
+	float height_half = width_half / (cam.width / (float)cam.height);
+	Vector3f n = normalized(g.viewdir);
+	Vector3f ul = cam.position + d * n - width_half * u + height_half * v;
+	Vector3f delta_h = (2 * width_half * u) / (float)g.width;
+	Vector3f delta_v = (-2 * height_half * v) / (float)g.height;
+
+	std::vector<Ray> primary;
+	for (int y = 0; y < g.height; y++) {
+		for (int x = 0; x < g.width; x++) {
+			Vector3f pixelPos = ul + (x + 0.5f) * delta_h + (y + 0.5f) * delta_v;
+			primary.push_back({ cam.position, normalized(pixelPos - cam.position) });
+		}
+	}
+
+	// the primary hits seed the other two sets
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> U(0.f, 1.f);
+	std::vector<Vector3f> hitPos;
+	std::vector<Ray> secondary, shadow;
+	for (const Ray& r : primary) {
+		Intersection inter;
+		if (!bvh.Intersect(r.orig, r.dir, inter)) continue;
+		Vector3f p = inter.pos + EPSILON * inter.Ng * (inter.Ng.dot(r.dir) < 0 ? 1.f : -1.f);
+		hitPos.push_back(p);
+
+		float z = 1 - 2 * U(rng), phi = 2 * M_PI * U(rng), s = sqrtf(fmax(0.f, 1 - z * z));
+		secondary.push_back({ p, Vector3f(s * cos(phi), s * sin(phi), z) });
+	}
+	for (int i = 0; i < hitPos.size(); i++) {
+		const Vector3f& a = hitPos[i];
+		const Vector3f& b = hitPos[(i * 7919LL) % hitPos.size()];
+		float dis = (b - a).norm();
+		if (dis < EPSILON) continue;
+		shadow.push_back({ a, normalized(b - a), dis - SHADOW_EPSILON });
+	}
+
+	std::cout << "\nprimitives: " << bvh.primitiveCount() << ", BVH nodes: " << bvh.getNodes().size()
+		<< ", QBVH nodes: " << qbvh.nodeCount() << "\n";
+	std::cout << "rays\t\tcount\tBVH Mrays/s\tQBVH Mrays/s\n";
+
+	struct Set { const char* name; std::vector<Ray>* rays; bool occlusion; };
+	Set sets[] = { { "primary", &primary, false }, { "secondary", &secondary, false }, { "shadow  ", &shadow, true } };
+	for (const Set& set : sets) {
+		const std::vector<Ray>& rays = *set.rays;
+		int hitsBVH = 0, hitsQBVH = 0;
+		double tBVH = timeRays(repeat, [&]() {
+			for (const Ray& r : rays) {
+				if (set.occlusion) hitsBVH += bvh.Occluded(r.orig, r.dir, 0.f, r.tMax);
+				else { Intersection inter; hitsBVH += bvh.Intersect(r.orig, r.dir, inter); }
+			}
+		});
+		double tQBVH = timeRays(repeat, [&]() {
+			for (const Ray& r : rays) {
+				if (set.occlusion) hitsQBVH += qbvh.Occluded(r.orig, r.dir, 0.f, r.tMax);
+				else { Intersection inter; hitsQBVH += qbvh.Intersect(r.orig, r.dir, inter); }
+			}
+		});
+		double nRays = (double)rays.size() * repeat;
+		std::cout << set.name << "\t" << rays.size() << "\t" << nRays / tBVH * 1e-6 << "\t\t" << nRays / tQBVH * 1e-6
+			<< (hitsBVH != hitsQBVH ? "\tHIT COUNT MISMATCH" : "") << "\n";
+	}
+
+	// primary rays again, RAY_PACKET_SIZE neighbouring pixels of a row per packet
+	{
+		Vector3f origs[RAY_PACKET_SIZE], dirs[RAY_PACKET_SIZE];
+		Intersection inters[RAY_PACKET_SIZE];
+		int hits = 0;
+		double tPacket = timeRays(repeat, [&]() {
+			for (int y = 0; y < g.height; y++) {
+				for (int x0 = 0; x0 < g.width; x0 += RAY_PACKET_SIZE) {
+					int n = std::min(RAY_PACKET_SIZE, g.width - x0);
+					for (int k = 0; k < n; k++) {
+						origs[k] = primary[y * g.width + x0 + k].orig;
+						dirs[k] = primary[y * g.width + x0 + k].dir;
+						inters[k] = Intersection();
+					}
+					bvh.IntersectPacket(origs, dirs, n, inters);
+					for (int k = 0; k < n; k++) hits += inters[k].intersected;
+				}
+			}
+		});
+		double nRays = (double)primary.size() * repeat;
+		std::cout << "primary, packets of " << RAY_PACKET_SIZE << "\t" << nRays / tPacket * 1e-6 << " Mrays/s (BVH)"
+			<< (hits != (int)hitPos.size() * repeat ? "\tHIT COUNT MISMATCH" : "") << "\n";
+	}
+
+	return 0;
+}
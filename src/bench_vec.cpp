@@ -0,0 +1,171 @@
+#include "../include/Vector.hpp"
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <random>
+
+// vector math throughput, single thread, millions of operations per second
+// dot, cross, normalize: Vector3f one at a time (array of structures) vs Vec3x8 (structure of arrays)
+// matrix: Mat4f * Vector4f, transformPoint and Mat4f * Mat4f vs the plain scalar loops they replaced
+// build with -DVECTOR_SIMD=0 for the scalar fallback, add -mavx2 -mfma for 8 wide Vec3x8
+// usage: bench_vec [repeat]
+
+#define N_VEC (1 << 16)
+
+template <typename F>
+double timeOps(int repeat, F op) {
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < repeat; r++) op();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - start).count();
+}
+
+void report(const char* name, double seconds, long long ops) {
+	printf("  %-26s %8.1f Mops/s\n", name, ops / seconds * 1e-6);
+}
+
+// the scalar versions Mat4f had before it went to Float4, the reference for the results
+Vector4f scalarMul(const Mat4f& m, const Vector4f& v) {
+	const float* e = m.ele;
+	return Vector4f(v.x * e[0] + v.y * e[1] + v.z * e[2] + v.w * e[3],
+		v.x * e[4] + v.y * e[5] + v.z * e[6] + v.w * e[7],
+		v.x * e[8] + v.y * e[9] + v.z * e[10] + v.w * e[11],
+		v.x * e[12] + v.y * e[13] + v.z * e[14] + v.w * e[15]);
+}
+
+Vector3f scalarTransformPoint(const Mat4f& m, const Vector3f& p) {
+	float w = m.get(3, 3);
+	for (int c = 0; c < 3; c++) w += m.get(3, c) * p.get(c);
+	const float invW = 1.f / w;
+	float res[3];
+	for (int r = 0; r < 3; r++) {
+		res[r] = m.get(r, 3);
+		for (int c = 0; c < 3; c++) res[r] += p.get(c) * m.get(r, c);
+		res[r] *= invW;
+	}
+	return Vector3f(res[0], res[1], res[2]);
+}
+
+Mat4f scalarMul(const Mat4f& left, const Mat4f& right) {
+	Mat4f res;
+	for (int row = 0; row < 4; row++) {
+		for (int col = 0; col < 4; col++) {
+			float r = 0;
+			for (int i = 0; i < 4; i++) r += left.get(row, i) * right.get(i, col);
+			res.set(row, col, r);
+		}
+	}
+	return res;
+}
+
+int main(int argc, char* argv[]) {
+	int repeat = argc > 1 ? std::stoi(argv[1]) : 200;
+	long long ops = (long long)N_VEC * repeat;
+	std::cout << "vector math backend: " << simdBackend() << ", " << N_VEC << " vectors x " << repeat << "\n";
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> U(-1.f, 1.f);
+	std::vector<Vector3f> a(N_VEC), b(N_VEC), out(N_VEC);
+	// the same vectors as structure of arrays
+	std::vector<float> ax(N_VEC), ay(N_VEC), az(N_VEC), bx(N_VEC), by(N_VEC), bz(N_VEC);
+	std::vector<float> ox(N_VEC), oy(N_VEC), oz(N_VEC);
+	for (int i = 0; i < N_VEC; i++) {
+		a[i] = Vector3f(U(rng), U(rng), U(rng));
+		b[i] = Vector3f(U(rng), U(rng), U(rng));
+		ax[i] = a[i].x; ay[i] = a[i].y; az[i] = a[i].z;
+		bx[i] = b[i].x; by[i] = b[i].y; bz[i] = b[i].z;
+	}
+	auto loadA = [&](int i) { return Vec3x8(Float8::load(&ax[i]), Float8::load(&ay[i]), Float8::load(&az[i])); };
+	auto loadB = [&](int i) { return Vec3x8(Float8::load(&bx[i]), Float8::load(&by[i]), Float8::load(&bz[i])); };
+	auto storeOut = [&](int i, const Vec3x8& v) { v.x.store(&ox[i]); v.y.store(&oy[i]); v.z.store(&oz[i]); };
+	volatile float sink = 0;
+
+	std::cout << "dot\n";
+	report("Vector3f", timeOps(repeat, [&]() {
+		float s = 0;
+		for (int i = 0; i < N_VEC; i++) s += a[i].dot(b[i]);
+		sink = sink + s;
+	}), ops);
+	report("Vec3x8", timeOps(repeat, [&]() {
+		Float8 s(0.f);
+		for (int i = 0; i < N_VEC; i += 8) s = s + dot(loadA(i), loadB(i));
+		for (int l = 0; l < 8; l++) sink = sink + s[l];
+	}), ops);
+
+	std::cout << "cross\n";
+	report("Vector3f", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) out[i] = crossProduct(a[i], b[i]);
+	}), ops);
+	report("Vec3x8", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i += 8) storeOut(i, crossProduct(loadA(i), loadB(i)));
+	}), ops);
+
+	std::cout << "normalize\n";
+	report("Vector3f", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) out[i] = normalized(a[i]);
+	}), ops);
+	report("Vec3x8", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i += 8) storeOut(i, normalized(loadA(i)));
+	}), ops);
+	// the lanes agree with the scalar version up to rounding
+	float maxErr = 0;
+	for (int i = 0; i < N_VEC; i++) {
+		Vector3f d = normalized(a[i]) - Vector3f(ox[i], oy[i], oz[i]);
+		maxErr = std::max(maxErr, std::max(fabsf(d.x), std::max(fabsf(d.y), fabsf(d.z))));
+	}
+	std::cout << "  max difference " << maxErr << "\n";
+
+	// the camera's world to raster matrix shape: perspective times a rigid transform
+	Mat4f m = getPerspectiveMatrix(40.f, 0.1f, 100.f, 4.f / 3.f) * Mat4f::getTranslate(Vector3f(0.5f, -1.f, 3.f));
+	std::vector<Vector4f> p4(N_VEC), o4(N_VEC);
+	std::vector<Mat4f> mats(N_VEC), omats(N_VEC);
+	for (int i = 0; i < N_VEC; i++) {
+		p4[i] = Vector4f(a[i].x, a[i].y, a[i].z, 1.f);
+		mats[i] = Mat4f::getScale(b[i] + Vector3f(2.f)) * Mat4f::getTranslate(a[i]);
+	}
+	int mismatches = 0;
+
+	std::cout << "Mat4f * Vector4f\n";
+	report("scalar loops", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) o4[i] = scalarMul(m, p4[i]);
+	}), ops);
+	report("Mat4f", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) o4[i] = m * p4[i];
+	}), ops);
+	for (int i = 0; i < N_VEC; i++) {
+		Vector4f r = scalarMul(m, p4[i]);
+		mismatches += memcmp(&r, &o4[i], sizeof(Vector4f)) != 0;
+	}
+
+	std::cout << "transformPoint\n";
+	report("scalar loops", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) out[i] = scalarTransformPoint(m, a[i]);
+	}), ops);
+	report("Mat4f", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) out[i] = m.transformPoint(a[i]);
+	}), ops);
+	for (int i = 0; i < N_VEC; i++) {
+		Vector3f r = scalarTransformPoint(m, a[i]);
+		mismatches += memcmp(&r, &out[i], sizeof(Vector3f)) != 0;
+	}
+
+	std::cout << "Mat4f * Mat4f\n";
+	report("scalar loops", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) omats[i] = scalarMul(m, mats[i]);
+	}), ops);
+	report("Mat4f", timeOps(repeat, [&]() {
+		for (int i = 0; i < N_VEC; i++) omats[i] = m * mats[i];
+	}), ops);
+	for (int i = 0; i < N_VEC; i++) {
+		Mat4f r = scalarMul(m, mats[i]);
+		mismatches += memcmp(r.ele, omats[i].ele, sizeof(r.ele)) != 0;
+	}
+
+	// the matrix products add up in the order of the scalar loops
+	std::cout << "matrix results different from the scalar loops: " << mismatches << "\n";
+	return 0;
+}
@@ -5,12 +5,11 @@
 #include "../include/Renderer.hpp"
 #include "../include/OBJ_Loader.h"
 #include "../include/Postprocessor.hpp"
+#include "../include/Scenes.hpp"
 
 #include <string>
 #include <chrono>
 
-// use EPSILON 0.0005f   in global
-
 int main(int argc, char* argv[]) {
 	if (argc < 2) {
 		std::cout << "ERROR: lack of the input configuration file, please provide its path as the first argument.\n";
@@ -19,71 +18,10 @@ int main(int argc, char* argv[]) {
 
 
 	PPMGenerator g(argv[1]);
+	parseThreadArgs(argc, argv);	// --threads N --pin core, override the config
 
 
-	Material roomMtl;
-	roomMtl.mType = LAMBERTIAN;
-	roomMtl.diffuse = { 0.725f, 0.71f, 0.68f };
-
-	objl::Loader room;
-	if (room.LoadFile("../model/veach_bdpt/veach_room.obj")) {
-		g.loadObj(room, roomMtl);
-	}
-
-	Material LlightMtl;
-	LlightMtl.diffuse = { 0.725f, 0.71f, 0.68f };
-	LlightMtl.emission = { 500.0 , 500.0 , 500.0 };
-	LlightMtl.emission = LlightMtl.emission * 0.5;
-
-	objl::Loader Llight;
-	if (Llight.LoadFile("../model/veach_bdpt/veach_Llight.obj")) {
-		g.loadObj(Llight, LlightMtl);
-	}
-
-	Material sLlightMtl;
-	sLlightMtl.diffuse = { 0.725f, 0.71f, 0.68f };
-	sLlightMtl.emission = { 6999.999881f, 5450.000167f, 3630.000055f} ;
-	sLlightMtl.emission = sLlightMtl.emission * 0.5;
-
-	objl::Loader slight;
-	if (slight.LoadFile("../model/veach_bdpt/veach_slight.obj")) {
-		g.loadObj(slight, sLlightMtl);
-	}
-
-	Material tableMtl;
-	tableMtl.mType = LAMBERTIAN;
-	tableMtl.diffuse = { 0.32962962985, 0.257976263762, 0.150291711092 };
-
-	objl::Loader table;
-	if (table.LoadFile("../model/veach_bdpt/veach_table.obj")) {
-		g.loadObj(table, tableMtl);
-	}
-
-	Material glassMtl;
-	glassMtl.mType = PERFECT_REFRACTIVE;
-	glassMtl.eta = 1.5f;
-
-	objl::Loader glass;
-	if (glass.LoadFile("../model/veach_bdpt/veach_glass.obj")) {
-		g.loadObj(glass, glassMtl);
-	}
-
-	Material tallLampMtl;
-	tallLampMtl.mType = MICROFACET_R;
-	tallLampMtl.roughness = 0.2775146484375f;
-	tallLampMtl.metallic = 0.5f;
-	tallLampMtl.diffuse = { 0.32962962985, 0.257976263762, 0.150291711092 };
-
-	objl::Loader tallLamp;
-	if (tallLamp.LoadFile("../model/veach_bdpt/veach_tallLamp.obj")) {
-		g.loadObj(tallLamp, tallLampMtl);
-	}
-
-
-	objl::Loader wallLamp;
-	if (wallLamp.LoadFile("../model/veach_bdpt/veach_wallLamp.obj")) {
-		g.loadObj(wallLamp, roomMtl);
-	}
+	addVeachBdpt(g);
 
 
 	Renderer r(&g);
@@ -0,0 +1,84 @@
+#include "../include/TileScheduler.hpp"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+
+// every tile is rendered exactly once
+// deque: one owner popping and thieves stealing from short deques, so the owner and a thief race for
+// the last tile again and again. scheduler: all tiles of an image on more threads than cores
+// usage: test_tiles [rounds], returns 1 on failure
+
+// each tile's x0 is its index
+bool testDeque(int rounds, int nThieves) {
+	int failures = 0;
+	for (int r = 0; r < rounds; r++) {
+		int n = 1 + r % 3;
+		TileDeque q;
+		for (int i = 0; i < n; i++) q.push({ i, 0, i + 1, 1 });
+
+		// one slot past the end, a tile read from there shows up as index n
+		std::unique_ptr<std::atomic<int>[]> taken(new std::atomic<int>[n + 1]);
+		for (int i = 0; i <= n; i++) taken[i] = 0;
+		auto take = [&](const Tile& t) {
+			taken[(t.x0 >= 0 && t.x0 < n) ? t.x0 : n]++;
+		};
+
+		std::atomic<bool> go{ false };
+		std::vector<std::thread> thieves;
+		for (int k = 0; k < nThieves; k++) {
+			thieves.emplace_back([&]() {
+				while (!go.load()) std::this_thread::yield();
+				Tile t;
+				while (true) {
+					TileDeque::StealResult s = q.steal(t);
+					if (s == TileDeque::STEAL_OK) take(t);
+					else if (s == TileDeque::STEAL_EMPTY) break;
+				}
+			});
+		}
+		go.store(true);
+		// the owner pops again after running dry, like TileScheduler::work after a stolen tile
+		Tile t;
+		for (int k = 0; k < 2; k++)
+			while (q.pop(t)) take(t);
+		for (std::thread& th : thieves) th.join();
+
+		for (int i = 0; i <= n; i++) {
+			int expected = i < n ? 1 : 0;
+			if (taken[i] != expected) {
+				if (failures++ < 10)
+					printf("round %d: tile %d of %d taken %d times\n", r, i, n, taken[i].load());
+			}
+		}
+	}
+	printf("deque: %d rounds, %d thieves, %d failures\n", rounds, nThieves, failures);
+	return failures == 0;
+}
+
+bool testScheduler(int width, int height, int nThreads) {
+	std::unique_ptr<std::atomic<int>[]> rendered(new std::atomic<int>[width * height]);
+	for (int i = 0; i < width * height; i++) rendered[i] = 0;
+
+	TileScheduler scheduler(width, height, nThreads, 4);
+	scheduler.run([&](const Tile& tile, int threadID) {
+		for (int y = tile.y0; y < tile.y1; y++)
+			for (int x = tile.x0; x < tile.x1; x++) rendered[y * width + x]++;
+	});
+
+	int failures = 0;
+	for (int i = 0; i < width * height; i++) failures += rendered[i] != 1;
+	printf("scheduler: %dx%d, %d threads, %d pixels not rendered exactly once\n", width, height, nThreads, failures);
+	return failures == 0;
+}
+
+int main(int argc, char* argv[]) {
+	int rounds = argc > 1 ? std::stoi(argv[1]) : 20000;
+	bool ok = testDeque(rounds, 1);
+	ok = testDeque(rounds / 4, 3) && ok;
+	ok = testScheduler(97, 61, 8) && ok;
+	printf(ok ? "passed\n" : "FAILED\n");
+	return ok ? 0 : 1;
+}
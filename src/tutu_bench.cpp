@@ -0,0 +1,197 @@
+#include "../include/PPMGenerator.hpp"
+#include "../include/Renderer.hpp"
+#include "../include/Scenes.hpp"
+
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+
+// fixed renders to track performance across changes: the scenes of the mains with the configs in
+// configs/bench, fixed image size, spp and seed. per scene: load (OBJ + BVH), render and output time,
+// Mrays/s, samples/s, the profiler's stage times and the RMSE of the image against the stored reference
+// configs/bench/<scene>_ref.ppm. images and results land in the working directory, tutu_bench.json
+// usage: tutu_bench [--root <repo folder>] [--threads N] [--pin none|core|numa] [--reference]
+// --reference renders the references with REFERENCE_SPP_SCALE times the samples and stores them
+
+#ifndef TUTU_SOURCE_DIR
+#define TUTU_SOURCE_DIR ".."
+#endif
+
+#define REFERENCE_SPP_SCALE 16
+
+struct BenchScene {
+	const char* name;		// configs/bench/<name>.txt
+	void (*add)(PPMGenerator& g, const std::string& modelDir);
+};
+
+struct BenchResult {
+	std::string name, integrator;
+	int width = 0, height = 0, spp = 0;
+	double loadMs = 0, renderMs = 0, outputMs = 0;
+	long long samples = 0;
+	unsigned long long rays = 0;			// closest hit + any hit queries, 0 without PROFILE
+	double stageMs[PROF_STAGES] = {};
+	double rmse = -1;						// -1: no reference
+};
+
+// P3 image as floats in [0, 1], false if it can't be read
+bool readPPM(const std::string& path, std::vector<float>& rgb, int& width, int& height) {
+	std::ifstream in(path);
+	std::string magic;
+	int maxValue;
+	if (!(in >> magic >> width >> height >> maxValue) || magic != "P3" || maxValue <= 0) return false;
+	rgb.resize((size_t)width * height * 3);
+	for (float& c : rgb) {
+		int v;
+		if (!(in >> v)) return false;
+		c = v / (float)maxValue;
+	}
+	return true;
+}
+
+// over all channels of all pixels, -1 if the images can't be compared
+double imageRMSE(const std::string& a, const std::string& b) {
+	std::vector<float> x, y;
+	int wx, hx, wy, hy;
+	if (!readPPM(a, x, wx, hx) || !readPPM(b, y, wy, hy) || wx != wy || hx != hy) return -1;
+	double sum = 0;
+	for (size_t i = 0; i < x.size(); i++) sum += (double)(x[i] - y[i]) * (x[i] - y[i]);
+	return sqrt(sum / std::max<size_t>(x.size(), 1));
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+BenchResult runScene(const BenchScene& s, const std::string& root, bool reference) {
+	BenchResult res;
+	res.name = s.name;
+	std::string benchDir = root + "/configs/bench/";
+
+	// the config is copied to the working directory, the image is written next to it
+	std::string config = std::string("tutu_bench_") + s.name + ".txt";
+	{
+		std::ifstream in(benchDir + s.name + ".txt");
+		if (!in.is_open()) throw std::runtime_error(benchDir + s.name + ".txt: can't open the bench config\n");
+		std::ofstream out(config);
+		out << in.rdbuf();
+	}
+
+	std::cout << "\n==== " << s.name << " ====\n";
+	PPMGenerator g(config.c_str());
+	if (reference) {
+		SPP *= REFERENCE_SPP_SCALE;
+		SPP_inv = 1.f / SPP;
+	}
+	s.add(g, root + "/model/");
+
+	auto start = std::chrono::steady_clock::now();
+	Renderer r(&g);
+	res.loadMs = msSince(start);
+
+	r.render();
+	res.renderMs = r.renderMs;
+
+	start = std::chrono::steady_clock::now();
+	g.generate();
+	res.outputMs = msSince(start);
+
+	res.integrator = r.integratorName();
+	res.width = g.width;
+	res.height = g.height;
+	res.spp = SPP;
+	for (int c : g.cam.sampleCount) res.samples += c;
+#if PROFILE
+	ProfileCounters p = profileTotal();
+	double msPerTick = profileMsPerTick();
+	res.rays = p.count[PROF_RAYS] + p.count[PROF_SHADOW_RAYS];
+	for (int st = 0; st < PROF_STAGES; st++) res.stageMs[st] = p.ticks[st] * msPerTick;
+#endif
+
+	std::string image = g.outputName(".ppm");
+	std::string refImage = benchDir + s.name + "_ref.ppm";
+	if (reference) {
+		std::ifstream in(image);
+		std::ofstream out(refImage);
+		out << in.rdbuf();
+		std::cout << "reference written to " << refImage << "\n";
+	}
+	else res.rmse = imageRMSE(image, refImage);
+	return res;
+}
+
+void writeResults(const std::string& path, const std::vector<BenchResult>& results) {
+	std::ofstream out(path);
+	out << "{\n\t\"threads\": " << N_THREAD << ",\n\t\"simd\": \"" << simdBackend() << "\",\n\t\"profile\": " << PROFILE
+		<< ",\n\t\"ray_query_stages\": " << (PROFILE_RAY_STAGES ? "true" : "false") << ",\n\t\"scenes\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		double seconds = r.renderMs * 1e-3;
+		out << (i ? ", " : "") << "{\n\t\t\"name\": \"" << r.name << "\",\n\t\t\"integrator\": \"" << r.integrator
+			<< "\",\n\t\t\"width\": " << r.width << ",\n\t\t\"height\": " << r.height << ",\n\t\t\"spp\": " << r.spp
+			<< ",\n\t\t\"load_ms\": " << r.loadMs << ",\n\t\t\"render_ms\": " << r.renderMs << ",\n\t\t\"output_ms\": " << r.outputMs
+			<< ",\n\t\t\"samples\": " << r.samples << ",\n\t\t\"samples_per_s\": " << (seconds > 0 ? r.samples / seconds : 0)
+			<< ",\n\t\t\"rays\": " << r.rays << ",\n\t\t\"mrays_per_s\": " << (seconds > 0 ? r.rays / seconds * 1e-6 : 0)
+			<< ",\n\t\t\"stage_ms\": {";
+		for (int s = STAGE_TILE; s < PROF_STAGES; s++)
+			out << (s > STAGE_TILE ? ", " : " ") << "\"" << profileStageName(s) << "\": " << r.stageMs[s];
+		out << " },\n\t\t\"rmse\": ";
+		if (r.rmse < 0) out << "null";
+		else out << r.rmse;
+		out << "\n\t}";
+	}
+	out << "]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+	std::string root = TUTU_SOURCE_DIR;
+	bool reference = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--root" && i + 1 < argc) root = argv[++i];
+		else if (arg == "--reference") reference = true;
+		// --threads N, --pin mode
+		else if (i + 1 < argc) {
+			parseThreadArgs(i + 2, argv, i);
+			i++;
+		}
+		else throw std::runtime_error("unknown argument " + arg + ", expect --root <dir>, --reference, --threads N or --pin none|core|numa\n");
+	}
+
+	const BenchScene scenes[] = {
+		{ "cornellBox", addCornellBox },
+		{ "veach_bdpt", addVeachBdpt },
+	};
+	std::vector<BenchResult> results;
+	for (const BenchScene& s : scenes) results.push_back(runScene(s, root, reference));
+
+	printf("\ntutu_bench: %d threads, %s vector math%s\n", N_THREAD, simdBackend(), PROFILE ? "" : ", PROFILE 0: no ray counts");
+	printf("%-12s %-10s %9s %10s %9s %9s %11s %9s\n", "scene", "integrator", "load ms", "render ms", "output ms",
+		"Mrays/s", "Msamples/s", "RMSE");
+	for (const BenchResult& r : results) {
+		double seconds = r.renderMs * 1e-3;
+		printf("%-12s %-10s %9.1f %10.1f %9.1f %9.2f %11.4f ", r.name.c_str(), r.integrator.c_str(), r.loadMs, r.renderMs,
+			r.outputMs, seconds > 0 ? r.rays / seconds * 1e-6 : 0.0, seconds > 0 ? r.samples / seconds * 1e-6 : 0.0);
+		if (r.rmse < 0) printf("%9s\n", reference ? "-" : "no ref");
+		else printf("%9.5f\n", r.rmse);
+	}
+#if PROFILE
+	// where the render time went, summed over the threads
+	printf("\n%-12s", "stage ms");
+	for (int s = STAGE_TILE; s < PROF_STAGES; s++) printf(" %10s", profileStageName(s));
+	printf("\n");
+	for (const BenchResult& r : results) {
+		printf("%-12s", r.name.c_str());
+		for (int s = STAGE_TILE; s < PROF_STAGES; s++) printf(" %10.1f", r.stageMs[s]);
+		printf("\n");
+	}
+	if (!PROFILE_RAY_STAGES) printf("%s\n", PROFILE_STAGE_NOTE);
+#endif
+
+	writeResults("tutu_bench.json", results);
+	std::cout << "\nresults written to tutu_bench.json\n";
+	return 0;
+}